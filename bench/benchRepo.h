@@ -0,0 +1,107 @@
+#ifndef BENCH_REPO_H
+#define BENCH_REPO_H
+
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <unordered_map>
+#include <string>
+#include <vector>
+
+#include "repository.h"
+#include "object.h"
+
+namespace fs = std::filesystem;
+
+// A throwaway repository with a synthetic linear history: `files` files
+// spread over nested directories, and `commits` commits that each rewrite
+// a few random files. Unchanged directories keep their tree ids, as in a
+// real history.
+class BenchRepo {
+public:
+    BenchRepo(const std::string &name, size_t commits, size_t files, unsigned seed = 1)
+        : dir(fs::temp_directory_path() / name), blobs(files) {
+        if (fs::exists(dir)) {
+            fs::remove_all(dir);
+        }
+        fs::create_directory(dir);
+        GitRepository::repo_create(dir);
+        GitRepository repo(dir);
+        std::mt19937 rng(seed);
+        for (size_t i = 0; i < files; ++i) {
+            blobs[i] = write_raw_object(repo, "blob", "initial " + std::to_string(i) + "\n");
+        }
+        for (size_t c = 0; c < commits; ++c) {
+            size_t changes = c == 0 ? 0 : 1 + rng() % 3;
+            for (size_t k = 0; k < changes; ++k) {
+                std::string content = "revision " + std::to_string(c) + " " + std::to_string(rng()) + "\n";
+                blobs[rng() % files] = write_raw_object(repo, "blob", content);
+            }
+            std::string body = "tree " + write_tree(repo, 0, files, 0) + "\n";
+            if (!tip.empty()) {
+                body += "parent " + tip + "\n";
+            }
+            std::string stamp = std::to_string(1700000000 + c * 60);
+            body += "author bench <bench@example.com> " + stamp + " +0000\n";
+            body += "committer bench <bench@example.com> " + stamp + " +0000\n\ncommit " + std::to_string(c) + "\n";
+            tip = write_raw_object(repo, "commit", body);
+        }
+    }
+    ~BenchRepo() {
+        fs::remove_all(dir);
+    }
+    BenchRepo(const BenchRepo &) = delete;
+    BenchRepo &operator=(const BenchRepo &) = delete;
+
+    // Path of file i, e.g. "d3/d1/f17.txt".
+    static std::string file_path(size_t i) {
+        return "d" + std::to_string(i % 10) + "/d" + std::to_string(i / 10 % 10) + "/f" + std::to_string(i) + ".txt";
+    }
+
+    fs::path dir;
+    std::string tip;
+private:
+    static std::string to_bytes(const std::string &hex) {
+        std::string out;
+        for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+            out += static_cast<char>(std::stoi(hex.substr(i, 2), nullptr, 16));
+        }
+        return out;
+    }
+
+    // Files are grouped by the digits their path is built from, so each
+    // level splits its range ten ways; names are emitted in sorted order.
+    std::string write_tree(const GitRepository &repo, size_t level, size_t files, size_t key) {
+        std::string body;
+        if (level == 2) {
+            std::vector<std::pair<std::string, size_t>> names;
+            for (size_t i = 0; i < files; ++i) {
+                if (i % 10 == key % 10 && i / 10 % 10 == key / 10) {
+                    names.emplace_back("f" + std::to_string(i) + ".txt", i);
+                }
+            }
+            std::sort(names.begin(), names.end());
+            for (const auto &[name, i] : names) {
+                body += "100644 " + name + std::string(1, '\0') + to_bytes(blobs[i]);
+            }
+        }
+        else {
+            for (size_t d = 0; d < 10; ++d) {
+                size_t child = level == 0 ? d : key + d * 10;
+                body += "40000 d" + std::to_string(d) + std::string(1, '\0') +
+                        to_bytes(write_tree(repo, level + 1, files, child));
+            }
+        }
+        auto [it, inserted] = trees.emplace(body, "");
+        if (inserted) {
+            it->second = write_raw_object(repo, "tree", body);
+        }
+        return it->second;
+    }
+
+    std::vector<std::string> blobs;
+    // Tree bodies already written, so unchanged directories are not rehashed.
+    std::unordered_map<std::string, std::string> trees;
+};
+
+#endif // BENCH_REPO_H
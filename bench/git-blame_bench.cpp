@@ -0,0 +1,94 @@
+#include <benchmark/benchmark.h>
+
+#include "benchRepo.h"
+#include "blame.h"
+
+namespace {
+
+// One 2000-line file, hot/hot.txt, edited a few lines at a time by 500
+// commits.
+struct HotFile {
+    BenchRepo repo{"git_cli_bench_blame", 0, 0};
+    std::string tip;
+
+    HotFile() {
+        GitRepository git(repo.dir);
+        std::mt19937 rng(5);
+        std::vector<std::string> lines;
+        for (size_t i = 0; i < 2000; ++i) {
+            lines.push_back("line " + std::to_string(i));
+        }
+        auto entry = [](const std::string &mode, const std::string &name, const std::string &sha) {
+            std::string raw;
+            for (size_t i = 0; i < sha.size(); i += 2) {
+                raw += static_cast<char>(std::stoi(sha.substr(i, 2), nullptr, 16));
+            }
+            return mode + " " + name + std::string(1, '\0') + raw;
+        };
+        std::string parent;
+        for (size_t c = 0; c < 500; ++c) {
+            for (size_t k = 0; k < 3; ++k) {
+                size_t at = rng() % lines.size();
+                if (rng() % 2) {
+                    lines[at] = "edit " + std::to_string(c) + " " + std::to_string(rng());
+                }
+                else {
+                    lines.insert(lines.begin() + at, "insert " + std::to_string(c));
+                }
+            }
+            std::string content;
+            for (const auto &line : lines) {
+                content += line + "\n";
+            }
+            std::string blob = write_raw_object(git, "blob", content);
+            std::string dir = write_raw_object(git, "tree", entry("100644", "hot.txt", blob));
+            std::string tree = write_raw_object(git, "tree", entry("40000", "hot", dir));
+            std::string body = "tree " + tree + "\n";
+            if (!parent.empty()) {
+                body += "parent " + parent + "\n";
+            }
+            std::string stamp = std::to_string(1700000000 + c * 60) + " +0000";
+            body += "author bench <bench@example.com> " + stamp + "\ncommitter bench <bench@example.com> " + stamp +
+                    "\n\nedit\n";
+            parent = write_raw_object(git, "commit", body);
+        }
+        tip = parent;
+    }
+};
+
+HotFile &hot_file() {
+    static HotFile file;
+    return file;
+}
+
+void BM_BlameCold(benchmark::State &state) {
+    HotFile &file = hot_file();
+    GitRepository repo(file.repo.dir);
+    BlameStats stats;
+    for (auto _ : state) {
+        BlameDiffCache cache;
+        repo.object_cache().clear();
+        stats = blame_file(repo, file.tip, "hot/hot.txt", cache).stats;
+    }
+    state.counters["commits"] = stats.commits;
+    state.counters["diffs"] = stats.diffs;
+}
+
+// Repeated blames of the same file, as from a long-running server.
+void BM_BlameCachedDiffs(benchmark::State &state) {
+    HotFile &file = hot_file();
+    GitRepository repo(file.repo.dir);
+    BlameDiffCache cache;
+    blame_file(repo, file.tip, "hot/hot.txt", cache);
+    BlameStats stats;
+    for (auto _ : state) {
+        stats = blame_file(repo, file.tip, "hot/hot.txt", cache).stats;
+    }
+    state.counters["commits"] = stats.commits;
+    state.counters["cached_diffs"] = stats.cached_diffs;
+}
+
+}
+
+BENCHMARK(BM_BlameCold)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_BlameCachedDiffs)->Unit(benchmark::kMillisecond);
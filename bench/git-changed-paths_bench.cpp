@@ -0,0 +1,42 @@
+#include <benchmark/benchmark.h>
+
+#include "benchRepo.h"
+#include "changedPaths.h"
+
+namespace {
+
+// 2000 commits over 1000 files, with filters written once up front.
+BenchRepo &history() {
+    static BenchRepo repo("git_cli_bench_changed_paths", 2000, 1000);
+    static bool indexed = (write_changed_path_index(GitRepository(repo.dir), {repo.tip}), true);
+    (void)indexed;
+    return repo;
+}
+
+void log_one_path(benchmark::State &state, bool use_filters) {
+    BenchRepo &bench = history();
+    GitRepository repo(bench.dir);
+    PathLogOptions options;
+    options.use_filters = use_filters;
+    PathLogStats stats;
+    for (auto _ : state) {
+        stats = log_path(repo, bench.tip, BenchRepo::file_path(417), options, nullptr);
+        benchmark::DoNotOptimize(stats.shown);
+    }
+    state.counters["commits"] = stats.commits;
+    state.counters["trees_compared"] = stats.compared;
+    state.counters["shown"] = stats.shown;
+}
+
+void BM_LogPathWithFilters(benchmark::State &state) {
+    log_one_path(state, true);
+}
+
+void BM_LogPathWithoutFilters(benchmark::State &state) {
+    log_one_path(state, false);
+}
+
+}
+
+BENCHMARK(BM_LogPathWithFilters)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LogPathWithoutFilters)->Unit(benchmark::kMillisecond);
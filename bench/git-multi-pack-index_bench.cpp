@@ -0,0 +1,112 @@
+#include <benchmark/benchmark.h>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <zlib.h>
+
+#include "benchRepo.h"
+#include "pack.h"
+
+namespace {
+
+constexpr size_t total_objects = 8192;
+
+std::string deflate_string(const std::string &data) {
+    uLongf len = compressBound(data.size());
+    std::string out(len, '\0');
+    compress2(reinterpret_cast<Bytef *>(out.data()), &len, reinterpret_cast<const Bytef *>(data.data()), data.size(),
+              Z_BEST_SPEED);
+    out.resize(len);
+    return out;
+}
+
+std::string blob_id(const std::string &content) {
+    SHA1 hasher;
+    hasher.update("blob " + std::to_string(content.size()) + std::string(1, '\0') + content);
+    return hasher.final();
+}
+
+// total_objects small blobs spread over `packs` packs in objects/pack, no
+// loose objects; with_midx adds a multi-pack-index over all of them.
+struct PackedStore {
+    BenchRepo repo;
+    std::vector<std::string> ids;
+
+    PackedStore(size_t packs, bool with_midx)
+        : repo("git_cli_bench_midx_" + std::to_string(packs) + (with_midx ? "_midx" : ""), 0, 0) {
+        GitRepository git(repo.dir);
+        fs::path pack_dir = repo.dir / ".git" / "objects" / "pack";
+        fs::create_directories(pack_dir);
+        size_t per_pack = total_objects / packs;
+        for (size_t p = 0; p < packs; ++p) {
+            std::string pack("PACK\0\0\0\2", 8);
+            for (int shift = 24; shift >= 0; shift -= 8) {
+                pack += static_cast<char>(per_pack >> shift & 0xff);
+            }
+            for (size_t i = 0; i < per_pack; ++i) {
+                std::string content = "object " + std::to_string(p * per_pack + i) + "\n";
+                ids.push_back(blob_id(content));
+                // Sizes stay under 128, so the entry header is two bytes.
+                pack += static_cast<char>(0x80 | 3 << 4 | (content.size() & 15));
+                pack += static_cast<char>(content.size() >> 4);
+                pack += deflate_string(content);
+            }
+            SHA1 hasher;
+            hasher.update(pack);
+            std::string checksum = hasher.final();
+            for (size_t i = 0; i < checksum.size(); i += 2) {
+                pack += static_cast<char>(std::stoi(checksum.substr(i, 2), nullptr, 16));
+            }
+            fs::path path = pack_dir / ("pack-" + std::to_string(p) + ".pack");
+            std::ofstream(path, std::ios::binary) << pack;
+            IndexPackOptions options;
+            options.index_path = pack_dir / ("pack-" + std::to_string(p) + ".idx");
+            index_pack(git, path, options);
+        }
+        if (with_midx) {
+            write_multi_pack_index(git);
+        }
+        std::shuffle(ids.begin(), ids.end(), std::mt19937(9));
+    }
+};
+
+PackedStore &store(size_t packs, bool with_midx) {
+    static std::map<std::pair<size_t, bool>, std::unique_ptr<PackedStore>> stores;
+    auto &slot = stores[{packs, with_midx}];
+    if (!slot) {
+        slot = std::make_unique<PackedStore>(packs, with_midx);
+    }
+    return *slot;
+}
+
+// Existence checks for every object in random order, the lookup pattern of
+// a connectivity walk. Without the multi-pack-index a miss in one .idx
+// moves on to the next, so the cost grows with the pack count.
+void BM_PackLookup(benchmark::State &state) {
+    PackedStore &packed = store(state.range(0), state.range(1));
+    GitRepository repo(packed.repo.dir);
+    repo.packs().contains(packed.ids[0]);
+    for (auto _ : state) {
+        for (const auto &id : packed.ids) {
+            benchmark::DoNotOptimize(repo.packs().contains(id));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * packed.ids.size());
+}
+
+// Full reads, which add the inflate to each lookup.
+void BM_PackRead(benchmark::State &state) {
+    PackedStore &packed = store(state.range(0), state.range(1));
+    GitRepository repo(packed.repo.dir);
+    for (auto _ : state) {
+        for (const auto &id : packed.ids) {
+            benchmark::DoNotOptimize(repo.packs().read(repo, id));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * packed.ids.size());
+}
+
+}
+
+BENCHMARK(BM_PackLookup)->ArgNames({"packs", "midx"})->ArgsProduct({{1, 16, 128}, {0, 1}});
+BENCHMARK(BM_PackRead)->ArgNames({"packs", "midx"})->ArgsProduct({{1, 16, 128}, {0, 1}});
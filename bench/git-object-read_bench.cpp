@@ -0,0 +1,94 @@
+#include <benchmark/benchmark.h>
+#include <fstream>
+#include <map>
+#include <zlib.h>
+
+#include "benchRepo.h"
+#include "gitBlob.h"
+
+namespace {
+
+// One blob per benchmarked size, half random and half repeated text so it
+// compresses roughly like source code.
+const std::string &blob_of_size(size_t size) {
+    static BenchRepo repo("git_cli_bench_object_read", 0, 0);
+    static std::map<size_t, std::string> blobs;
+    auto it = blobs.find(size);
+    if (it == blobs.end()) {
+        std::mt19937 rng(size);
+        std::string content;
+        while (content.size() < size) {
+            content += (rng() % 2) ? "static const int value = 42;\n" : std::to_string(rng()) + "\n";
+        }
+        content.resize(size);
+        it = blobs.emplace(size, write_raw_object(GitRepository(repo.dir), "blob", content)).first;
+    }
+    return it->second;
+}
+
+const fs::path &bench_dir() {
+    static const fs::path dir = fs::temp_directory_path() / "git_cli_bench_object_read";
+    return dir;
+}
+
+// The read path before loose objects were mapped: an ifstream read one
+// byte at a time, a growing inflate buffer, then copies into a payload
+// vector, a string and the object.
+std::shared_ptr<GitObject> legacy_read(const GitRepository &repo, const std::string &sha) {
+    fs::path path = GitRepository::repo_file(repo, "objects/" + sha.substr(0, 2) + "/" + sha.substr(2));
+    std::ifstream file(path, std::ios::binary);
+    std::vector<unsigned char> compressed;
+    char byte;
+    while (file.get(byte)) {
+        compressed.push_back(static_cast<unsigned char>(byte));
+    }
+    z_stream stream{};
+    inflateInit(&stream);
+    std::vector<unsigned char> raw(std::max<size_t>(compressed.size() * 4, 256));
+    stream.next_in = compressed.data();
+    stream.avail_in = compressed.size();
+    int status = Z_OK;
+    while (status != Z_STREAM_END) {
+        if (stream.total_out == raw.size()) {
+            raw.resize(raw.size() * 2);
+        }
+        stream.next_out = raw.data() + stream.total_out;
+        stream.avail_out = raw.size() - stream.total_out;
+        status = inflate(&stream, Z_NO_FLUSH);
+        if (status != Z_OK && status != Z_STREAM_END) {
+            break;
+        }
+    }
+    raw.resize(stream.total_out);
+    inflateEnd(&stream);
+    auto nul = std::find(raw.begin(), raw.end(), '\0');
+    std::vector<unsigned char> content(nul + 1, raw.end());
+    auto obj = std::make_shared<GitBlob>(repo);
+    const std::string payload(content.begin(), content.end());
+    obj->deserialize(payload);
+    return obj;
+}
+
+void BM_ReadObject(benchmark::State &state) {
+    const std::string &sha = blob_of_size(state.range(0));
+    GitRepository repo(bench_dir());
+    for (auto _ : state) {
+        repo.object_cache().clear();
+        benchmark::DoNotOptimize(read_object(repo, sha));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+void BM_ReadObjectLegacy(benchmark::State &state) {
+    const std::string &sha = blob_of_size(state.range(0));
+    GitRepository repo(bench_dir());
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(legacy_read(repo, sha));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+}
+
+BENCHMARK(BM_ReadObject)->Arg(200)->Arg(4 << 10)->Arg(1 << 20)->Arg(16 << 20);
+BENCHMARK(BM_ReadObjectLegacy)->Arg(200)->Arg(4 << 10)->Arg(1 << 20)->Arg(16 << 20);
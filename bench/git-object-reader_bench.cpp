@@ -0,0 +1,81 @@
+#include <benchmark/benchmark.h>
+#include <fstream>
+
+#include "benchRepo.h"
+#include "objectReader.h"
+#include "reachability.h"
+
+namespace {
+
+// 300 commits over 3000 files, all loose: roughly 10k objects.
+BenchRepo &store() {
+    static BenchRepo repo("git_cli_bench_object_reader", 300, 3000);
+    return repo;
+}
+
+const std::vector<std::string> &all_ids() {
+    static const std::vector<std::string> ids = []() {
+        std::vector<std::string> out;
+        for (const auto &fanout : fs::directory_iterator(store().dir / ".git" / "objects")) {
+            std::string prefix = fanout.path().filename().string();
+            if (prefix.size() != 2) {
+                continue;
+            }
+            for (const auto &file : fs::directory_iterator(fanout.path())) {
+                out.push_back(prefix + file.path().filename().string());
+            }
+        }
+        return out;
+    }();
+    return ids;
+}
+
+ObjectReadBackend backend_arg(const benchmark::State &state) {
+    return static_cast<ObjectReadBackend>(state.range(0));
+}
+
+// Reopens the store with core.objectreader set, as a user would select it.
+GitRepository open_with(ObjectReadBackend backend) {
+    fs::path dir = store().dir;
+    std::ofstream(dir / ".git" / "config") << "[core]\nrepositoryformatversion=0\nfilemode=false\nbare=false\n"
+                                           << "objectreader=" << read_backend_name(backend) << "\n";
+    return GitRepository(dir);
+}
+
+// Every object in the store, read in batches and inflated as each arrives.
+void BM_BatchRead(benchmark::State &state) {
+    const auto &ids = all_ids();
+    GitRepository repo(store().dir);
+    BatchObjectReader reader(repo, backend_arg(state));
+    size_t bytes = 0;
+    for (auto _ : state) {
+        bytes = 0;
+        reader.read(ids, [&](size_t index, std::string &&compressed, std::exception_ptr error) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            bytes += inflate_loose_object(ids[index], compressed).size();
+        });
+    }
+    state.SetLabel(read_backend_name(reader.backend()));
+    state.counters["objects"] = ids.size();
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+
+// A cold-cache object walk, where the prefetcher's workers use the backend.
+void BM_RevListObjects(benchmark::State &state) {
+    GitRepository repo = open_with(backend_arg(state));
+    RevListOptions options;
+    options.objects = true;
+    size_t count = 0;
+    for (auto _ : state) {
+        repo.object_cache().clear();
+        count = rev_list(repo, {store().tip}, {}, options, [](const std::string &, const std::string &) {});
+    }
+    state.counters["objects"] = count;
+}
+
+}
+
+BENCHMARK(BM_BatchRead)->DenseRange(0, 2)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_RevListObjects)->DenseRange(0, 2)->Unit(benchmark::kMillisecond);
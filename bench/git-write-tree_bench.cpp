@@ -0,0 +1,82 @@
+#include <benchmark/benchmark.h>
+#include <fstream>
+#include <memory>
+
+#include "benchRepo.h"
+#include "dirSnapshot.h"
+
+namespace {
+
+constexpr size_t file_count = 20000;
+
+// A build-output-like directory: file_count files of 1-8 KiB spread over
+// 100 directories, two levels deep.
+struct OutputDir {
+    fs::path dir = fs::temp_directory_path() / "git_cli_bench_write_tree_src";
+
+    OutputDir() {
+        fs::remove_all(dir);
+        std::mt19937 rng(11);
+        for (size_t i = 0; i < file_count; ++i) {
+            fs::path path = dir / ("d" + std::to_string(i % 10)) / ("d" + std::to_string(i / 10 % 10)) /
+                            ("f" + std::to_string(i) + ".o");
+            if (i < 100) {
+                fs::create_directories(path.parent_path());
+            }
+            std::string content(1024 + rng() % 7168, '\0');
+            for (auto &c : content) {
+                c = static_cast<char>(rng() % 64);
+            }
+            std::ofstream(path, std::ios::binary) << content;
+        }
+    }
+    ~OutputDir() {
+        fs::remove_all(dir);
+    }
+};
+
+OutputDir &output_dir() {
+    static OutputDir dir;
+    return dir;
+}
+
+// Every iteration snapshots into a fresh repository, so all objects are
+// hashed, compressed and written.
+void BM_WriteTreeFromDir(benchmark::State &state) {
+    OutputDir &src = output_dir();
+    SnapshotOptions options;
+    options.threads = state.range(0);
+    SnapshotStats stats;
+    std::unique_ptr<BenchRepo> repo;
+    for (auto _ : state) {
+        state.PauseTiming();
+        repo.reset();
+        repo = std::make_unique<BenchRepo>("git_cli_bench_write_tree", 0, 0);
+        state.ResumeTiming();
+        stats = write_tree_from_dir(GitRepository(repo->dir), src.dir, options);
+    }
+    state.SetItemsProcessed(state.iterations() * stats.files);
+    state.SetBytesProcessed(state.iterations() * stats.bytes);
+}
+
+// A second snapshot of an unchanged directory only hashes.
+void BM_WriteTreeFromDirUnchanged(benchmark::State &state) {
+    OutputDir &src = output_dir();
+    BenchRepo repo("git_cli_bench_write_tree_unchanged", 0, 0);
+    GitRepository git(repo.dir);
+    SnapshotOptions options;
+    options.threads = state.range(0);
+    SnapshotStats stats = write_tree_from_dir(git, src.dir, options);
+    for (auto _ : state) {
+        stats = write_tree_from_dir(git, src.dir, options);
+    }
+    state.SetItemsProcessed(state.iterations() * stats.files);
+    state.SetBytesProcessed(state.iterations() * stats.bytes);
+}
+
+}
+
+BENCHMARK(BM_WriteTreeFromDir)->ArgName("threads")->RangeMultiplier(2)->Range(1, 8)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_WriteTreeFromDirUnchanged)->ArgName("threads")->RangeMultiplier(2)->Range(1, 8)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
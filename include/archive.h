@@ -0,0 +1,33 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "repository.h"
+#include "pathspec.h"
+
+enum class ArchiveFormat {
+    Tar,
+    TarGz
+};
+
+struct ArchiveOptions {
+    ArchiveFormat format = ArchiveFormat::Tar;
+    Pathspec pathspec;
+    // Modification time stamped on every entry (seconds since the epoch).
+    int64_t mtime = 0;
+    size_t threads = 0;
+};
+
+// Parses "tar" or "tar.gz"/"tgz"; throws on anything else.
+ArchiveFormat parse_archive_format(const std::string &name);
+
+// Streams tree_sha as a POSIX ustar archive to out, straight from the object
+// store. Blobs are inflated on a thread pool a bounded window ahead of the
+// writer, so entries still come out in tree order; blobs too large for the
+// window are streamed through in chunks when their turn comes.
+void write_archive(const GitRepository &repo, const std::string &tree_sha, const ArchiveOptions &options, std::ostream &out);
+
+#endif // ARCHIVE_H
@@ -0,0 +1,36 @@
+#ifndef BINARY_IO_H
+#define BINARY_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace fs = std::filesystem;
+
+// Helpers for the on-disk index formats (pack indexes, the multi-pack
+// index, reachability bitmaps, changed-path filters): big-endian integers,
+// raw object ids and read-only mapped files.
+
+uint64_t read_be(const unsigned char *p, int bytes);
+void put_be(std::string &out, uint64_t value, int bytes);
+
+// Lowercase hex of n raw bytes.
+std::string to_hex(const unsigned char *p, size_t n);
+// Raw bytes of a hex string such as an object id.
+std::string hex_to_bytes(const std::string &hex);
+
+// The whole file mapped read-only; throws if it cannot be opened or is
+// shorter than min_size. what names the file in error messages.
+class MappedFile {
+public:
+    MappedFile(const fs::path &path, size_t min_size, const std::string &what);
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+};
+
+#endif // BINARY_IO_H
@@ -0,0 +1,80 @@
+#ifndef BLAME_H
+#define BLAME_H
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "repository.h"
+
+// A run of count lines that are identical in two versions of a file.
+struct LineMatch {
+    size_t old_start;
+    size_t new_start;
+    size_t count;
+};
+
+// Myers' diff in linear space: the longest runs of unchanged lines from
+// old to new, in order.
+std::vector<LineMatch> diff_lines(const std::vector<std::string_view> &old_lines,
+                                  const std::vector<std::string_view> &new_lines);
+
+// LRU of line diffs keyed by (old blob, new blob). Blob ids name their
+// content, so an entry never goes stale; repeated blames of a hot file
+// skip both the blob reads and the diff.
+class BlameDiffCache {
+public:
+    using Matches = std::vector<LineMatch>;
+
+    explicit BlameDiffCache(size_t capacity = default_capacity);
+    std::shared_ptr<const Matches> get(const std::string &old_blob, const std::string &new_blob);
+    void put(const std::string &old_blob, const std::string &new_blob, std::shared_ptr<const Matches> matches);
+    void clear();
+    size_t size();
+
+    // Shared by every blame in the process, e.g. across serve requests.
+    static BlameDiffCache &shared();
+    static constexpr size_t default_capacity = 4096;
+private:
+    size_t capacity;
+    std::mutex mutex;
+    std::list<std::pair<std::string, std::shared_ptr<const Matches>>> lru;
+    std::unordered_map<std::string, decltype(lru)::iterator> index;
+};
+
+// Lines [final_start, final_start + count) of the blamed file were added by
+// commit, where they were lines [orig_start, orig_start + count). Line
+// numbers are 0-based. boundary marks a root commit.
+struct BlameEntry {
+    std::string commit;
+    size_t final_start;
+    size_t orig_start;
+    size_t count;
+    bool boundary = false;
+};
+
+struct BlameStats {
+    size_t commits = 0;
+    size_t diffs = 0;
+    size_t cached_diffs = 0;
+};
+
+struct BlameResult {
+    std::vector<BlameEntry> entries;   // sorted by final_start, covering every line
+    std::vector<std::string> lines;    // the file at commit, without newlines
+    BlameStats stats;
+};
+
+// Attributes each line of path at commit to the commit that introduced it.
+// Starting from commit, unattributed line ranges are handed to each parent
+// whose copy of the file still has them; a commit whose blob matches a
+// parent's passes everything on without diffing. Lines no parent has are
+// blamed on the commit, and the walk ends once every line is attributed.
+BlameResult blame_file(const GitRepository &repo, const std::string &commit, const std::string &path,
+                       BlameDiffCache &cache = BlameDiffCache::shared());
+
+#endif // BLAME_H
@@ -0,0 +1,93 @@
+#ifndef CHANGED_PATHS_H
+#define CHANGED_PATHS_H
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "repository.h"
+
+namespace fs = std::filesystem;
+
+class MappedFile;
+
+// Bloom filter over the paths a commit changed relative to its first
+// parent, built like git's changed-path filters: every changed path and
+// each of its leading directories is a key, 10 bits per key, 7 probes from
+// two murmur3 hashes. A commit that changed more than 512 paths gets a
+// filter with every bit set.
+class ChangedPathFilter {
+public:
+    static constexpr size_t bits_per_entry = 10;
+    static constexpr size_t num_hashes = 7;
+    static constexpr size_t max_changes = 512;
+
+    static std::string build(const std::vector<std::string> &paths);
+    // The keys to probe for path: the path and each leading directory.
+    static std::vector<std::string> keys(const std::string &path);
+    // False only if none of the changed paths can be path.
+    static bool maybe_contains(const unsigned char *filter, size_t len, const std::vector<std::string> &keys);
+};
+
+// objects/info/changed-paths.bloom, mapped read-only.
+class ChangedPathIndex {
+public:
+    // Null if the repository has no filter file.
+    static std::unique_ptr<ChangedPathIndex> open(const GitRepository &repo);
+    ~ChangedPathIndex();
+    ChangedPathIndex(const ChangedPathIndex &) = delete;
+    ChangedPathIndex &operator=(const ChangedPathIndex &) = delete;
+
+    enum class Answer { No, Maybe, Unknown };
+    // Unknown for commits written after the file was.
+    Answer query(const std::string &commit, const std::vector<std::string> &keys) const;
+    size_t size() const {
+        return commits;
+    }
+private:
+    ChangedPathIndex() = default;
+
+    std::unique_ptr<MappedFile> file;
+    size_t commits = 0;
+};
+
+fs::path changed_path_index_path(const GitRepository &repo);
+
+// Paths whose entries differ between two trees, each with its leading
+// directories. Either tree may be empty for "no tree".
+std::vector<std::string> changed_paths(const GitRepository &repo, const std::string &old_tree,
+                                       const std::string &new_tree);
+
+struct ChangedPathWriteStats {
+    size_t commits = 0;
+    size_t too_large = 0;
+    size_t bytes = 0;
+};
+
+// Diffs every commit reachable from tips against its first parent and
+// writes the filters.
+ChangedPathWriteStats write_changed_path_index(const GitRepository &repo, const std::vector<std::string> &tips);
+
+struct PathLogOptions {
+    bool use_filters = true;
+};
+
+struct PathLogStats {
+    size_t commits = 0;
+    size_t filtered = 0;
+    size_t compared = 0;
+    size_t shown = 0;
+};
+
+// Walks history from tip newest first (by committer date) and visits each
+// commit whose entry at path differs from any parent's, or that adds path
+// as a root commit, like `git log --full-history`. A non-merge commit whose
+// filter rules the path out is skipped without reading any trees.
+PathLogStats log_path(const GitRepository &repo, const std::string &tip, const std::string &path,
+                      const PathLogOptions &options,
+                      const std::function<void(const std::string &sha, const std::string &message)> &visit);
+
+#endif // CHANGED_PATHS_H
@@ -9,6 +9,7 @@ class ConfigParser
 public:
     void load(const std::filesystem::path &configFile);
     std::string get(const std::string &section, const std::string &key) const;
+    std::string get(const std::string &section, const std::string &key, const std::string &fallback) const;
     std::string repo_default_config();
     std::string get_configData() const;
 
@@ -0,0 +1,33 @@
+#ifndef DIR_SNAPSHOT_H
+#define DIR_SNAPSHOT_H
+
+#include <filesystem>
+#include <string>
+
+#include "repository.h"
+
+namespace fs = std::filesystem;
+
+struct SnapshotOptions {
+    size_t threads = 0;
+};
+
+struct SnapshotStats {
+    std::string tree;
+    size_t files = 0;
+    size_t trees = 0;
+    size_t written = 0;     // objects not yet in the store when they were hashed
+    size_t bytes = 0;       // file content hashed
+    double seconds = 0;
+};
+
+// Stores dir as blob and tree objects, as `git add -A && git write-tree`
+// would from an empty index, and returns the root tree id. Files are
+// hashed and compressed on a work-stealing pool; each directory's tree is
+// written by whichever thread finishes its last child. Executable files
+// get mode 100755 and symlinks are stored, not followed. Empty directories
+// and .git are left out, as are sockets and other special files.
+SnapshotStats write_tree_from_dir(const GitRepository &repo, const fs::path &dir,
+                                  const SnapshotOptions &options = SnapshotOptions());
+
+#endif // DIR_SNAPSHOT_H
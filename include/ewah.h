@@ -0,0 +1,38 @@
+#ifndef EWAH_H
+#define EWAH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// EWAH-compressed bitmap in git's on-disk layout: a stream of 64-bit words
+// where each marker word encodes a run of all-0 or all-1 words (bit 0 is the
+// run's value, bits 1-32 its length) followed by bits 33-63 literal words.
+// Serialized as big-endian: bit count, word count, words, last marker index.
+class EwahBitmap {
+public:
+    EwahBitmap() = default;
+    // Compresses an uncompressed bitset of bit_size bits.
+    static EwahBitmap compress(const std::vector<uint64_t> &plain, size_t bit_size);
+    // Parses a serialized bitmap at data; used is set to the bytes consumed.
+    static EwahBitmap deserialize(const unsigned char *data, size_t len, size_t &used);
+
+    void serialize(std::string &out) const;
+    // ORs the bitmap into an uncompressed bitset. Words past the end of
+    // plain are dropped; bits past bit_size() in the last word are not
+    // guaranteed to be clear.
+    void or_into(std::vector<uint64_t> &plain) const;
+    size_t bit_size() const {
+        return bits;
+    }
+    size_t word_count() const {
+        return words.size();
+    }
+private:
+    std::vector<uint64_t> words;
+    size_t bits = 0;
+    uint32_t last_marker = 0;
+};
+
+#endif // EWAH_H
@@ -0,0 +1,30 @@
+#ifndef FSCK_H
+#define FSCK_H
+
+#include <ostream>
+#include <string>
+
+#include "repository.h"
+
+struct FsckOptions {
+    size_t threads = 0;
+    bool progress = false;
+};
+
+struct FsckReport {
+    size_t objects = 0;
+    size_t corrupt = 0;
+    size_t missing = 0;
+    size_t dangling = 0;
+    double seconds = 0;
+};
+
+// Re-hashes and parses every object in the store, loose and packed, on a
+// thread pool, then reports objects that are referenced but absent, refs
+// whose target is absent, and objects nothing (neither another object nor a
+// ref) points to. Findings go to out, one per line, in git fsck's
+// "<kind> <type> <sha>" form; a missing ref target is
+// "missing object <sha> from <ref>".
+FsckReport fsck_objects(const GitRepository &repo, const FsckOptions &options, std::ostream &out, std::ostream &err);
+
+#endif // FSCK_H
@@ -7,9 +7,10 @@
 
 class GitBlob : public GitObject {
 public:
+    static constexpr ObjectType static_type = ObjectType::Blob;
     GitBlob(const GitRepository& repo, const std::string& data = "");
     virtual std::string serialize() const override;
-    virtual void deserialize(const std::string& data) override;
+    virtual void deserialize(std::string data) override;
 };
 
 #endif // GIT_BLOB_H
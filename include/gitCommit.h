@@ -2,6 +2,7 @@
 #define GIT_COMMIT_H
 
 #include <algorithm>
+#include <cstdint>
 #include <string>
 #include <filesystem>
 
@@ -17,11 +18,13 @@ struct KVLMEntry {
     
 class GitCommit : public GitObject {
 public:
+    static constexpr ObjectType static_type = ObjectType::Commit;
     GitCommit(const GitRepository& repo, const std::string& data = "") : GitObject(repo, data) {
         this->fmt = "commit";
+        this->type = ObjectType::Commit;
     }
     virtual std::string serialize() const override;
-    virtual void deserialize(const std::string& data) override;
+    virtual void deserialize(std::string data) override;
     std::vector<std::string> get_value(const std::string& key) const;
     std::string get_message() const;
 protected:
@@ -32,4 +35,10 @@ private:
     std::string serialize_kvlm(const std::vector<KVLMEntry>& kvlm) const;
 };
 
+// The commit's tree id; throws if it has none.
+std::string commit_tree(const GitCommit& commit);
+// Seconds since the epoch from the committer line, or 0 if it is missing or
+// malformed.
+int64_t committer_time(const GitCommit& commit);
+
 #endif // GIT_COMMIT_H
\ No newline at end of file
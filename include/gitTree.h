@@ -2,12 +2,14 @@
 #define GIT_TREE_H
 
 #include <string>
+#include <string_view>
 #include <algorithm>
 #include <sstream>
 #include <vector>   
 #include <array>
 
 #include "object.h"
+#include "pathspec.h"
 
 struct GitTreeEntry {
     std::string mode;
@@ -17,23 +19,49 @@ struct GitTreeEntry {
 
 class GitTree : public GitObject {
 public:
+    static constexpr ObjectType static_type = ObjectType::Tree;
     GitTree(const GitRepository& repo, const std::string& data = "") : GitObject(repo, data) {
         this->fmt = "tree";
+        this->type = ObjectType::Tree;
     }
     virtual std::string serialize() const override;
-    virtual void deserialize(const std::string& data) override;
-    std::vector<GitTreeEntry> parse_tree(const std::vector<unsigned char>& data);
-    void recursive_ls_tree(const GitRepository& repo, const std::string& tree_sha, const std::string& prefix="");
-    std::vector<GitTreeEntry> get_entries() const;
+    virtual void deserialize(std::string data) override;
+    std::vector<GitTreeEntry> parse_tree(std::string_view data);
+    void recursive_ls_tree(const GitRepository& repo, const std::string& tree_sha, const std::string& prefix="", std::ostream& out=std::cout,
+                           const Pathspec& pathspec=Pathspec());
+    const std::vector<GitTreeEntry>& get_entries() const;
 protected:
     std::vector<GitTreeEntry> entries;
 private:
-    std::pair<size_t, GitTreeEntry> parse_single_tree(const std::vector<unsigned char>& data, size_t pos);
+    std::pair<size_t, GitTreeEntry> parse_single_tree(std::string_view data, size_t pos);
     std::vector<GitTreeEntry> sort_tree_leaf(const std::vector<GitTreeEntry>& entries) const;
     std::string serialize_tree(const std::vector<GitTreeEntry>& entries) const;
 };
 
+// git's tree order: names compare bytewise, a subtree's name as if it
+// ended in '/'. Symlinks and submodules sort as plain names.
+bool tree_entry_less(const GitTreeEntry& a, const GitTreeEntry& b);
+// The object type an entry's mode implies: a tree, a submodule commit or a
+// blob, without reading the object.
+const char* tree_entry_type(const GitTreeEntry& entry);
+// The names along a slash-separated path, ignoring empty components;
+// throws if there are none.
+std::vector<std::string> split_tree_path(const std::string& path);
+
 std::string branch_sha(const GitRepository &repo, const std::string &branch);
-void tree_checkout(const GitRepository &repo, const std::string &tree_sha, const fs::path &target_path);
+std::vector<GitTreeEntry> select_entries(const std::vector<GitTreeEntry>& entries, const std::string& dir, const Pathspec& pathspec);
+struct CheckoutStats {
+    size_t written = 0;
+    size_t deleted = 0;
+    size_t chmodded = 0;
+};
+
+void tree_checkout(const GitRepository &repo, const std::string &tree_sha, const fs::path &target_path, const Pathspec &pathspec = Pathspec());
+// Moves a checkout of old_tree in target_path to new_tree, writing, deleting
+// or chmodding only the paths that differ. With check_local, every path it
+// would touch must still hold old_tree's content (or be absent); otherwise
+// nothing is changed and the conflicting paths are reported.
+CheckoutStats tree_checkout_update(const GitRepository &repo, const std::string &old_tree, const std::string &new_tree,
+                                   const fs::path &target_path, bool check_local, const Pathspec &pathspec = Pathspec());
 
 #endif // GIT_TREE_H
@@ -0,0 +1,59 @@
+#ifndef GREP_H
+#define GREP_H
+
+#include <memory>
+#include <ostream>
+#include <regex>
+#include <string>
+#include <string_view>
+
+#include "repository.h"
+#include "pathspec.h"
+
+enum class GrepSyntax {
+    Basic,
+    Extended,
+    Fixed
+};
+
+struct GrepOptions {
+    GrepSyntax syntax = GrepSyntax::Basic;
+    bool ignore_case = false;
+    bool files_only = false;
+    bool line_numbers = false;
+    Pathspec pathspec;
+    size_t threads = 0;
+    // Printed before every path, e.g. "main:".
+    std::string label;
+};
+
+// Finds the lines of a buffer that match a pattern. Patterns without regex
+// metacharacters (and all -F patterns) are searched as literals with
+// memchr/memmem, which scan whole buffers at vector speed instead of
+// running the regex engine line by line.
+class GrepMatcher {
+public:
+    GrepMatcher(const std::string &pattern, GrepSyntax syntax, bool ignore_case);
+    // Returns the line containing the first match at or after pos, or an
+    // empty view with data() == nullptr when there is none.
+    std::string_view next_line(std::string_view text, size_t pos) const;
+    bool is_literal() const {
+        return literal;
+    }
+private:
+    const char *find_literal(const char *begin, const char *end) const;
+
+    std::string pattern;
+    bool ignore_case;
+    bool literal;
+    std::unique_ptr<std::regex> regex;
+};
+
+// Searches every regular file under tree_sha. Blobs are inflated and
+// scanned on a thread pool; binary blobs (a NUL in the first 8000 bytes)
+// are skipped. Output is "<label><path>:<line>" (or just the path with
+// files_only), in tree order. Returns the number of files that matched.
+size_t grep_tree(const GitRepository &repo, const std::string &tree_sha, const std::string &pattern,
+                 const GrepOptions &options, std::ostream &out);
+
+#endif // GREP_H
@@ -5,6 +5,9 @@
 #include <filesystem>
 #include <stdexcept>
 #include <iomanip>
+#include <functional>
+#include <memory>
+#include <vector>
 #include <zlib.h>
 
 #include "repository.h"
@@ -12,24 +15,83 @@
 
 namespace fs = std::filesystem;
 
+enum class ObjectType { Blob, Tree, Commit, Tag };
+
+// Throws on anything but "blob", "tree", "commit" or "tag".
+ObjectType parse_object_type(const std::string& name);
+const char* object_type_name(ObjectType type);
+
 class GitObject{
 public:
     GitObject(const GitRepository& repo, const std::string& data = "");
     virtual std::string serialize() const = 0;
-    virtual void deserialize(const std::string& data) = 0;
+    // Takes the payload by value so readers can move their buffer in.
+    virtual void deserialize(std::string data) = 0;
     std::string get_type() const;
+    ObjectType get_object_type() const {
+        return type;
+    }
     size_t get_size() const;
-    std::string get_content() const;
+    const std::string& get_content() const;
 protected:
     const GitRepository* repo;
     std::string fmt;
+    ObjectType type = ObjectType::Blob;
     size_t size;
     std::string content;
 };
 
+// Narrows an object to GitBlob, GitTree or GitCommit by its type tag rather
+// than RTTI; throws naming sha on a mismatch.
+template <typename T>
+std::shared_ptr<T> object_as(std::shared_ptr<GitObject> obj, const std::string& sha) {
+    if (!obj || obj->get_object_type() != T::static_type) {
+        throw std::runtime_error("Object " + sha + " is " + (obj ? obj->get_type() : std::string("missing")) +
+                                 ", not a " + object_type_name(T::static_type));
+    }
+    return std::static_pointer_cast<T>(std::move(obj));
+}
+
+class GitBlob;
+class GitTree;
+class GitCommit;
+
+struct ObjectHeader {
+    std::string type;
+    size_t size = 0;
+};
+
 std::string find_object(const GitRepository& repo, const std::string& sha);
+// Inflates an object through a fixed-size per-thread buffer: on_header sees
+// the parsed header first, then sink receives the payload in chunks. Memory
+// use does not depend on the object's size, except for packed deltas, which
+// are resolved whole and reach sink as one chunk.
+ObjectHeader stream_object(const GitRepository& repo, const std::string& sha,
+                           const std::function<void(const ObjectHeader&)>& on_header,
+                           const std::function<void(const unsigned char*, size_t)>& sink);
+// Inflates only as far as the header; for packed objects nothing past the
+// entry headers and a delta's size fields.
+ObjectHeader read_object_header(const GitRepository& repo, const std::string& sha);
+std::vector<std::string> list_objects(const GitRepository& repo);
+std::vector<unsigned char> read_raw_object(const GitRepository& repo, const std::string& sha);
+// The same two steps for a loose object file whose compressed bytes were
+// already read, e.g. by a BatchObjectReader. parse_loose_object caches the
+// result like read_object does.
+std::vector<unsigned char> inflate_loose_object(const std::string& sha, const std::string& compressed);
+std::shared_ptr<GitObject> parse_loose_object(const GitRepository& repo, const std::string& sha,
+                                              const std::string& compressed);
 std::shared_ptr<GitObject> read_object(const GitRepository& repo, const std::string& sha);
-std::string write_object(const GitRepository& repo, const std::string& data);
+// Typed reads. The header's type is checked before the payload is parsed,
+// so a mismatch fails without building the wrong object.
+std::shared_ptr<GitBlob> read_blob(const GitRepository& repo, const std::string& sha);
+std::shared_ptr<GitTree> read_tree(const GitRepository& repo, const std::string& sha);
+std::shared_ptr<GitCommit> read_commit(const GitRepository& repo, const std::string& sha);
+std::string write_object(const GitRepository& repo, const GitObject& obj);
+// Writes an already-serialized payload of any type, e.g. objects unpacked
+// from a packfile; returns its id. An object already stored, loose or
+// packed, is left alone; created reports whether a file was written.
+std::string write_raw_object(const GitRepository& repo, const std::string& type, const std::string& data,
+                             bool* created = nullptr);
 std::string hash_object(const GitRepository& repo, const std::string& data, const std::string& fmt, bool write);
 
 #endif // OBJECT_H
\ No newline at end of file
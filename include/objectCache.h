@@ -0,0 +1,39 @@
+#ifndef OBJECT_CACHE_H
+#define OBJECT_CACHE_H
+
+#include <array>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class GitObject;
+
+// Byte-bounded LRU of parsed objects, sharded by object id so concurrent
+// readers on one repository handle rarely contend on the same lock.
+class ObjectCache {
+public:
+    explicit ObjectCache(size_t capacity_bytes = default_capacity);
+    std::shared_ptr<GitObject> get(const std::string &sha);
+    void put(const std::string &sha, const std::shared_ptr<GitObject> &obj);
+    void clear();
+    size_t capacity() const {
+        return capacity_bytes;
+    }
+
+    static constexpr size_t default_capacity = 64 << 20;
+private:
+    static constexpr size_t shard_count = 16;
+    struct Shard {
+        std::mutex mutex;
+        std::list<std::pair<std::string, std::shared_ptr<GitObject>>> lru;
+        std::unordered_map<std::string, decltype(lru)::iterator> index;
+        size_t bytes = 0;
+    };
+    Shard &shard_for(const std::string &sha);
+    size_t capacity_bytes;
+    std::array<Shard, shard_count> shards;
+};
+
+#endif // OBJECT_CACHE_H
@@ -0,0 +1,61 @@
+#ifndef OBJECT_READER_H
+#define OBJECT_READER_H
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "repository.h"
+
+// How BatchObjectReader fetches loose object files, set with
+// `objectreader = sync|threads|io_uring` under [core]:
+//   sync      one blocking open/pread per object on the calling thread
+//   threads   reads spread over a shared pool of I/O threads
+//   io_uring  one openat and one read submission per batch; only available
+//             when built with liburing, otherwise threads is used instead.
+//             Experimental: it compiles against liburing but has not been
+//             run under CI, so prefer threads for anything that matters.
+enum class ObjectReadBackend { Sync, Threads, IoUring };
+
+ObjectReadBackend parse_read_backend(const std::string &name);
+const char *read_backend_name(ObjectReadBackend backend);
+// core.objectreader, or Sync when unset.
+ObjectReadBackend configured_read_backend(const GitRepository &repo);
+bool io_uring_available();
+
+// Reads the compressed bytes of many loose objects at once, so the device
+// sees a deep queue instead of one request at a time. Completions are
+// handed to the caller's thread (in completion order) for inflating.
+class BatchObjectReader {
+public:
+    // Falls back to Threads when IoUring is asked for but unavailable.
+    BatchObjectReader(const GitRepository &repo, ObjectReadBackend backend, size_t depth = default_depth);
+    ~BatchObjectReader();
+    BatchObjectReader(const BatchObjectReader &) = delete;
+    BatchObjectReader &operator=(const BatchObjectReader &) = delete;
+
+    using Completion = std::function<void(size_t index, std::string &&compressed, std::exception_ptr error)>;
+    // Calls on_read once per id, with its index in ids and either the file's
+    // bytes or the error that prevented reading it.
+    void read(const std::vector<std::string> &ids, const Completion &on_read);
+    ObjectReadBackend backend() const {
+        return active;
+    }
+
+    static constexpr size_t default_depth = 64;
+private:
+    struct Ring;
+
+    void read_sync(const std::vector<std::string> &ids, const Completion &on_read);
+    void read_threads(const std::vector<std::string> &ids, const Completion &on_read);
+    void read_ring(const std::vector<std::string> &ids, const Completion &on_read);
+
+    const GitRepository &repo;
+    ObjectReadBackend active;
+    size_t depth;
+    std::unique_ptr<Ring> ring;
+};
+
+#endif // OBJECT_READER_H
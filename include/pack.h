@@ -0,0 +1,110 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "repository.h"
+#include "object.h"
+
+namespace fs = std::filesystem;
+
+struct IndexPackOptions {
+    size_t threads = 0;
+    // Write every object as a loose object instead of writing an index.
+    bool unpack = false;
+    // Where to write the .idx; defaults to the pack path with ".idx".
+    fs::path index_path;
+};
+
+struct PackThreadStats {
+    size_t objects = 0;
+    uint64_t bytes = 0;
+    double seconds = 0;
+};
+
+struct IndexPackResult {
+    std::string pack_checksum;
+    size_t objects = 0;
+    size_t deltas = 0;
+    double scan_seconds = 0;
+    double resolve_seconds = 0;
+    std::vector<PackThreadStats> threads;
+};
+
+// Ingests a version 2 or 3 packfile. One sequential pass finds every entry's
+// boundaries (and CRC) without keeping any object; the entries are then
+// resolved in parallel, each worker taking a whole base object and walking
+// its delta children depth first so a base is inflated once. Bases of
+// REF_DELTA entries that are not in the pack are read from the repository.
+// Writes a v2 .idx next to the pack, or loose objects with options.unpack.
+IndexPackResult index_pack(const GitRepository &repo, const fs::path &pack_path, const IndexPackOptions &options);
+
+struct PackedObject {
+    ObjectType type;
+    std::string data;
+};
+
+// The packfiles in objects/pack. Ids are looked up through the
+// multi-pack-index when one covers the packs, with one binary search over
+// a single table; packs it does not cover have their .idx probed in turn.
+// The directory is scanned on first use and again by refresh(), which
+// readers call after a miss, so packs added later are picked up.
+class PackStore {
+public:
+    explicit PackStore(const fs::path &pack_dir);
+    ~PackStore();
+    PackStore(const PackStore &) = delete;
+    PackStore &operator=(const PackStore &) = delete;
+
+    bool contains(const std::string &sha) const;
+    // Resolves delta chains; bases outside the pack are read through repo.
+    std::optional<PackedObject> read(const GitRepository &repo, const std::string &sha) const;
+    // Type and size from the entry headers alone: a delta's size is the
+    // result size at the start of its data, its type that of the end of its
+    // chain. Nothing else is inflated.
+    std::optional<ObjectHeader> read_header(const GitRepository &repo, const std::string &sha) const;
+    // Non-delta objects are inflated through a fixed-size buffer straight
+    // into sink. Deltas are still resolved in memory and handed over in one
+    // chunk, though on_header sees their header before that happens.
+    std::optional<ObjectHeader> stream(const GitRepository &repo, const std::string &sha,
+                                       const std::function<void(const ObjectHeader &)> &on_header,
+                                       const std::function<void(const unsigned char *, size_t)> &sink) const;
+    // Appends packed ids starting with the hex prefix, stopping after limit.
+    void find_prefix(const std::string &prefix, std::vector<std::string> &out, size_t limit) const;
+    // Every packed id, sorted, each once even if several packs hold it.
+    std::vector<std::string> list_ids() const;
+    // Rescans if the directory changed since the last scan.
+    bool refresh();
+    size_t pack_count() const;
+    bool uses_multi_pack_index() const;
+private:
+    struct Snapshot;
+    std::shared_ptr<const Snapshot> snapshot() const;
+
+    fs::path pack_dir;
+    mutable std::mutex mutex;
+    mutable std::shared_ptr<const Snapshot> current;
+};
+
+struct MultiPackIndexStats {
+    size_t packs = 0;
+    size_t objects = 0;
+    size_t duplicates = 0;
+    size_t bytes = 0;
+};
+
+fs::path multi_pack_index_path(const GitRepository &repo);
+
+// Writes objects/pack/multi-pack-index in git's format (version 1, SHA-1)
+// over every pack with an index. An id found in several packs is taken
+// from the most recently modified one.
+MultiPackIndexStats write_multi_pack_index(const GitRepository &repo);
+
+#endif // PACK_H
@@ -0,0 +1,39 @@
+#ifndef PATHSPEC_H
+#define PATHSPEC_H
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Patterns are tree-relative paths. A literal pattern selects that path and
+// everything beneath it; a pattern containing *, ? or [ is a glob whose
+// wildcards may cross '/', and it also selects everything beneath a
+// directory it matches. An empty Pathspec selects everything.
+class Pathspec {
+public:
+    Pathspec() = default;
+    explicit Pathspec(const std::vector<std::string> &patterns);
+    // One pattern per line; blank lines and lines starting with '#' are skipped.
+    static Pathspec from_file(const fs::path &file);
+
+    bool empty() const {
+        return patterns.empty();
+    }
+    // True if path (or one of its leading directories) is selected.
+    bool matches(const std::string &path) const;
+    // True if some path below directory dir could be selected; when false
+    // the whole subtree can be skipped without reading it.
+    bool may_match_under(const std::string &dir) const;
+private:
+    struct Pattern {
+        std::string text;
+        std::string literal_prefix;
+        bool glob;
+    };
+    bool matches_one(const Pattern &pattern, const std::string &path) const;
+    std::vector<Pattern> patterns;
+};
+
+#endif // PATHSPEC_H
@@ -0,0 +1,120 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "repository.h"
+#include "object.h"
+#include "objectReader.h"
+
+// Reads and inflates the objects a walk will need next on background threads.
+// Parsed objects wait in a queue bounded by max_bytes; once it is full the
+// workers stall until the walk consumes something. get() never blocks on the
+// budget: an object that has not been started yet is read inline.
+// Unless core.objectreader is sync, each worker claims up to read_batch
+// queued ids at a time and reads them through its own BatchObjectReader,
+// inflating each object as its read completes.
+class ObjectPrefetcher {
+public:
+    explicit ObjectPrefetcher(const GitRepository &repo, size_t threads = default_threads, size_t max_bytes = default_budget);
+    ~ObjectPrefetcher();
+    ObjectPrefetcher(const ObjectPrefetcher &) = delete;
+    ObjectPrefetcher &operator=(const ObjectPrefetcher &) = delete;
+
+    // Newer batches are served first, matching depth-first walks.
+    void prefetch(const std::vector<std::string> &ids);
+    std::shared_ptr<GitObject> get(const std::string &sha);
+    void cancel(const std::vector<std::string> &ids);
+    void cancel_all();
+    const GitRepository &repository() const {
+        return repo;
+    }
+
+    struct Stats {
+        size_t queued = 0;
+        size_t loading = 0;
+        size_t ready = 0;
+        size_t failed = 0;
+        size_t ready_bytes = 0;
+    };
+    // A consistent snapshot of the slots not yet handed out by get().
+    Stats stats() const;
+
+    static constexpr size_t default_threads = 4;
+    static constexpr size_t default_budget = 64 << 20;
+    static constexpr size_t read_batch = 32;
+private:
+    enum class State { Queued, Loading, Ready, Failed };
+    struct Slot {
+        State state = State::Queued;
+        std::shared_ptr<GitObject> obj;
+        std::exception_ptr error;
+        size_t bytes = 0;
+    };
+    void worker_loop();
+    void load_batch(BatchObjectReader &reader, std::vector<std::string> &batch);
+    void publish(const std::string &sha, Slot &&loaded);
+    void drop_locked(std::unordered_map<std::string, Slot>::iterator it);
+
+    const GitRepository &repo;
+    ObjectReadBackend backend;
+    size_t max_bytes;
+    size_t ready_bytes = 0;
+    bool stopping = false;
+    std::deque<std::string> queue;
+    std::unordered_map<std::string, Slot> slots;
+    mutable std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable slot_done;
+    std::vector<std::thread> workers;
+};
+
+// Idle prefetchers kept with their worker threads for the next walk through
+// the same repository handle, so a long-lived handle (as in `serve`) does not
+// start threads for every request. Each walk still gets a prefetcher of its
+// own; the pool only grows to the number of walks running at once.
+class PrefetcherPool {
+public:
+    explicit PrefetcherPool(const GitRepository &repo) : repo(repo) {}
+    PrefetcherPool(const PrefetcherPool &) = delete;
+    PrefetcherPool &operator=(const PrefetcherPool &) = delete;
+
+    // Returns the prefetcher to the pool, emptied, when it goes out of scope.
+    class Lease {
+    public:
+        Lease(Lease &&other) noexcept = default;
+        Lease &operator=(Lease &&) = delete;
+        ~Lease();
+        ObjectPrefetcher &operator*() const {
+            return *prefetcher;
+        }
+        ObjectPrefetcher *operator->() const {
+            return prefetcher.get();
+        }
+    private:
+        friend class PrefetcherPool;
+        Lease(PrefetcherPool &pool, std::unique_ptr<ObjectPrefetcher> prefetcher)
+            : pool(&pool), prefetcher(std::move(prefetcher)) {}
+        PrefetcherPool *pool;
+        std::unique_ptr<ObjectPrefetcher> prefetcher;
+    };
+
+    Lease acquire();
+    size_t idle() const;
+private:
+    void release(std::unique_ptr<ObjectPrefetcher> prefetcher);
+
+    const GitRepository &repo;
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<ObjectPrefetcher>> pooled;
+};
+
+#endif // PREFETCH_H
@@ -0,0 +1,43 @@
+#ifndef REACHABILITY_H
+#define REACHABILITY_H
+
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "repository.h"
+
+namespace fs = std::filesystem;
+
+struct RevListOptions {
+    // List trees and blobs too, not just commits.
+    bool objects = false;
+    // Use objects/info/reachability.bitmap when it exists.
+    bool use_bitmaps = true;
+};
+
+struct BitmapWriteStats {
+    size_t objects = 0;
+    size_t commits = 0;
+    size_t bytes = 0;
+};
+
+fs::path reachability_bitmap_path(const GitRepository &repo);
+
+// Visits every object reachable from include but not from exclude (commits
+// first, then trees and blobs with their paths when known) and returns how
+// many there were. visit may be empty when only the count is wanted.
+// Reaching a commit that has a stored bitmap ORs that bitmap in instead of
+// walking its history. Annotated tags among the tips are peeled.
+size_t rev_list(const GitRepository &repo, const std::vector<std::string> &include,
+                const std::vector<std::string> &exclude, const RevListOptions &options,
+                const std::function<void(const std::string &sha, const std::string &path)> &visit);
+
+// Writes reachability bitmaps for the given tips plus every `every`-th
+// commit of their history. Objects are numbered oldest commit first, so
+// each commit's closure is mostly one long run and compresses well.
+BitmapWriteStats write_reachability_bitmaps(const GitRepository &repo, const std::vector<std::string> &tips,
+                                            size_t every = 100);
+
+#endif // REACHABILITY_H
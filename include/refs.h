@@ -0,0 +1,58 @@
+#ifndef REFS_H
+#define REFS_H
+
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "repository.h"
+
+// Ref lookups over packed-refs plus loose refs. packed-refs is mapped
+// read-only and searched in place, so opening a store and resolving one
+// name costs O(log n) however many refs the repository carries; loose
+// refs under the git dir override packed entries of the same name.
+class RefStore {
+public:
+    explicit RefStore(const GitRepository &repo);
+    ~RefStore();
+    RefStore(const RefStore &) = delete;
+    RefStore &operator=(const RefStore &) = delete;
+
+    // Object id of a full ref name such as "HEAD" or "refs/tags/v1",
+    // following symbolic refs.
+    std::optional<std::string> read(const std::string &refname) const;
+    // Expands a short name the way git rev-parse does: <name>, refs/<name>,
+    // refs/tags/<name>, refs/heads/<name>, refs/remotes/<name> and
+    // refs/remotes/<name>/HEAD, first hit wins.
+    std::optional<std::string> resolve(const std::string &name) const;
+    // Visits every ref under refs/ whose name starts with prefix, in sorted
+    // order, without materializing the full list.
+    void for_each(const std::function<void(const std::string &name, const std::string &sha)> &visit,
+                  const std::string &prefix = "refs/") const;
+private:
+    struct PackedRecord {
+        std::string_view name;
+        std::string_view sha;
+        // Offset just past the record, including any peeled "^" line.
+        size_t next;
+    };
+    std::optional<std::string> read_loose(const std::string &refname, std::string &symref) const;
+    std::optional<std::string> read_packed(const std::string &refname) const;
+    PackedRecord packed_record(size_t pos) const;
+    // Calls visit on packed records in name order, starting at the first
+    // name not less than from, until visit returns false.
+    void scan_packed(std::string_view from, const std::function<bool(const PackedRecord &)> &visit) const;
+
+    const GitRepository &repo;
+    const char *packed = nullptr;
+    size_t packed_size = 0;
+    // First record after the "# pack-refs" header line.
+    size_t packed_begin = 0;
+    // Record offsets in name order, only built when the file lacks the
+    // "sorted" trait and cannot be binary-searched in place.
+    std::vector<size_t> packed_index;
+};
+
+#endif // REFS_H
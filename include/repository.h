@@ -3,26 +3,53 @@
 
 #include <string>
 #include <filesystem>
+#include <memory>
 
 #include "configParser.h"
+#include "objectCache.h"
 
 namespace fs = std::filesystem;
 
+class PackStore;
+class PrefetcherPool;
+
+// A repository handle owns its config, object cache and pack store. Copies
+// share the cache and packs, and object reads through one handle are safe
+// from many threads. Each handle has its own pool of idle prefetchers, since
+// they refer back to the handle that made them.
 class GitRepository
 {
 public:
     GitRepository(const fs::path &path, bool force = false);
-    static ConfigParser config;
+    GitRepository(const GitRepository &other);
+    GitRepository &operator=(const GitRepository &other);
+    ~GitRepository();
+    ConfigParser config;
     static GitRepository repo_create(const fs::path &path);
     static fs::path repo_file(const GitRepository &repo, const fs::path &file, bool mkdir = false);
     static GitRepository repo_find(const fs::path &path=".", bool required = true);
     fs::path get_gitdir() const {
         return gitdir;
     }
+    fs::path get_worktree() const {
+        return worktree;
+    }
+    ObjectCache &object_cache() const {
+        return *cache;
+    }
+    PackStore &packs() const {
+        return *pack_store;
+    }
+    PrefetcherPool &prefetchers() const {
+        return *prefetch_pool;
+    }
 protected:
     fs::path worktree;
     fs::path gitdir;
     fs::path configFile;
+    std::shared_ptr<ObjectCache> cache;
+    std::shared_ptr<PackStore> pack_store;
+    std::unique_ptr<PrefetcherPool> prefetch_pool;
     static fs::path repo_dir(const GitRepository &repo, const fs::path &dir, bool mkdir = false);
 };
 
@@ -0,0 +1,58 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Wire format: every message is a 4-byte big-endian length followed by that
+// many payload bytes. A request payload is the command's arguments joined by
+// NUL (e.g. "cat-file\0-p\0<sha>"). A response payload is one status byte,
+// a 4-byte big-endian stdout length, stdout, and then stderr. Frames are at
+// most 64 MiB; a reply that would not fit comes back as an error status.
+using RequestHandler = std::function<int(const std::vector<std::string> &args, std::ostream &out, std::ostream &err)>;
+
+struct ServerResponse {
+    int status = 0;
+    std::string out;
+    std::string err;
+};
+
+// Serves requests on a Unix socket from a single epoll loop; requests run on
+// a worker pool, one at a time per connection so responses keep their order.
+// A client that shuts down its write side still gets the replies it is owed.
+class ObjectServer {
+public:
+    ObjectServer(const fs::path &socket_path, RequestHandler handler, size_t workers = 0);
+    ~ObjectServer();
+    ObjectServer(const ObjectServer &) = delete;
+    ObjectServer &operator=(const ObjectServer &) = delete;
+
+    // Runs until SIGINT or SIGTERM.
+    void run();
+private:
+    struct Connection;
+    fs::path socket_path;
+    RequestHandler handler;
+    size_t workers;
+    int listen_fd = -1;
+};
+
+class ServerClient {
+public:
+    explicit ServerClient(const fs::path &socket_path);
+    ~ServerClient();
+    ServerClient(const ServerClient &) = delete;
+    ServerClient &operator=(const ServerClient &) = delete;
+
+    ServerResponse request(const std::vector<std::string> &args);
+private:
+    int fd = -1;
+};
+
+#endif // SERVER_H
@@ -0,0 +1,85 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size FIFO worker pool. Tasks must not throw; wrap work that can
+// fail and report errors through the task's own result.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(std::function<void()> task);
+    void wait_idle();
+    size_t size() const {
+        return workers.size();
+    }
+    static size_t default_threads();
+private:
+    void worker_loop();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable task_ready;
+    std::condition_variable idle;
+    size_t running = 0;
+    bool stopping = false;
+};
+
+// Fork-join pool for recursive work whose size is not known up front, such
+// as walking a directory tree. Each worker runs the newest task on its own
+// deque first and, once that is empty, steals the oldest task from another
+// worker, so big subtrees get split while finished work stays cache-warm.
+// Threads live only for the duration of run().
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(size_t threads = 0);
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    // Runs root and everything it spawns, transitively; returns when all
+    // of it has finished. After a task throws, queued tasks are dropped
+    // and the first exception is rethrown here.
+    void run(Task root);
+    // Called from inside a task: queues work on the calling worker.
+    void spawn(Task task);
+    size_t size() const {
+        return workers.size();
+    }
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    void work(size_t self);
+    bool next_task(size_t self, Task &task);
+    // Blocks until a task is queued (true) or every task has run (false).
+    bool wait_for_work();
+    void push(size_t worker, Task task);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> outstanding{0};
+    // Idle workers sleep here until a task is pushed or the run ends.
+    std::mutex idle_mutex;
+    std::condition_variable work_ready;
+    size_t queued = 0;
+    std::atomic<bool> failed{false};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,100 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Timed phases. Keep in sync with the names table in trace.cpp.
+enum class TraceTimer {
+    ReadObject,
+    WriteObject,
+    Inflate,
+    Deflate,
+    Sha1,
+    ParseTree,
+    ParseCommit,
+    CheckoutWrite,
+    Count
+};
+
+enum class TraceCounter {
+    ObjectsRead,
+    ObjectsWritten,
+    BytesRead,
+    BytesWritten,
+    BytesInflated,
+    BytesDeflated,
+    CacheHits,
+    CacheMisses,
+    Syscalls,
+    FilesCheckedOut,
+    PrefetchHits,
+    PrefetchCancelled,
+    ReadBatches,
+    PackIndexProbes,
+    Count
+};
+
+struct TraceTimerStats {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> total_ns{0};
+};
+
+// Process-wide performance tracing, enabled with GIT_CLI_TRACE=perf[:file].
+// With no file the summary goes to stderr; a file ending in ".json" receives
+// Chrome trace-event JSON instead of the text summary. When tracing is off
+// every hook is a single branch on a plain bool.
+class Trace {
+public:
+    static void init_from_env();
+    static bool enabled() {
+        return active;
+    }
+    static void count(TraceCounter counter, uint64_t n = 1) {
+        if (active) {
+            counters[static_cast<size_t>(counter)].fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+    static uint64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    // Running total since the process started; only moves while tracing is on.
+    static uint64_t counter(TraceCounter counter) {
+        return counters[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+    }
+    static void record(TraceTimer timer, uint64_t start_ns, uint64_t end_ns);
+    static void report();
+private:
+    static inline bool active = false;
+    static inline bool chrome = false;
+    static inline std::string output;
+    static inline uint64_t start_ns = 0;
+    static inline std::array<std::atomic<uint64_t>, static_cast<size_t>(TraceCounter::Count)> counters{};
+    static inline std::array<TraceTimerStats, static_cast<size_t>(TraceTimer::Count)> timers{};
+};
+
+class TraceScope {
+public:
+    explicit TraceScope(TraceTimer timer) : timer(timer), armed(Trace::enabled()) {
+        if (armed) {
+            start = Trace::now_ns();
+        }
+    }
+    ~TraceScope() {
+        if (armed) {
+            Trace::record(timer, start, Trace::now_ns());
+        }
+    }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+private:
+    TraceTimer timer;
+    bool armed;
+    uint64_t start = 0;
+};
+
+#endif // TRACE_H
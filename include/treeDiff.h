@@ -0,0 +1,34 @@
+#ifndef TREE_DIFF_H
+#define TREE_DIFF_H
+
+#include <functional>
+#include <string>
+
+#include "repository.h"
+#include "gitTree.h"
+#include "pathspec.h"
+
+enum class TreeChange {
+    Added,
+    Deleted,
+    Modified
+};
+
+// One file-level difference. For Added only new_entry is set, for Deleted
+// only old_entry; Modified means the blob id or the mode changed.
+struct TreeDiffEntry {
+    TreeChange change;
+    std::string path;
+    GitTreeEntry old_entry;
+    GitTreeEntry new_entry;
+};
+
+// Walks two trees side by side in tree order. Subtrees whose ids are equal
+// are skipped without being read, so the cost follows the size of the
+// change. Either id may be empty to stand for an empty tree. A file that
+// became a directory (or back) is reported as a delete plus adds.
+void diff_trees(const GitRepository &repo, const std::string &old_tree, const std::string &new_tree,
+                const std::function<void(const TreeDiffEntry &)> &visit, const Pathspec &pathspec = Pathspec(),
+                const std::string &prefix = "");
+
+#endif // TREE_DIFF_H
@@ -1,287 +1,1025 @@
-#include <fstream>
-#include <iostream>
-#include <iomanip>
-#include <string>
-#include <set>
-#include <vector>
-#include <exception>
-#include <memory>
-#include <map>
-
-#include "repository.h"
-#include "object.h"
-#include "gitCommit.h"
-#include "gitTree.h"
-
-namespace fs = std::filesystem;
-
-int cmd_init(const std::vector<std::string> &args) {
-    if (args.size() < 1) {
-        std::cerr << "Usage: init <repository-path>" << std::endl;
-        return 1;
-    }
-    fs::path repo_path = fs::current_path();
-    GitRepository::repo_create(repo_path);
-    return 0;
-}
-
-int cmd_cat_file(const std::vector<std::string> &args) {
-    if (args.size() < 4) {
-        std::cerr << "Usage: cat-file <type> <object>" << std::endl;
-        return 1;
-    }
-    const std::string &type = args[2];
-    const std::string &object = args[3];
-    
-    try {
-        GitRepository repo = GitRepository::repo_find(fs::current_path(), true);
-        std::string obj_name = find_object(repo, object);
-        std::shared_ptr<GitObject> obj = read_object(repo, obj_name);
-        if (type == "-p") {
-            std::cout << obj->get_content() << std::endl;
-            return 0;
-        } else if (type == "-t") {
-            std::cout << obj->get_type() << std::endl;
-            return 0;
-        } else if (type == "-s") {
-            std::cout << obj->get_size() << std::endl;
-            return 0;
-        } else {
-            std::cerr << "Unknown option: " << type <<std::endl;
-            std::cerr << "Options: -p, -t, -s" << std::endl;
-            return 1;
-        }
-    } 
-    catch (const std::exception &e) {
-        std::cerr << "Error: " << e.what() << std::endl;
-        return 1;
-    }
-    return 0;
-}
-
-int cmd_hash_object(const std::vector<std::string> &args) {
-    if (args.size() < 4) {
-        std::cerr << "Usage: hash-object [-t <type>] [-w] [--path=<file>]" << std::endl;
-        return 1;
-    }
-    const std::string &type = args[2];
-    bool write = false;
-    fs::path file;
-
-    if (args[3] == "-w") {
-        write = true;
-        if (args.size() < 5) {
-            std::cerr << "Usage: hash-object [-t <type>] [-w] [--path=<file>]" << std::endl;
-            return 1;
-        }
-        file = args[4];
-    } else {
-        file = args[3];
-    }
-
-    try {
-        GitRepository repo = GitRepository::repo_find(fs::current_path(), true);
-        if (!fs::exists(file) || !fs::is_regular_file(file)) {
-            throw std::runtime_error("File not found: " + file.string());
-        }
-        std::ifstream ifs(file);
-        std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
-        std::string sha = hash_object(repo, data, type, write);
-        std::cout << sha << std::endl;
-        return 0;
-    }
-    catch (const std::exception &e) {
-        std::cerr << "Error: " << e.what() << std::endl;
-        return 1;
-    }
-    return 0;
-}
-
-int log_graphviz(GitRepository &repo, const std::string& sha, std::set<std::string>& seen) {
-
-    if (seen.count(sha)) 
-        return 0;
-    seen.insert(sha);
-    
-    const auto& commit_obj = read_object(repo, sha);
-    if (commit_obj == nullptr) {
-        throw std::runtime_error("Object not found: " + sha);
-        return 1;
-    }
-    else if (commit_obj->get_type() != "commit") {
-        throw std::runtime_error("Not a commit object: " + sha);
-        return 1;
-    }
-    auto commit = std::dynamic_pointer_cast<GitCommit>(commit_obj);
-    std::string msg = commit->get_message();
-    std::cout << " c_" << sha << " [label=\"" << sha.substr(0, 7) << ": " << msg << "\"];\n";
-
-    auto parents = commit->get_value("parent");
-    for (const std::string& parent : parents) {
-        std::cout << " c_" << sha << " -> c_" << parent << ";\n";
-        log_graphviz(repo, parent, seen);
-    }
-    return 0;
-}
-
-int cmd_log(const std::vector<std::string> &args) {
-    int status = 0;
-    
-    if (args.size() < 3) {
-        std::cerr << "Usage: log <commit>" << std::endl;
-        return 1;
-    }
-    const std::string &commit = args[2];
-    
-    try {
-        GitRepository repo = GitRepository::repo_find(fs::current_path(), true);
-        std::string obj_name = find_object(repo, commit);
-        std::shared_ptr<GitObject> obj = read_object(repo, obj_name);
-        if (obj->get_type() != "commit") {
-            throw std::runtime_error("Object is not a commit: " + commit);
-        }
-        std::cout<< "digraph log {" << std::endl;
-        std::set<std::string> seen;
-        status = log_graphviz(repo, obj_name, seen);
-        if (status == 0) {
-            std::cout << "}\n";
-        }
-    } 
-    catch (const std::exception &e) {
-        std::cerr << "Error: " << e.what() << std::endl;
-        return 1;
-    }
-    return status;
-}
-
-int cmd_ls_tree(const std::vector<std::string> &args) {
-    if (args.size() < 2) {
-        std::cerr << "Usage: ls-tree [options] <tree-ish> [path]" << std::endl;
-        std::cerr << "Options: -r, --name-only, --long" << std::endl;
-        return 1;
-    }
-    std::string treeish;
-    std::string path;
-    bool opt_recursive = false;
-    bool opt_name_only = false;
-    bool opt_long = false;
-
-    for (size_t i = 2; i < args.size(); ++i) {
-        const std::string &arg = args[i];
-        if (arg == "-r") {
-            opt_recursive = true;
-        } else if (arg == "--name-only") {
-            opt_name_only = true;
-        } else if (arg == "--long") {
-            opt_long = true;
-        } else if (treeish.empty()) {
-            treeish = arg;
-        } else {
-            path = arg;
-        }
-    }
-   
-    GitRepository repo = GitRepository::repo_find(fs::current_path(), true);
-    std::string tree_sha = find_object(repo, treeish);
-    auto obj = read_object(repo, tree_sha);
-    if (obj->get_type() != "tree") {
-        throw std::runtime_error("Object is not a tree: " + tree_sha);
-    }
-    auto tree = std::dynamic_pointer_cast<GitTree>(obj);
-    auto entries = tree->get_entries();
-    if (opt_recursive) {
-        tree->recursive_ls_tree(repo, tree_sha, path);
-        return 0;
-    }
-    for (const auto &entry : entries) {
-        auto entry_obj = read_object(repo, entry.sha);
-        if (opt_name_only) {
-            std::cout << entry.path << std::endl;
-            continue;
-        }
-        if (opt_long){
-            std::cout << entry.mode << " " << entry_obj->get_type() << " " << entry.sha << "\t" << entry_obj->get_size() << "\t" << entry.path << std::endl;
-            continue;
-        }
-        std::cout << entry.mode << " " << entry_obj->get_type() << " " << entry.sha << "\t" << entry.path << std::endl;
-    }
-    return 0;
-}
-
-int cmd_checkout(const std::vector<std::string> &args) {
-    if (args.size() < 3) {
-        std::cerr << "Usage: checkout <branch>" << std::endl;
-        return 1;
-    }
-    std::string branch = args[2];
-    fs::path branch_path;
-    if (args.size() > 3) {
-        branch_path = args[3];
-    } else {
-        branch_path = fs::current_path();
-    }
-
-    GitRepository repo = GitRepository::repo_find(fs::current_path(), true);
-    std::string sha = branch_sha(repo, branch);
-    std::shared_ptr<GitObject> obj = read_object(repo, sha);
-
-    if (obj->get_type() != "commit") {
-        std::cerr << "Branch does not point to a commit: " << branch << std::endl;
-        return 1;
-    }
-
-    auto commit = std::dynamic_pointer_cast<GitCommit>(obj);
-    if (commit->get_value("tree").empty()) {
-        std::cerr << "Commit has no tree." << std::endl;
-        return 1;
-    }
-    std::string tree_sha = commit->get_value("tree").front();
-
-    obj = read_object(repo, tree_sha);
-    if (fs::exists(branch_path)) {
-        if (!fs::is_directory(branch_path)) {
-            std::cerr << "Target path is not a directory: " << branch_path.string() << std::endl;
-            return 1;
-        }
-        if (!fs::is_empty(branch_path)) {
-            std::cerr << "Target directory is not empty: " << branch_path.string() << std::endl;
-            return 1;
-        }
-    } else {
-        fs::create_directories(branch_path);
-    }
-    tree_checkout(repo, tree_sha, branch_path);
-    return 0;
-}
-
-int process_command(const std::vector<std::string> &args) {
-    int status = 0;
-    if (args.empty()) {
-        std::cerr << "No command provided." << std::endl;
-        return 1;
-    }
-
-    const std::string& command = args[1];
-    if (command == "init") 
-        status = cmd_init(args);
-    else if (command == "cat-file") 
-        status = cmd_cat_file(args);
-    else if (command == "hash-object")
-        status = cmd_hash_object(args);
-    else if (command == "log")
-        status = cmd_log(args);
-    else if (command == "ls-tree")
-        status = cmd_ls_tree(args);
-    else if (command == "checkout")
-        status = cmd_checkout(args);
-    else {
-        std::cerr << "Unknown command: " << command << std::endl;
-        status = 1;
-    }
-    return status;
-}
-
-int main(int argc, char *argv[]) {
-    std::vector<std::string> args(argv, argv + argc);
-    return process_command(args);
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <set>
+#include <vector>
+#include <exception>
+#include <memory>
+#include <map>
+#include <chrono>
+#include <algorithm>
+#include <charconv>
+
+#include <spawn.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+
+#include "repository.h"
+#include "object.h"
+#include "gitCommit.h"
+#include "gitTree.h"
+#include "trace.h"
+#include "server.h"
+#include "prefetch.h"
+#include "fsck.h"
+#include "archive.h"
+#include "grep.h"
+#include "refs.h"
+#include "pack.h"
+#include "reachability.h"
+#include "changedPaths.h"
+#include "blame.h"
+#include "dirSnapshot.h"
+
+namespace fs = std::filesystem;
+
+// The value of a numeric flag such as --threads. A bad value is reported
+// here and false returned, so the command can exit with its usage status.
+bool parse_count(const std::string &flag, const std::string &value, size_t &out) {
+    auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), out);
+    if (value.empty() || ec != std::errc() || end != value.data() + value.size()) {
+        std::cerr << "Error: " << flag << " expects a non-negative number, got '" << value << "'" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int cmd_init(const std::vector<std::string> &args) {
+    if (args.size() < 1) {
+        std::cerr << "Usage: init <repository-path>" << std::endl;
+        return 1;
+    }
+    fs::path repo_path = fs::current_path();
+    GitRepository::repo_create(repo_path);
+    return 0;
+}
+
+// A ref name (HEAD, a branch, a tag, ...) or a (possibly abbreviated) object id.
+std::string resolve_name(const GitRepository &repo, const std::string &name) {
+    if (name.size() != 40) {
+        if (auto sha = RefStore(repo).resolve(name)) {
+            return *sha;
+        }
+    }
+    return find_object(repo, name);
+}
+
+// The root tree of the commit a name resolves to.
+std::string resolve_commit_tree(const GitRepository &repo, const std::string &name) {
+    return commit_tree(*read_commit(repo, resolve_name(repo, name)));
+}
+
+// Read-only commands below take an open repository and write to the given
+// streams so that `serve` can answer them from a warm, long-lived handle.
+int cmd_cat_file(GitRepository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err) {
+    if (args.size() < 4) {
+        err << "Usage: cat-file <type> <object>" << std::endl;
+        return 1;
+    }
+    const std::string &type = args[2];
+    const std::string &object = args[3];
+
+    std::string obj_name = resolve_name(repo, object);
+    std::shared_ptr<GitObject> obj = read_object(repo, obj_name);
+    if (type == "-p") {
+        out << obj->get_content() << std::endl;
+        return 0;
+    } else if (type == "-t") {
+        out << obj->get_type() << std::endl;
+        return 0;
+    } else if (type == "-s") {
+        out << obj->get_size() << std::endl;
+        return 0;
+    } else {
+        err << "Unknown option: " << type <<std::endl;
+        err << "Options: -p, -t, -s" << std::endl;
+        return 1;
+    }
+}
+
+int cmd_hash_object(const std::vector<std::string> &args) {
+    if (args.size() < 4) {
+        std::cerr << "Usage: hash-object [-t <type>] [-w] [--path=<file>]" << std::endl;
+        return 1;
+    }
+    const std::string &type = args[2];
+    bool write = false;
+    fs::path file;
+
+    if (args[3] == "-w") {
+        write = true;
+        if (args.size() < 5) {
+            std::cerr << "Usage: hash-object [-t <type>] [-w] [--path=<file>]" << std::endl;
+            return 1;
+        }
+        file = args[4];
+    } else {
+        file = args[3];
+    }
+
+    try {
+        GitRepository repo = GitRepository::repo_find(fs::current_path(), true);
+        if (!fs::exists(file) || !fs::is_regular_file(file)) {
+            throw std::runtime_error("File not found: " + file.string());
+        }
+        std::ifstream ifs(file);
+        std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        std::string sha = hash_object(repo, data, type, write);
+        std::cout << sha << std::endl;
+        return 0;
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int log_graphviz(ObjectPrefetcher &prefetcher, const std::string& sha, std::set<std::string>& seen, std::ostream &out) {
+
+    if (seen.count(sha)) 
+        return 0;
+    seen.insert(sha);
+    
+    auto commit = object_as<GitCommit>(prefetcher.get(sha), sha);
+    std::string msg = commit->get_message();
+    out << " c_" << sha << " [label=\"" << sha.substr(0, 7) << ": " << msg << "\"];\n";
+
+    auto parents = commit->get_value("parent");
+    std::vector<std::string> unseen;
+    for (const std::string& parent : parents) {
+        if (!seen.count(parent)) {
+            unseen.push_back(parent);
+        }
+    }
+    prefetcher.prefetch(unseen);
+    for (const std::string& parent : parents) {
+        out << " c_" << sha << " -> c_" << parent << ";\n";
+        log_graphviz(prefetcher, parent, seen, out);
+    }
+    return 0;
+}
+
+int cmd_log(GitRepository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err) {
+    int status = 0;
+
+    if (args.size() < 3) {
+        err << "Usage: log <commit> [--no-filters] [-- <path>]" << std::endl;
+        return 1;
+    }
+    const std::string &commit = args[2];
+    PathLogOptions path_options;
+    std::string path;
+    for (size_t i = 3; i < args.size(); ++i) {
+        if (args[i] == "--" && i + 2 == args.size()) {
+            path = args[++i];
+        } else if (args[i] == "--no-filters") {
+            path_options.use_filters = false;
+        } else {
+            err << "Usage: log <commit> [--no-filters] [-- <path>]" << std::endl;
+            return 1;
+        }
+    }
+    if (!path.empty()) {
+        // One line per commit that changed path, newest first.
+        log_path(repo, resolve_name(repo, commit), path, path_options,
+                 [&](const std::string &sha, const std::string &message) {
+            out << sha << " " << message.substr(0, message.find('\n')) << "\n";
+        });
+        out.flush();
+        return 0;
+    }
+
+    std::string obj_name = resolve_name(repo, commit);
+    read_commit(repo, obj_name);
+    out << "digraph log {" << std::endl;
+    std::set<std::string> seen;
+    auto lease = repo.prefetchers().acquire();
+    ObjectPrefetcher &prefetcher = *lease;
+    status = log_graphviz(prefetcher, obj_name, seen, out);
+    if (status == 0) {
+        out << "}\n";
+    }
+    return status;
+}
+
+int cmd_ls_tree(GitRepository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err) {
+    if (args.size() < 3) {
+        err << "Usage: ls-tree [options] <tree-ish> [path] [-- <pathspec>...]" << std::endl;
+        err << "Options: -r, --name-only, --long" << std::endl;
+        return 1;
+    }
+    std::string treeish;
+    std::string path;
+    std::vector<std::string> patterns;
+    bool opt_recursive = false;
+    bool opt_name_only = false;
+    bool opt_long = false;
+
+    for (size_t i = 2; i < args.size(); ++i) {
+        const std::string &arg = args[i];
+        if (arg == "--") {
+            patterns.assign(args.begin() + i + 1, args.end());
+            break;
+        } else if (arg == "-r") {
+            opt_recursive = true;
+        } else if (arg == "--name-only") {
+            opt_name_only = true;
+        } else if (arg == "--long") {
+            opt_long = true;
+        } else if (treeish.empty()) {
+            treeish = arg;
+        } else {
+            path = arg;
+        }
+    }
+
+    // Like git ls-tree, a commit stands for its tree.
+    std::string tree_sha = resolve_name(repo, treeish);
+    if (read_object_header(repo, tree_sha).type == "commit") {
+        tree_sha = resolve_commit_tree(repo, tree_sha);
+    }
+    auto tree = read_tree(repo, tree_sha);
+    Pathspec pathspec(patterns);
+    auto entries = select_entries(tree->get_entries(), "", pathspec);
+    if (opt_recursive) {
+        tree->recursive_ls_tree(repo, tree_sha, path, out, pathspec);
+        return 0;
+    }
+    for (const auto &entry : entries) {
+        if (opt_name_only) {
+            out << entry.path << std::endl;
+            continue;
+        }
+        std::string type = tree_entry_type(entry);
+        if (opt_long){
+            // Like git, only blobs have a size; trees and submodules show "-".
+            std::string size = type == "blob" ? std::to_string(read_object_header(repo, entry.sha).size) : "-";
+            out << entry.mode << " " << type << " " << entry.sha << "\t" << size << "\t" << entry.path << std::endl;
+            continue;
+        }
+        out << entry.mode << " " << type << " " << entry.sha << "\t" << entry.path << std::endl;
+    }
+    return 0;
+}
+
+int cmd_rev_parse(GitRepository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err) {
+    if (args.size() < 3) {
+        err << "Usage: rev-parse <name>..." << std::endl;
+        return 1;
+    }
+    for (size_t i = 2; i < args.size(); ++i) {
+        out << resolve_name(repo, args[i]) << "\n";
+    }
+    return 0;
+}
+
+int cmd_show_ref(GitRepository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err) {
+    std::vector<std::string> prefixes;
+    std::vector<std::string> patterns;
+    bool hash_only = false;
+    bool verify = false;
+    for (size_t i = 2; i < args.size(); ++i) {
+        if (args[i] == "--heads") {
+            prefixes.push_back("refs/heads/");
+        } else if (args[i] == "--tags") {
+            prefixes.push_back("refs/tags/");
+        } else if (args[i] == "--hash") {
+            hash_only = true;
+        } else if (args[i] == "--verify") {
+            verify = true;
+        } else if (!args[i].empty() && args[i][0] == '-') {
+            err << "Usage: show-ref [--heads] [--tags] [--hash] [--verify] [<pattern>...]" << std::endl;
+            return 1;
+        } else {
+            patterns.push_back(args[i]);
+        }
+    }
+    RefStore refs(repo);
+    size_t shown = 0;
+    auto show = [&](const std::string &name, const std::string &sha) {
+        if (hash_only) {
+            out << sha << "\n";
+        } else {
+            out << sha << " " << name << "\n";
+        }
+        ++shown;
+    };
+    if (verify) {
+        // Exact, full ref names only, each an O(log n) lookup.
+        for (const auto &name : patterns) {
+            if (auto sha = refs.read(name)) {
+                show(name, *sha);
+            } else {
+                err << "fatal: '" << name << "' - not a valid ref" << std::endl;
+                return 1;
+            }
+        }
+        return shown ? 0 : 1;
+    }
+    // A pattern matches whole trailing components: "v1" matches
+    // refs/tags/v1 but not refs/tags/xv1.
+    auto selected = [&](const std::string &name) {
+        if (patterns.empty()) {
+            return true;
+        }
+        return std::any_of(patterns.begin(), patterns.end(), [&](const std::string &pattern) {
+            return name == pattern || (name.size() > pattern.size() && name[name.size() - pattern.size() - 1] == '/' &&
+                                       name.compare(name.size() - pattern.size(), pattern.size(), pattern) == 0);
+        });
+    };
+    if (prefixes.empty()) {
+        prefixes.push_back("refs/");
+    }
+    for (const auto &prefix : prefixes) {
+        refs.for_each([&](const std::string &name, const std::string &sha) {
+            if (selected(name)) {
+                show(name, sha);
+            }
+        }, prefix);
+    }
+    out.flush();
+    return shown ? 0 : 1;
+}
+
+int cmd_rev_list(GitRepository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err) {
+    RevListOptions options;
+    bool count_only = false;
+    std::vector<std::string> include;
+    std::vector<std::string> exclude;
+    for (size_t i = 2; i < args.size(); ++i) {
+        if (args[i] == "--objects") {
+            options.objects = true;
+        } else if (args[i] == "--count") {
+            count_only = true;
+        } else if (args[i] == "--no-bitmaps") {
+            options.use_bitmaps = false;
+        } else if (args[i].size() > 1 && args[i][0] == '^') {
+            exclude.push_back(resolve_name(repo, args[i].substr(1)));
+        } else if (!args[i].empty() && args[i][0] != '-') {
+            include.push_back(resolve_name(repo, args[i]));
+        } else {
+            include.clear();
+            break;
+        }
+    }
+    if (include.empty()) {
+        err << "Usage: rev-list [--objects] [--count] [--no-bitmaps] <commit>... [^<commit>...]" << std::endl;
+        return 1;
+    }
+    std::function<void(const std::string &, const std::string &)> visit;
+    if (!count_only) {
+        visit = [&](const std::string &sha, const std::string &path) {
+            out << sha;
+            if (!path.empty()) {
+                out << " " << path;
+            }
+            out << "\n";
+        };
+    }
+    size_t count = rev_list(repo, include, exclude, options, visit);
+    if (count_only) {
+        out << count << "\n";
+    }
+    out.flush();
+    return 0;
+}
+
+int cmd_blame(GitRepository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err) {
+    if (args.size() != 5 || args[3] != "--") {
+        err << "Usage: blame <commit> -- <path>" << std::endl;
+        return 1;
+    }
+    BlameResult result = blame_file(repo, resolve_name(repo, args[2]), args[4]);
+    // Like `git blame -s -l`: root commits are marked with '^'.
+    int width = std::to_string(result.lines.size()).size();
+    for (const auto &entry : result.entries) {
+        std::string id = entry.boundary ? "^" + entry.commit.substr(0, 39) : entry.commit;
+        for (size_t i = 0; i < entry.count; ++i) {
+            size_t line = entry.final_start + i;
+            out << id << " " << std::setw(width) << line + 1 << ") " << result.lines[line] << "\n";
+        }
+    }
+    out.flush();
+    return 0;
+}
+
+bool is_query_command(const std::string &command) {
+    return command == "cat-file" || command == "log" || command == "ls-tree" || command == "rev-parse" ||
+           command == "show-ref" || command == "rev-list" || command == "blame";
+}
+
+int run_query(GitRepository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err) {
+    const std::string &command = args.size() > 1 ? args[1] : "";
+    if (command == "cat-file")
+        return cmd_cat_file(repo, args, out, err);
+    else if (command == "log")
+        return cmd_log(repo, args, out, err);
+    else if (command == "ls-tree")
+        return cmd_ls_tree(repo, args, out, err);
+    else if (command == "rev-parse")
+        return cmd_rev_parse(repo, args, out, err);
+    else if (command == "show-ref")
+        return cmd_show_ref(repo, args, out, err);
+    else if (command == "rev-list")
+        return cmd_rev_list(repo, args, out, err);
+    else if (command == "blame")
+        return cmd_blame(repo, args, out, err);
+    err << "Unsupported command: " << command << std::endl;
+    return 1;
+}
+
+int cmd_query(const std::vector<std::string> &args) {
+    try {
+        GitRepository repo = GitRepository::repo_find(fs::current_path(), true);
+        return run_query(repo, args, std::cout, std::cerr);
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
+
+int cmd_serve(const std::vector<std::string> &args) {
+    fs::path socket_path;
+    size_t workers = 0;
+    for (size_t i = 2; i < args.size(); ++i) {
+        if (args[i] == "--socket" && i + 1 < args.size()) {
+            socket_path = args[++i];
+        } else if (args[i] == "--workers" && i + 1 < args.size()) {
+            if (!parse_count(args[i], args[i + 1], workers)) {
+                return 1;
+            }
+            ++i;
+        }
+    }
+    if (socket_path.empty()) {
+        std::cerr << "Usage: serve --socket <path> [--workers <n>]" << std::endl;
+        return 1;
+    }
+    try {
+        GitRepository repo = GitRepository::repo_find(fs::current_path(), true);
+        ObjectServer server(socket_path, [&repo](const std::vector<std::string> &request, std::ostream &out, std::ostream &err) {
+            if (!is_query_command(request.size() > 1 ? request[1] : "")) {
+                err << "Unsupported command" << std::endl;
+                return 1;
+            }
+            return run_query(repo, request, out, err);
+        }, workers);
+        std::cerr << "Serving " << repo.get_gitdir().string() << " on " << socket_path.string() << std::endl;
+        server.run();
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+void print_latency(const std::string &label, std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    auto at = [&](double q) {
+        return samples[std::min(samples.size() - 1, static_cast<size_t>(q * samples.size()))];
+    };
+    std::cerr << std::fixed << std::setprecision(1) << label << ": n=" << samples.size()
+              << " p50=" << at(0.50) << "us p99=" << at(0.99) << "us" << std::endl;
+}
+
+// One fresh git_cli process per call, output discarded: the path `serve` replaces.
+double time_process_call(const std::vector<std::string> &request) {
+    std::vector<std::string> argv_strings = {"/proc/self/exe"};
+    argv_strings.insert(argv_strings.end(), request.begin(), request.end());
+    std::vector<char *> argv;
+    for (auto &s : argv_strings) {
+        argv.push_back(s.data());
+    }
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid;
+    int rc = posix_spawn(&pid, "/proc/self/exe", &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0) {
+        throw std::runtime_error("Failed to spawn git_cli");
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+int cmd_client(const std::vector<std::string> &args) {
+    fs::path socket_path;
+    size_t repeat = 1;
+    bool compare = false;
+    size_t i = 2;
+    for (; i < args.size(); ++i) {
+        if (args[i] == "--socket" && i + 1 < args.size()) {
+            socket_path = args[++i];
+        } else if (args[i] == "--repeat" && i + 1 < args.size()) {
+            if (!parse_count(args[i], args[i + 1], repeat)) {
+                return 1;
+            }
+            repeat = std::max<size_t>(1, repeat);
+            ++i;
+        } else if (args[i] == "--compare") {
+            compare = true;
+        } else {
+            break;
+        }
+    }
+    if (socket_path.empty() || i >= args.size()) {
+        std::cerr << "Usage: client --socket <path> [--repeat <n>] [--compare] <command> [args...]" << std::endl;
+        return 1;
+    }
+    std::vector<std::string> request(args.begin() + i, args.end());
+
+    try {
+        ServerClient client(socket_path);
+        ServerResponse response;
+        std::vector<double> samples;
+        for (size_t n = 0; n < repeat; ++n) {
+            auto start = std::chrono::steady_clock::now();
+            response = client.request(request);
+            samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::cout << response.out;
+        std::cerr << response.err;
+        if (repeat > 1 || compare) {
+            print_latency("daemon", samples);
+        }
+        if (compare) {
+            std::vector<double> process_samples;
+            for (size_t n = 0; n < repeat; ++n) {
+                process_samples.push_back(time_process_call(request));
+            }
+            print_latency("process", process_samples);
+        }
+        return response.status;
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
+
+// Switch an existing checkout of `from` over to `branch` in place.
+int checkout_update(const std::string &from, const std::string &branch, const fs::path &branch_path, bool check_local,
+                    const Pathspec &pathspec) {
+    try {
+        GitRepository repo = GitRepository::repo_find(fs::current_path(), true);
+        if (!fs::is_directory(branch_path)) {
+            std::cerr << "Target path is not a directory: " << branch_path.string() << std::endl;
+            return 1;
+        }
+        CheckoutStats stats = tree_checkout_update(repo, resolve_commit_tree(repo, from), resolve_commit_tree(repo, branch), branch_path,
+                                                   check_local, pathspec);
+        std::cout << "Updated " << stats.written << " files, removed " << stats.deleted << ", changed mode of "
+                  << stats.chmodded << std::endl;
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int cmd_checkout(const std::vector<std::string> &args) {
+    std::vector<std::string> positional;
+    fs::path sparse_file;
+    std::string from;
+    bool check_local = false;
+    for (size_t i = 2; i < args.size(); ++i) {
+        if (args[i] == "--sparse" && i + 1 < args.size()) {
+            sparse_file = args[++i];
+        } else if (args[i] == "--from" && i + 1 < args.size()) {
+            from = args[++i];
+        } else if (args[i] == "--check") {
+            check_local = true;
+        } else {
+            positional.push_back(args[i]);
+        }
+    }
+    if (positional.empty()) {
+        std::cerr << "Usage: checkout [--sparse <patterns-file>] [--from <commit> [--check]] <branch> [target-path]" << std::endl;
+        return 1;
+    }
+    std::string branch = positional[0];
+    fs::path branch_path;
+    if (positional.size() > 1) {
+        branch_path = positional[1];
+    } else {
+        branch_path = fs::current_path();
+    }
+    Pathspec pathspec = sparse_file.empty() ? Pathspec() : Pathspec::from_file(sparse_file);
+    if (!from.empty()) {
+        return checkout_update(from, branch, branch_path, check_local, pathspec);
+    }
+
+    try {
+        GitRepository repo = GitRepository::repo_find(fs::current_path(), true);
+        std::string tree_sha = resolve_commit_tree(repo, branch);
+        if (fs::exists(branch_path)) {
+            if (!fs::is_directory(branch_path)) {
+                std::cerr << "Target path is not a directory: " << branch_path.string() << std::endl;
+                return 1;
+            }
+            if (!fs::is_empty(branch_path)) {
+                std::cerr << "Target directory is not empty: " << branch_path.string() << std::endl;
+                std::cerr << "Use --from <commit> to update an existing checkout in place." << std::endl;
+                return 1;
+            }
+        } else {
+            fs::create_directories(branch_path);
+        }
+        tree_checkout(repo, tree_sha, branch_path, pathspec);
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int cmd_archive(const std::vector<std::string> &args) {
+    ArchiveOptions options;
+    std::string treeish;
+    std::vector<std::string> patterns;
+    try {
+        for (size_t i = 2; i < args.size(); ++i) {
+            if (args[i].rfind("--format=", 0) == 0) {
+                options.format = parse_archive_format(args[i].substr(9));
+            } else if (args[i] == "--threads" && i + 1 < args.size()) {
+                if (!parse_count(args[i], args[i + 1], options.threads)) {
+                    return 1;
+                }
+                ++i;
+            } else if (treeish.empty()) {
+                treeish = args[i];
+            } else {
+                patterns.push_back(args[i]);
+            }
+        }
+        if (treeish.empty()) {
+            std::cerr << "Usage: archive [--format=tar|tar.gz] [--threads <n>] <tree-ish> [pathspec...]" << std::endl;
+            return 1;
+        }
+        options.pathspec = Pathspec(patterns);
+
+        GitRepository repo = GitRepository::repo_find(fs::current_path(), true);
+        std::string sha = resolve_name(repo, treeish);
+        auto obj = read_object(repo, sha);
+        options.mtime = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        if (obj->get_object_type() == ObjectType::Commit) {
+            // Like git archive, stamp entries with the committer date.
+            auto commit = object_as<GitCommit>(obj, sha);
+            options.mtime = committer_time(*commit);
+            sha = commit_tree(*commit);
+        }
+        else if (obj->get_object_type() != ObjectType::Tree) {
+            throw std::runtime_error("Not a tree-ish: " + treeish);
+        }
+        write_archive(repo, sha, options, std::cout);
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// A commit's root tree, or a tree id itself.
+std::string treeish_tree(const GitRepository &repo, const std::string &name) {
+    std::string sha = resolve_name(repo, name);
+    auto obj = read_object(repo, sha);
+    if (obj->get_object_type() == ObjectType::Commit) {
+        return commit_tree(*object_as<GitCommit>(obj, sha));
+    }
+    if (obj->get_object_type() != ObjectType::Tree) {
+        throw std::runtime_error("Not a tree-ish: " + name);
+    }
+    return sha;
+}
+
+int cmd_grep(const std::vector<std::string> &args) {
+    GrepOptions options;
+    std::vector<std::string> positional;
+    std::vector<std::string> patterns;
+    for (size_t i = 2; i < args.size(); ++i) {
+        if (args[i] == "--") {
+            patterns.assign(args.begin() + i + 1, args.end());
+            break;
+        } else if (args[i] == "-F") {
+            options.syntax = GrepSyntax::Fixed;
+        } else if (args[i] == "-E") {
+            options.syntax = GrepSyntax::Extended;
+        } else if (args[i] == "-i") {
+            options.ignore_case = true;
+        } else if (args[i] == "-l") {
+            options.files_only = true;
+        } else if (args[i] == "-n") {
+            options.line_numbers = true;
+        } else if (args[i] == "--threads" && i + 1 < args.size()) {
+            if (!parse_count(args[i], args[i + 1], options.threads)) {
+                return 2;
+            }
+            ++i;
+        } else {
+            positional.push_back(args[i]);
+        }
+    }
+    if (positional.size() != 2) {
+        std::cerr << "Usage: grep [-F|-E] [-i] [-l] [-n] [--threads <n>] <pattern> <tree-ish> [-- <pathspec>...]" << std::endl;
+        return 2;
+    }
+    try {
+        GitRepository repo = GitRepository::repo_find(fs::current_path(), true);
+        options.pathspec = Pathspec(patterns);
+        options.label = positional[1] + ":";
+        size_t matched = grep_tree(repo, treeish_tree(repo, positional[1]), positional[0], options, std::cout);
+        return matched ? 0 : 1;
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 2;
+    }
+}
+
+void print_pack_stats(const IndexPackResult &result, const std::string &verb) {
+    std::cerr << verb << " " << result.objects << " objects (" << result.deltas << " deltas) in " << std::fixed
+              << std::setprecision(2) << result.scan_seconds + result.resolve_seconds << " s: scan "
+              << result.scan_seconds << " s, resolve " << result.resolve_seconds << " s" << std::endl;
+    for (size_t t = 0; t < result.threads.size(); ++t) {
+        const auto &stats = result.threads[t];
+        double mib = stats.bytes / 1048576.0;
+        std::cerr << "  thread " << t << ": " << stats.objects << " objects, " << std::setprecision(1) << mib
+                  << " MiB in " << std::setprecision(2) << stats.seconds << " s (" << std::setprecision(0)
+                  << (stats.seconds > 0 ? stats.objects / stats.seconds : 0) << " objects/s, " << std::setprecision(1)
+                  << (stats.seconds > 0 ? mib / stats.seconds : 0) << " MiB/s)" << std::endl;
+    }
+}
+
+// index-pack and unpack-objects share one pipeline; unpack writes loose
+// objects instead of an index.
+int cmd_index_pack(const std::vector<std::string> &args, bool unpack) {
+    IndexPackOptions options;
+    options.unpack = unpack;
+    fs::path pack_path;
+    for (size_t i = 2; i < args.size(); ++i) {
+        if (args[i] == "--threads" && i + 1 < args.size()) {
+            if (!parse_count(args[i], args[i + 1], options.threads)) {
+                return 1;
+            }
+            ++i;
+        } else if (args[i] == "-o" && i + 1 < args.size() && !unpack) {
+            options.index_path = args[++i];
+        } else if (pack_path.empty()) {
+            pack_path = args[i];
+        } else {
+            pack_path.clear();
+            break;
+        }
+    }
+    if (pack_path.empty()) {
+        if (unpack) {
+            std::cerr << "Usage: unpack-objects [--threads <n>] <file.pack>" << std::endl;
+        } else {
+            std::cerr << "Usage: index-pack [--threads <n>] [-o <file.idx>] <file.pack>" << std::endl;
+        }
+        return 1;
+    }
+    try {
+        GitRepository repo = GitRepository::repo_find(fs::current_path(), true);
+        IndexPackResult result = index_pack(repo, pack_path, options);
+        if (!unpack) {
+            std::cout << result.pack_checksum << std::endl;
+        }
+        print_pack_stats(result, unpack ? "Unpacked" : "Indexed");
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Bitmaps for the named commits, or for HEAD and every ref when none are
+// given, plus every n-th commit of their history.
+int cmd_write_bitmap(const std::vector<std::string> &args) {
+    size_t every = 100;
+    std::vector<std::string> names;
+    for (size_t i = 2; i < args.size(); ++i) {
+        if (args[i] == "--every" && i + 1 < args.size()) {
+            if (!parse_count(args[i], args[i + 1], every)) {
+                return 1;
+            }
+            ++i;
+        } else if (!args[i].empty() && args[i][0] != '-') {
+            names.push_back(args[i]);
+        } else {
+            std::cerr << "Usage: write-bitmap [--every <n>] [<commit>...]" << std::endl;
+            return 1;
+        }
+    }
+    try {
+        GitRepository repo = GitRepository::repo_find(fs::current_path(), true);
+        std::vector<std::string> tips;
+        for (const auto &name : names) {
+            tips.push_back(resolve_name(repo, name));
+        }
+        if (names.empty()) {
+            RefStore refs(repo);
+            if (auto head = refs.read("HEAD")) {
+                tips.push_back(*head);
+            }
+            refs.for_each([&](const std::string &, const std::string &sha) {
+                tips.push_back(sha);
+            });
+        }
+        if (tips.empty()) {
+            throw std::runtime_error("No commits to index");
+        }
+        BitmapWriteStats stats = write_reachability_bitmaps(repo, tips, every);
+        std::cerr << "Wrote " << stats.commits << " bitmaps over " << stats.objects << " objects ("
+                  << stats.bytes << " bytes)" << std::endl;
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int cmd_write_changed_paths(const std::vector<std::string> &args) {
+    try {
+        GitRepository repo = GitRepository::repo_find(fs::current_path(), true);
+        std::vector<std::string> tips;
+        for (size_t i = 2; i < args.size(); ++i) {
+            tips.push_back(resolve_name(repo, args[i]));
+        }
+        if (tips.empty()) {
+            RefStore refs(repo);
+            if (auto head = refs.read("HEAD")) {
+                tips.push_back(*head);
+            }
+            refs.for_each([&](const std::string &name, const std::string &sha) {
+                if (name.rfind("refs/heads/", 0) == 0) {
+                    tips.push_back(sha);
+                }
+            });
+        }
+        if (tips.empty()) {
+            throw std::runtime_error("No commits to index");
+        }
+        ChangedPathWriteStats stats = write_changed_path_index(repo, tips);
+        std::cerr << "Wrote changed-path filters for " << stats.commits << " commits (" << stats.too_large
+                  << " too large, " << stats.bytes << " bytes)" << std::endl;
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int cmd_multi_pack_index(const std::vector<std::string> &args) {
+    if (args.size() != 3 || args[2] != "write") {
+        std::cerr << "Usage: multi-pack-index write" << std::endl;
+        return 1;
+    }
+    try {
+        GitRepository repo = GitRepository::repo_find(fs::current_path(), true);
+        MultiPackIndexStats stats = write_multi_pack_index(repo);
+        std::cerr << "Wrote multi-pack-index for " << stats.objects << " objects in " << stats.packs << " packs ("
+                  << stats.duplicates << " duplicates, " << stats.bytes << " bytes)" << std::endl;
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int cmd_write_tree(const std::vector<std::string> &args) {
+    SnapshotOptions options;
+    fs::path dir;
+    for (size_t i = 2; i < args.size(); ++i) {
+        if (args[i] == "--from-dir" && i + 1 < args.size()) {
+            dir = args[++i];
+        } else if (args[i] == "--threads" && i + 1 < args.size()) {
+            if (!parse_count(args[i], args[i + 1], options.threads)) {
+                return 1;
+            }
+            ++i;
+        } else {
+            dir.clear();
+            break;
+        }
+    }
+    if (dir.empty()) {
+        std::cerr << "Usage: write-tree --from-dir <dir> [--threads <n>]" << std::endl;
+        return 1;
+    }
+    try {
+        GitRepository repo = GitRepository::repo_find(fs::current_path(), true);
+        SnapshotStats stats = write_tree_from_dir(repo, dir, options);
+        std::cout << stats.tree << std::endl;
+        std::cerr << "Stored " << stats.files << " files and " << stats.trees << " trees (" << stats.written
+                  << " new objects, " << stats.bytes << " bytes) in " << std::fixed << std::setprecision(2)
+                  << stats.seconds << " s" << std::endl;
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int cmd_fsck(const std::vector<std::string> &args) {
+    FsckOptions options;
+    bool show_rate = false;
+    for (size_t i = 2; i < args.size(); ++i) {
+        if (args[i] == "--threads" && i + 1 < args.size()) {
+            if (!parse_count(args[i], args[i + 1], options.threads)) {
+                return 1;
+            }
+            ++i;
+        } else if (args[i] == "--progress") {
+            options.progress = true;
+        } else if (args[i] == "--objects-per-sec") {
+            show_rate = true;
+        } else {
+            std::cerr << "Usage: fsck [--threads <n>] [--progress] [--objects-per-sec]" << std::endl;
+            return 1;
+        }
+    }
+    try {
+        GitRepository repo = GitRepository::repo_find(fs::current_path(), true);
+        FsckReport report = fsck_objects(repo, options, std::cout, std::cerr);
+        if (show_rate) {
+            std::cerr << "Checked " << report.objects << " objects in " << std::fixed << std::setprecision(2)
+                      << report.seconds << " s (" << std::setprecision(0)
+                      << (report.seconds > 0 ? report.objects / report.seconds : 0) << " objects/sec)" << std::endl;
+        }
+        return (report.corrupt || report.missing) ? 1 : 0;
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
+
+int process_command(const std::vector<std::string> &args) {
+    int status = 0;
+    if (args.empty()) {
+        std::cerr << "No command provided." << std::endl;
+        return 1;
+    }
+
+    const std::string& command = args[1];
+    if (command == "init") 
+        status = cmd_init(args);
+    else if (is_query_command(command))
+        status = cmd_query(args);
+    else if (command == "hash-object")
+        status = cmd_hash_object(args);
+    else if (command == "fsck")
+        status = cmd_fsck(args);
+    else if (command == "serve")
+        status = cmd_serve(args);
+    else if (command == "client")
+        status = cmd_client(args);
+    else if (command == "checkout")
+        status = cmd_checkout(args);
+    else if (command == "archive")
+        status = cmd_archive(args);
+    else if (command == "grep")
+        status = cmd_grep(args);
+    else if (command == "index-pack")
+        status = cmd_index_pack(args, false);
+    else if (command == "unpack-objects")
+        status = cmd_index_pack(args, true);
+    else if (command == "write-bitmap")
+        status = cmd_write_bitmap(args);
+    else if (command == "write-changed-paths")
+        status = cmd_write_changed_paths(args);
+    else if (command == "multi-pack-index")
+        status = cmd_multi_pack_index(args);
+    else if (command == "write-tree")
+        status = cmd_write_tree(args);
+    else {
+        std::cerr << "Unknown command: " << command << std::endl;
+        status = 1;
+    }
+    return status;
+}
+
+int main(int argc, char *argv[]) {
+    Trace::init_from_env();
+    std::vector<std::string> args(argv, argv + argc);
+    return process_command(args);
 }
\ No newline at end of file
@@ -0,0 +1,362 @@
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include <zlib.h>
+
+#include "archive.h"
+#include "object.h"
+#include "gitTree.h"
+#include "prefetch.h"
+#include "threadPool.h"
+#include "trace.h"
+
+namespace {
+
+constexpr size_t block_size = 512;
+// tar's default blocking factor of 20: the archive is padded to a whole record.
+constexpr size_t record_size = 20 * block_size;
+constexpr size_t write_chunk = 64 * 1024;
+// Blobs up to this size are inflated ahead of the writer; larger ones are
+// streamed when reached so the window never holds more than a few MiB each.
+constexpr size_t inline_blob_limit = 1 << 20;
+constexpr size_t window_per_thread = 4;
+
+// Buffers output in fixed-size chunks and optionally gzips them on the way
+// to the stream.
+class ArchiveWriter {
+public:
+    ArchiveWriter(std::ostream &out, bool gzip) : out(out), gzip(gzip) {
+        buffer.reserve(write_chunk);
+        if (gzip) {
+            zbuf.resize(write_chunk);
+            if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                throw std::runtime_error("Failed to initialize gzip stream");
+            }
+        }
+    }
+    ~ArchiveWriter() {
+        if (gzip) {
+            deflateEnd(&stream);
+        }
+    }
+    ArchiveWriter(const ArchiveWriter &) = delete;
+    ArchiveWriter &operator=(const ArchiveWriter &) = delete;
+
+    void write(const void *data, size_t len) {
+        const char *p = static_cast<const char *>(data);
+        total += len;
+        while (len > 0) {
+            size_t n = std::min(len, write_chunk - buffer.size());
+            buffer.insert(buffer.end(), p, p + n);
+            p += n;
+            len -= n;
+            if (buffer.size() == write_chunk) {
+                flush_buffer(false);
+            }
+        }
+    }
+    // Zero-fills up to the next block boundary.
+    void pad_block() {
+        static const std::array<char, block_size> zeros{};
+        if (size_t rem = total % block_size) {
+            write(zeros.data(), block_size - rem);
+        }
+    }
+    void finish() {
+        static const std::array<char, block_size> zeros{};
+        write(zeros.data(), zeros.size());
+        write(zeros.data(), zeros.size());
+        while (total % record_size) {
+            write(zeros.data(), zeros.size());
+        }
+        flush_buffer(true);
+        out.flush();
+        if (!out) {
+            throw std::runtime_error("Failed to write archive");
+        }
+    }
+private:
+    void flush_buffer(bool last) {
+        if (!gzip) {
+            put(buffer.data(), buffer.size());
+            buffer.clear();
+            return;
+        }
+        TraceScope scope(TraceTimer::Deflate);
+        stream.next_in = reinterpret_cast<Bytef *>(buffer.data());
+        stream.avail_in = buffer.size();
+        int status;
+        do {
+            stream.next_out = reinterpret_cast<Bytef *>(zbuf.data());
+            stream.avail_out = zbuf.size();
+            status = deflate(&stream, last ? Z_FINISH : Z_NO_FLUSH);
+            if (status == Z_STREAM_ERROR) {
+                throw std::runtime_error("Failed to compress archive");
+            }
+            size_t produced = zbuf.size() - stream.avail_out;
+            Trace::count(TraceCounter::BytesDeflated, produced);
+            put(zbuf.data(), produced);
+        } while (stream.avail_out == 0 || (last && status != Z_STREAM_END));
+        buffer.clear();
+    }
+    void put(const char *data, size_t len) {
+        if (len == 0) {
+            return;
+        }
+        out.write(data, len);
+        if (!out) {
+            throw std::runtime_error("Failed to write archive");
+        }
+        Trace::count(TraceCounter::BytesWritten, len);
+    }
+
+    std::ostream &out;
+    bool gzip;
+    uint64_t total = 0;
+    std::vector<char> buffer;
+    std::vector<char> zbuf;
+    z_stream stream{};
+};
+
+struct ArchiveEntry {
+    std::string path;
+    std::string mode;
+    std::string sha;
+    bool has_data() const {
+        return mode != "40000" && mode != "160000";
+    }
+};
+
+struct LoadedBlob {
+    ObjectHeader header;
+    std::string data;
+    // Too large to hold in the window; stream it when it is written.
+    bool deferred = false;
+};
+
+struct DeferBlob {};
+
+void collect_entries(ObjectPrefetcher &prefetcher, const std::string &tree_sha, const std::string &dir,
+                     const Pathspec &pathspec, std::vector<ArchiveEntry> &out) {
+    auto tree = object_as<GitTree>(prefetcher.get(tree_sha), tree_sha);
+    auto entries = select_entries(tree->get_entries(), dir, pathspec);
+    std::vector<std::string> subtrees;
+    for (const auto &entry : entries) {
+        if (entry.mode == "40000") {
+            subtrees.push_back(entry.sha);
+        }
+    }
+    prefetcher.prefetch(subtrees);
+    for (const auto &entry : entries) {
+        std::string path = dir.empty() ? entry.path : dir + "/" + entry.path;
+        out.push_back({path, entry.mode, entry.sha});
+        if (entry.mode == "40000") {
+            size_t mark = out.size();
+            collect_entries(prefetcher, entry.sha, path, pathspec, out);
+            // Keep a directory only if it was selected or something below it was.
+            if (out.size() == mark && !pathspec.matches(path)) {
+                out.pop_back();
+            }
+        }
+    }
+}
+
+LoadedBlob load_blob(const GitRepository &repo, const std::string &sha) {
+    LoadedBlob blob;
+    try {
+        stream_object(repo, sha, [&](const ObjectHeader &header) {
+            if (header.type != "blob") {
+                throw std::runtime_error("Object is not a blob: " + sha);
+            }
+            blob.header = header;
+            if (header.size > inline_blob_limit) {
+                throw DeferBlob{};
+            }
+            blob.data.reserve(header.size);
+        }, [&](const unsigned char *data, size_t len) {
+            blob.data.append(reinterpret_cast<const char *>(data), len);
+        });
+    }
+    catch (const DeferBlob &) {
+        blob.deferred = true;
+        blob.data.clear();
+    }
+    return blob;
+}
+
+void put_octal(char *field, size_t width, uint64_t value) {
+    // width includes the terminating NUL.
+    std::snprintf(field, width, "%0*llo", static_cast<int>(width - 1), static_cast<unsigned long long>(value));
+}
+
+bool fits_octal(uint64_t value, size_t width) {
+    return value < (uint64_t(1) << (3 * (width - 1)));
+}
+
+// Appends one "<len> key=value\n" pax record; len counts the whole record.
+void add_pax_record(std::string &records, const std::string &key, const std::string &value) {
+    size_t body = key.size() + value.size() + 3;
+    size_t len = body + std::to_string(body).size();
+    if (std::to_string(len).size() != std::to_string(body).size()) {
+        ++len;
+    }
+    records += std::to_string(len) + " " + key + "=" + value + "\n";
+}
+
+// Splits path into ustar's prefix/name fields; false if it cannot fit.
+bool split_ustar_name(const std::string &path, std::string &prefix, std::string &name) {
+    if (path.size() <= 100) {
+        prefix.clear();
+        name = path;
+        return true;
+    }
+    for (size_t slash = path.find('/'); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+        if (slash <= 155 && path.size() - slash - 1 <= 100 && path.size() - slash - 1 > 0) {
+            prefix = path.substr(0, slash);
+            name = path.substr(slash + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+class TarStream {
+public:
+    TarStream(ArchiveWriter &writer, int64_t mtime) : writer(writer), mtime(mtime) {}
+
+    void add(const std::string &path, char typeflag, unsigned mode, uint64_t size, const std::string &link = "") {
+        std::string prefix;
+        std::string name;
+        std::string pax;
+        if (!split_ustar_name(path, prefix, name)) {
+            add_pax_record(pax, "path", path);
+            prefix.clear();
+            name = path.substr(0, 100);
+        }
+        if (link.size() > 100) {
+            add_pax_record(pax, "linkpath", link);
+        }
+        if (!fits_octal(size, 12)) {
+            add_pax_record(pax, "size", std::to_string(size));
+        }
+        if (!pax.empty()) {
+            write_header("pax_header", "", 'x', 0644, pax.size(), "");
+            writer.write(pax.data(), pax.size());
+            writer.pad_block();
+        }
+        write_header(name, prefix, typeflag, mode, fits_octal(size, 12) ? size : 0, link.substr(0, 100));
+    }
+private:
+    void write_header(const std::string &name, const std::string &prefix, char typeflag, unsigned mode,
+                      uint64_t size, const std::string &link) {
+        std::array<char, block_size> block{};
+        std::memcpy(&block[0], name.data(), std::min<size_t>(name.size(), 100));
+        put_octal(&block[100], 8, mode);
+        put_octal(&block[108], 8, 0);
+        put_octal(&block[116], 8, 0);
+        put_octal(&block[124], 12, size);
+        put_octal(&block[136], 12, fits_octal(mtime, 12) ? mtime : 0);
+        std::memset(&block[148], ' ', 8);
+        block[156] = typeflag;
+        std::memcpy(&block[157], link.data(), std::min<size_t>(link.size(), 100));
+        std::memcpy(&block[257], "ustar", 6);
+        std::memcpy(&block[263], "00", 2);
+        std::memcpy(&block[265], "root", 4);
+        std::memcpy(&block[297], "root", 4);
+        std::memcpy(&block[345], prefix.data(), std::min<size_t>(prefix.size(), 155));
+        unsigned checksum = 0;
+        for (char c : block) {
+            checksum += static_cast<unsigned char>(c);
+        }
+        std::snprintf(&block[148], 8, "%06o", checksum);
+        writer.write(block.data(), block.size());
+    }
+
+    ArchiveWriter &writer;
+    int64_t mtime;
+};
+
+}
+
+ArchiveFormat parse_archive_format(const std::string &name) {
+    if (name == "tar") {
+        return ArchiveFormat::Tar;
+    }
+    if (name == "tar.gz" || name == "tgz") {
+        return ArchiveFormat::TarGz;
+    }
+    throw std::runtime_error("Unknown archive format: " + name);
+}
+
+void write_archive(const GitRepository &repo, const std::string &tree_sha, const ArchiveOptions &options, std::ostream &out) {
+    std::vector<ArchiveEntry> entries;
+    {
+        auto lease = repo.prefetchers().acquire();
+        ObjectPrefetcher &prefetcher = *lease;
+        collect_entries(prefetcher, tree_sha, "", options.pathspec, entries);
+    }
+
+    std::vector<size_t> blobs;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].has_data()) {
+            blobs.push_back(i);
+        }
+    }
+    std::vector<std::future<LoadedBlob>> loads(blobs.size());
+    // Declared after the futures so it drains before they go away.
+    ThreadPool pool(options.threads);
+    size_t window = pool.size() * window_per_thread;
+    size_t submitted = 0;
+    auto submit_until = [&](size_t limit) {
+        for (; submitted < std::min(limit, blobs.size()); ++submitted) {
+            auto promise = std::make_shared<std::promise<LoadedBlob>>();
+            loads[submitted] = promise->get_future();
+            std::string sha = entries[blobs[submitted]].sha;
+            pool.submit([&repo, promise, sha]() {
+                try {
+                    promise->set_value(load_blob(repo, sha));
+                }
+                catch (...) {
+                    promise->set_exception(std::current_exception());
+                }
+            });
+        }
+    };
+    submit_until(window);
+
+    ArchiveWriter writer(out, options.format == ArchiveFormat::TarGz);
+    TarStream tar(writer, options.mtime);
+    size_t next_blob = 0;
+    for (const auto &entry : entries) {
+        if (!entry.has_data()) {
+            tar.add(entry.path + "/", '5', 0755, 0);
+            continue;
+        }
+        LoadedBlob blob = loads[next_blob].get();
+        ++next_blob;
+        submit_until(next_blob + window);
+        if (entry.mode == "120000") {
+            if (blob.deferred) {
+                throw std::runtime_error("Symlink target too long: " + entry.path);
+            }
+            tar.add(entry.path, '2', 0777, 0, blob.data);
+            continue;
+        }
+        tar.add(entry.path, '0', entry.mode == "100755" ? 0755 : 0644, blob.header.size);
+        if (blob.deferred) {
+            stream_object(repo, entry.sha, nullptr, [&](const unsigned char *data, size_t len) {
+                writer.write(data, len);
+            });
+        }
+        else {
+            writer.write(blob.data.data(), blob.data.size());
+        }
+        writer.pad_block();
+    }
+    writer.finish();
+}
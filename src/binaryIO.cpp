@@ -0,0 +1,94 @@
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "binaryIO.h"
+
+namespace {
+
+int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+}
+
+uint64_t read_be(const unsigned char *p, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+void put_be(std::string &out, uint64_t value, int bytes) {
+    for (int i = bytes - 1; i >= 0; --i) {
+        out += static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+}
+
+std::string to_hex(const unsigned char *p, size_t n) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(2 * n, '0');
+    for (size_t i = 0; i < n; ++i) {
+        hex[2 * i] = digits[p[i] >> 4];
+        hex[2 * i + 1] = digits[p[i] & 15];
+    }
+    return hex;
+}
+
+std::string hex_to_bytes(const std::string &hex) {
+    if (hex.size() % 2 != 0) {
+        throw std::runtime_error("Invalid hex string: " + hex);
+    }
+    std::string out(hex.size() / 2, '\0');
+    for (size_t i = 0; i < out.size(); ++i) {
+        int high = hex_digit(hex[2 * i]);
+        int low = hex_digit(hex[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            throw std::runtime_error("Invalid hex string: " + hex);
+        }
+        out[i] = static_cast<char>((high << 4) | low);
+    }
+    return out;
+}
+
+MappedFile::MappedFile(const fs::path &path, size_t min_size, const std::string &what) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open " + what + ": " + path.string());
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(min_size)) {
+        ::close(fd);
+        throw std::runtime_error("Truncated " + what + ": " + path.string());
+    }
+    size = st.st_size;
+    if (size == 0) {
+        ::close(fd);
+        return;
+    }
+    void *map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error("Cannot map " + what + ": " + path.string());
+    }
+    data = static_cast<const unsigned char *>(map);
+}
+
+MappedFile::~MappedFile() {
+    if (data) {
+        ::munmap(const_cast<unsigned char *>(data), size);
+    }
+}
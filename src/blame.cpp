@@ -0,0 +1,397 @@
+#include <algorithm>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <tuple>
+
+#include "blame.h"
+#include "object.h"
+#include "gitBlob.h"
+#include "gitCommit.h"
+#include "gitTree.h"
+
+namespace {
+
+// Myers' O(ND) diff with the linear-space middle-snake refinement, over
+// lines mapped to integer ids.
+class MyersDiff {
+public:
+    MyersDiff(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b, std::vector<LineMatch> &out)
+        : a(a), b(b), out(out) {}
+
+    void solve(size_t left, size_t top, size_t right, size_t bottom) {
+        while (left < right && top < bottom && a[left] == b[top]) {
+            emit(left++, top++);
+        }
+        size_t suffix = 0;
+        while (left < right - suffix && top < bottom - suffix && a[right - suffix - 1] == b[bottom - suffix - 1]) {
+            ++suffix;
+        }
+        right -= suffix;
+        bottom -= suffix;
+        if (left < right && top < bottom) {
+            auto [x0, y0, x1, y1] = middle_snake(left, top, right, bottom);
+            solve(left, top, x0, y0);
+            // One edit and a diagonal; trimming above finds the diagonal.
+            solve(x0, y0, x1, y1);
+            solve(x1, y1, right, bottom);
+        }
+        for (size_t i = 0; i < suffix; ++i) {
+            emit(right + i, bottom + i);
+        }
+    }
+private:
+    void emit(size_t x, size_t y) {
+        if (!out.empty() && out.back().old_start + out.back().count == x &&
+            out.back().new_start + out.back().count == y) {
+            ++out.back().count;
+        }
+        else {
+            out.push_back({x, y, 1});
+        }
+    }
+
+    // The snake in the middle of a shortest edit path through the box,
+    // found by searching forward from the top left and backward from the
+    // bottom right until the two frontiers overlap.
+    std::tuple<size_t, size_t, size_t, size_t> middle_snake(size_t left, size_t top, size_t right, size_t bottom) {
+        const ptrdiff_t l = left, t = top, r = right, btm = bottom;
+        const ptrdiff_t delta = (r - l) - (btm - t);
+        const ptrdiff_t max = ((r - l) + (btm - t) + 1) / 2;
+        const ptrdiff_t off = max + 1;
+        forward.assign(2 * max + 3, 0);
+        backward.assign(2 * max + 3, 0);
+        forward[off + 1] = l;
+        backward[off + 1] = btm;
+        for (ptrdiff_t d = 0; d <= max; ++d) {
+            for (ptrdiff_t k = d; k >= -d; k -= 2) {
+                ptrdiff_t px, x;
+                if (k == -d || (k != d && forward[off + k - 1] < forward[off + k + 1])) {
+                    px = x = forward[off + k + 1];
+                }
+                else {
+                    px = forward[off + k - 1];
+                    x = px + 1;
+                }
+                ptrdiff_t y = t + (x - l) - k;
+                ptrdiff_t py = (d == 0 || x != px) ? y : y - 1;
+                while (x < r && y < btm && a[x] == b[y]) {
+                    ++x;
+                    ++y;
+                }
+                forward[off + k] = x;
+                ptrdiff_t c = k - delta;
+                if ((delta & 1) && c >= -(d - 1) && c <= d - 1 && y >= backward[off + c]) {
+                    return {px, py, x, y};
+                }
+            }
+            for (ptrdiff_t c = d; c >= -d; c -= 2) {
+                ptrdiff_t py, y;
+                if (c == -d || (c != d && backward[off + c - 1] > backward[off + c + 1])) {
+                    py = y = backward[off + c + 1];
+                }
+                else {
+                    py = backward[off + c - 1];
+                    y = py - 1;
+                }
+                ptrdiff_t k = c + delta;
+                ptrdiff_t x = l + (y - t) + k;
+                ptrdiff_t px = (d == 0 || y != py) ? x : x + 1;
+                while (x > l && y > t && a[x - 1] == b[y - 1]) {
+                    --x;
+                    --y;
+                }
+                backward[off + c] = y;
+                if (!(delta & 1) && k >= -d && k <= d && x <= forward[off + k]) {
+                    return {x, y, px, py};
+                }
+            }
+        }
+        throw std::logic_error("diff: no middle snake");
+    }
+
+    const std::vector<uint32_t> &a;
+    const std::vector<uint32_t> &b;
+    std::vector<LineMatch> &out;
+    std::vector<ptrdiff_t> forward;
+    std::vector<ptrdiff_t> backward;
+};
+
+// Lines of content without their newlines; a final line need not end in one.
+std::vector<std::string_view> split_lines(const std::string &content) {
+    std::vector<std::string_view> lines;
+    size_t start = 0;
+    while (start < content.size()) {
+        size_t end = content.find('\n', start);
+        if (end == std::string::npos) {
+            end = content.size();
+        }
+        lines.emplace_back(content.data() + start, end - start);
+        start = end + 1;
+    }
+    return lines;
+}
+
+// Finds the blob at one path in many commits' trees. Lookups are memoized
+// per subtree id at each depth, so a commit that left the path's
+// directories alone resolves from its parent's answer without reading them.
+class PathResolver {
+public:
+    PathResolver(const GitRepository &repo, const std::string &path)
+        : repo(repo), components(split_tree_path(path)), resolved(components.size()) {
+    }
+
+    std::optional<std::string> blob(const std::string &root) {
+        return lookup(root, 0);
+    }
+private:
+    std::optional<std::string> lookup(const std::string &tree, size_t depth) {
+        auto known = resolved[depth].find(tree);
+        if (known != resolved[depth].end()) {
+            return known->second;
+        }
+        std::optional<std::string> found;
+        for (const auto &entry : read_tree(repo, tree)->get_entries()) {
+            if (entry.path != components[depth]) {
+                continue;
+            }
+            if (depth + 1 == components.size()) {
+                if (entry.mode != "40000" && entry.mode != "160000") {
+                    found = entry.sha;
+                }
+            }
+            else if (entry.mode == "40000") {
+                found = lookup(entry.sha, depth + 1);
+            }
+            break;
+        }
+        resolved[depth].emplace(tree, found);
+        return found;
+    }
+
+    const GitRepository &repo;
+    std::vector<std::string> components;
+    std::vector<std::unordered_map<std::string, std::optional<std::string>>> resolved;
+};
+
+// Lines [orig_start, orig_start + count) of a suspect's blob, which are
+// lines [final_start, final_start + count) of the blamed file.
+struct Range {
+    size_t final_start;
+    size_t orig_start;
+    size_t count;
+};
+
+struct Suspect {
+    std::string blob;
+    std::vector<Range> ranges;
+};
+
+class BlameWalk {
+public:
+    BlameWalk(const GitRepository &repo, const std::string &path, BlameDiffCache &cache)
+        : repo(repo), resolver(repo, path), cache(cache) {}
+
+    BlameResult run(const std::string &tip, const std::string &path) {
+        BlameResult result;
+        auto blob = resolver.blob(commit_tree(*read_commit(repo, tip)));
+        if (!blob) {
+            throw std::runtime_error("No such path " + path + " in " + tip);
+        }
+        auto content = read_blob(repo, *blob);
+        for (auto line : split_lines(content->get_content())) {
+            result.lines.emplace_back(line);
+        }
+        if (!result.lines.empty()) {
+            give(tip, *blob, {0, 0, result.lines.size()});
+        }
+        while (!queue.empty()) {
+            std::string sha = std::get<2>(queue.top());
+            queue.pop();
+            auto it = pending.find(sha);
+            if (it == pending.end()) {
+                continue;
+            }
+            Suspect suspect = std::move(it->second);
+            pending.erase(it);
+            blame_suspect(sha, suspect, result);
+        }
+
+        auto &entries = result.entries;
+        std::sort(entries.begin(), entries.end(), [](const BlameEntry &x, const BlameEntry &y) {
+            return x.final_start < y.final_start;
+        });
+        std::vector<BlameEntry> merged;
+        for (auto &entry : entries) {
+            if (!merged.empty() && merged.back().commit == entry.commit &&
+                merged.back().final_start + merged.back().count == entry.final_start &&
+                merged.back().orig_start + merged.back().count == entry.orig_start) {
+                merged.back().count += entry.count;
+            }
+            else {
+                merged.push_back(std::move(entry));
+            }
+        }
+        entries = std::move(merged);
+        result.stats = stats;
+        return result;
+    }
+private:
+    // Hands r to commit, queueing it newest-first by committer date. A
+    // commit that was already processed (clock skew) is simply queued again
+    // with the new ranges.
+    void give(const std::string &commit, const std::string &blob, const Range &r) {
+        auto [it, inserted] = pending.try_emplace(commit);
+        if (inserted) {
+            it->second.blob = blob;
+            queue.emplace(committer_time(*read_commit(repo, commit)), --sequence, commit);
+        }
+        it->second.ranges.push_back(r);
+    }
+
+    std::shared_ptr<const BlameDiffCache::Matches> diff(const std::string &old_blob, const std::string &new_blob) {
+        if (auto cached = cache.get(old_blob, new_blob)) {
+            ++stats.cached_diffs;
+            return cached;
+        }
+        ++stats.diffs;
+        auto old_content = read_blob(repo, old_blob);
+        auto new_content = read_blob(repo, new_blob);
+        auto matches = std::make_shared<const BlameDiffCache::Matches>(
+            diff_lines(split_lines(old_content->get_content()), split_lines(new_content->get_content())));
+        cache.put(old_blob, new_blob, matches);
+        return matches;
+    }
+
+    void blame_suspect(const std::string &sha, Suspect &suspect, BlameResult &result) {
+        ++stats.commits;
+        auto commit = read_commit(repo, sha);
+        std::vector<std::string> parents = commit->get_value("parent");
+        std::vector<std::optional<std::string>> parent_blobs;
+        for (const auto &parent : parents) {
+            parent_blobs.push_back(resolver.blob(commit_tree(*read_commit(repo, parent))));
+        }
+
+        // Same blob in a parent: every line came from there, no diff needed.
+        for (size_t i = 0; i < parents.size(); ++i) {
+            if (parent_blobs[i] == suspect.blob) {
+                for (const auto &r : suspect.ranges) {
+                    give(parents[i], suspect.blob, r);
+                }
+                return;
+            }
+        }
+
+        std::vector<Range> remaining = std::move(suspect.ranges);
+        for (size_t i = 0; i < parents.size() && !remaining.empty(); ++i) {
+            if (!parent_blobs[i]) {
+                continue;
+            }
+            auto matches = diff(*parent_blobs[i], suspect.blob);
+            std::vector<Range> left;
+            for (const auto &r : remaining) {
+                size_t pos = r.orig_start;
+                size_t end = r.orig_start + r.count;
+                auto m = std::partition_point(matches->begin(), matches->end(), [&](const LineMatch &match) {
+                    return match.new_start + match.count <= pos;
+                });
+                while (pos < end) {
+                    if (m == matches->end() || m->new_start >= end) {
+                        left.push_back({r.final_start + (pos - r.orig_start), pos, end - pos});
+                        break;
+                    }
+                    if (m->new_start > pos) {
+                        left.push_back({r.final_start + (pos - r.orig_start), pos, m->new_start - pos});
+                        pos = m->new_start;
+                    }
+                    size_t stop = std::min(end, m->new_start + m->count);
+                    give(parents[i], *parent_blobs[i],
+                         {r.final_start + (pos - r.orig_start), m->old_start + (pos - m->new_start), stop - pos});
+                    pos = stop;
+                    ++m;
+                }
+            }
+            remaining = std::move(left);
+        }
+        for (const auto &r : remaining) {
+            result.entries.push_back({sha, r.final_start, r.orig_start, r.count, parents.empty()});
+        }
+    }
+
+    const GitRepository &repo;
+    PathResolver resolver;
+    BlameDiffCache &cache;
+    BlameStats stats;
+    std::unordered_map<std::string, Suspect> pending;
+    std::priority_queue<std::tuple<int64_t, int64_t, std::string>> queue;
+    int64_t sequence = 0;
+};
+
+}
+
+std::vector<LineMatch> diff_lines(const std::vector<std::string_view> &old_lines,
+                                  const std::vector<std::string_view> &new_lines) {
+    std::unordered_map<std::string_view, uint32_t> ids;
+    auto intern = [&](const std::vector<std::string_view> &lines) {
+        std::vector<uint32_t> out;
+        out.reserve(lines.size());
+        for (auto line : lines) {
+            out.push_back(ids.try_emplace(line, ids.size()).first->second);
+        }
+        return out;
+    };
+    std::vector<uint32_t> a = intern(old_lines);
+    std::vector<uint32_t> b = intern(new_lines);
+    std::vector<LineMatch> out;
+    MyersDiff(a, b, out).solve(0, 0, a.size(), b.size());
+    return out;
+}
+
+BlameDiffCache::BlameDiffCache(size_t capacity) : capacity(capacity) {}
+
+std::shared_ptr<const BlameDiffCache::Matches> BlameDiffCache::get(const std::string &old_blob,
+                                                                   const std::string &new_blob) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(old_blob + new_blob);
+    if (it == index.end()) {
+        return nullptr;
+    }
+    lru.splice(lru.begin(), lru, it->second);
+    return it->second->second;
+}
+
+void BlameDiffCache::put(const std::string &old_blob, const std::string &new_blob,
+                         std::shared_ptr<const Matches> matches) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string key = old_blob + new_blob;
+    if (index.count(key) || capacity == 0) {
+        return;
+    }
+    lru.emplace_front(key, std::move(matches));
+    index.emplace(std::move(key), lru.begin());
+    if (lru.size() > capacity) {
+        index.erase(lru.back().first);
+        lru.pop_back();
+    }
+}
+
+void BlameDiffCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    index.clear();
+    lru.clear();
+}
+
+size_t BlameDiffCache::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lru.size();
+}
+
+BlameDiffCache &BlameDiffCache::shared() {
+    static BlameDiffCache cache;
+    return cache;
+}
+
+BlameResult blame_file(const GitRepository &repo, const std::string &commit, const std::string &path,
+                       BlameDiffCache &cache) {
+    return BlameWalk(repo, path, cache).run(commit, path);
+}
@@ -0,0 +1,380 @@
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <optional>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "changedPaths.h"
+#include "binaryIO.h"
+#include "object.h"
+#include "gitCommit.h"
+#include "gitTree.h"
+#include "prefetch.h"
+#include "threadPool.h"
+#include "treeDiff.h"
+
+namespace {
+
+// File layout, integers big-endian:
+//   "CPBF", version, commit count N
+//   N x (20-byte id, u32 offset, u32 length)   sorted by id
+//   filter bytes
+//   SHA-1 of everything above
+constexpr char file_magic[4] = {'C', 'P', 'B', 'F'};
+constexpr uint32_t file_version = 1;
+constexpr size_t header_size = 12;
+constexpr size_t record_size = 28;
+constexpr uint32_t seed_one = 0x293ae76f;
+constexpr uint32_t seed_two = 0x7e646e2c;
+
+uint32_t murmur3(const std::string &key, uint32_t seed) {
+    const uint32_t c1 = 0xcc9e2d51;
+    const uint32_t c2 = 0x1b873593;
+    auto rotl = [](uint32_t x, int r) {
+        return (x << r) | (x >> (32 - r));
+    };
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(key.data());
+    size_t blocks = key.size() / 4;
+    uint32_t hash = seed;
+    for (size_t i = 0; i < blocks; ++i) {
+        uint32_t k = data[4 * i] | (data[4 * i + 1] << 8) | (data[4 * i + 2] << 16) | (uint32_t(data[4 * i + 3]) << 24);
+        k = rotl(k * c1, 15) * c2;
+        hash = rotl(hash ^ k, 13) * 5 + 0xe6546b64;
+    }
+    const unsigned char *tail = data + blocks * 4;
+    uint32_t k = 0;
+    switch (key.size() & 3) {
+    case 3:
+        k ^= tail[2] << 16;
+        [[fallthrough]];
+    case 2:
+        k ^= tail[1] << 8;
+        [[fallthrough]];
+    case 1:
+        k ^= tail[0];
+        hash ^= rotl(k * c1, 15) * c2;
+    }
+    hash ^= key.size();
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+std::shared_ptr<GitCommit> load_commit(ObjectPrefetcher &prefetcher, const std::string &sha) {
+    return object_as<GitCommit>(prefetcher.get(sha), sha);
+}
+
+// "mode sha" of the entry at path, or nullopt if there is none.
+std::optional<std::string> lookup_path(ObjectPrefetcher &prefetcher, std::string tree,
+                                       const std::vector<std::string> &components) {
+    for (size_t i = 0; i < components.size(); ++i) {
+        auto obj = object_as<GitTree>(prefetcher.get(tree), tree);
+        const auto &entries = obj->get_entries();
+        const GitTreeEntry *found = nullptr;
+        for (const auto &entry : entries) {
+            if (entry.path == components[i]) {
+                found = &entry;
+                break;
+            }
+        }
+        if (!found) {
+            return std::nullopt;
+        }
+        if (i + 1 == components.size()) {
+            return found->mode + " " + found->sha;
+        }
+        if (found->mode != "40000") {
+            return std::nullopt;
+        }
+        tree = found->sha;
+    }
+    return "40000 " + tree;
+}
+
+}
+
+std::string ChangedPathFilter::build(const std::vector<std::string> &paths) {
+    if (paths.empty()) {
+        return std::string(1, '\0');
+    }
+    if (paths.size() > max_changes) {
+        return std::string(1, '\xff');
+    }
+    std::string filter((paths.size() * bits_per_entry + 7) / 8, '\0');
+    uint64_t bits = filter.size() * 8;
+    for (const auto &path : paths) {
+        uint32_t one = murmur3(path, seed_one);
+        uint32_t two = murmur3(path, seed_two);
+        for (size_t i = 0; i < num_hashes; ++i) {
+            uint64_t bit = (one + i * uint64_t(two)) % bits;
+            filter[bit / 8] |= 1 << (bit % 8);
+        }
+    }
+    return filter;
+}
+
+std::vector<std::string> ChangedPathFilter::keys(const std::string &path) {
+    std::vector<std::string> keys{path};
+    for (size_t slash = path.rfind('/'); slash != std::string::npos && slash > 0; slash = path.rfind('/', slash - 1)) {
+        keys.push_back(path.substr(0, slash));
+    }
+    return keys;
+}
+
+bool ChangedPathFilter::maybe_contains(const unsigned char *filter, size_t len, const std::vector<std::string> &keys) {
+    if (len == 0) {
+        return true;
+    }
+    uint64_t bits = len * 8;
+    for (const auto &key : keys) {
+        uint32_t one = murmur3(key, seed_one);
+        uint32_t two = murmur3(key, seed_two);
+        for (size_t i = 0; i < num_hashes; ++i) {
+            uint64_t bit = (one + i * uint64_t(two)) % bits;
+            if (!(filter[bit / 8] & (1 << (bit % 8)))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+std::unique_ptr<ChangedPathIndex> ChangedPathIndex::open(const GitRepository &repo) {
+    fs::path path = changed_path_index_path(repo);
+    std::error_code ec;
+    if (!fs::exists(path, ec)) {
+        return nullptr;
+    }
+    std::unique_ptr<ChangedPathIndex> index(new ChangedPathIndex());
+    index->file = std::make_unique<MappedFile>(path, header_size + 20, "changed-path filter file");
+    const unsigned char *data = index->file->data;
+    if (std::memcmp(data, file_magic, 4) != 0 || read_be(data + 4, 4) != file_version) {
+        throw std::runtime_error("Invalid changed-path filter file: " + path.string());
+    }
+    index->commits = read_be(data + 8, 4);
+    if (header_size + index->commits * record_size + 20 > index->file->size) {
+        throw std::runtime_error("Truncated changed-path filter file: " + path.string());
+    }
+    return index;
+}
+
+ChangedPathIndex::~ChangedPathIndex() = default;
+
+ChangedPathIndex::Answer ChangedPathIndex::query(const std::string &commit, const std::vector<std::string> &keys) const {
+    std::string key = hex_to_bytes(commit);
+    const unsigned char *data = file->data;
+    size_t lo = 0;
+    size_t hi = commits;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const unsigned char *record = data + header_size + mid * record_size;
+        int cmp = std::memcmp(record, key.data(), 20);
+        if (cmp == 0) {
+            size_t offset = read_be(record + 20, 4);
+            size_t len = read_be(record + 24, 4);
+            if (offset + len > file->size - 20) {
+                throw std::runtime_error("Corrupt changed-path filter for " + commit);
+            }
+            return ChangedPathFilter::maybe_contains(data + offset, len, keys) ? Answer::Maybe : Answer::No;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return Answer::Unknown;
+}
+
+fs::path changed_path_index_path(const GitRepository &repo) {
+    return repo.get_gitdir() / "objects" / "info" / "changed-paths.bloom";
+}
+
+std::vector<std::string> changed_paths(const GitRepository &repo, const std::string &old_tree,
+                                       const std::string &new_tree) {
+    std::vector<std::string> out;
+    if (old_tree == new_tree) {
+        return out;
+    }
+    std::unordered_set<std::string> seen;
+    diff_trees(repo, old_tree, new_tree, [&](const TreeDiffEntry &change) {
+        for (auto &key : ChangedPathFilter::keys(change.path)) {
+            if (seen.insert(key).second) {
+                out.push_back(std::move(key));
+            }
+        }
+    });
+    return out;
+}
+
+ChangedPathWriteStats write_changed_path_index(const GitRepository &repo, const std::vector<std::string> &tips) {
+    // Every reachable commit with its tree and its first parent's tree.
+    struct Work {
+        std::string sha;
+        std::string tree;
+        std::string parent_tree;
+        std::string filter;
+        std::exception_ptr error;
+    };
+    std::vector<Work> work;
+    {
+        auto lease = repo.prefetchers().acquire();
+        ObjectPrefetcher &prefetcher = *lease;
+        std::unordered_map<std::string, std::string> trees;
+        std::vector<std::string> order;
+        std::vector<std::string> stack(tips.begin(), tips.end());
+        std::unordered_map<std::string, std::string> first_parent;
+        while (!stack.empty()) {
+            std::string sha = std::move(stack.back());
+            stack.pop_back();
+            if (trees.count(sha)) {
+                continue;
+            }
+            auto commit = load_commit(prefetcher, sha);
+            trees.emplace(sha, commit_tree(*commit));
+            order.push_back(sha);
+            auto parents = commit->get_value("parent");
+            if (!parents.empty()) {
+                first_parent.emplace(sha, parents.front());
+            }
+            prefetcher.prefetch(parents);
+            stack.insert(stack.end(), parents.begin(), parents.end());
+        }
+        for (const auto &sha : order) {
+            auto parent = first_parent.find(sha);
+            work.push_back({sha, trees.at(sha), parent == first_parent.end() ? "" : trees.at(parent->second), "", nullptr});
+        }
+    }
+
+    {
+        ThreadPool pool;
+        for (auto &item : work) {
+            pool.submit([&repo, &item]() {
+                try {
+                    item.filter = ChangedPathFilter::build(changed_paths(repo, item.parent_tree, item.tree));
+                }
+                catch (...) {
+                    item.error = std::current_exception();
+                }
+            });
+        }
+        pool.wait_idle();
+    }
+
+    ChangedPathWriteStats stats;
+    std::sort(work.begin(), work.end(), [](const Work &a, const Work &b) {
+        return a.sha < b.sha;
+    });
+    std::string out(file_magic, 4);
+    put_be(out, file_version, 4);
+    put_be(out, work.size(), 4);
+    size_t offset = header_size + work.size() * record_size;
+    for (const auto &item : work) {
+        if (item.error) {
+            std::rethrow_exception(item.error);
+        }
+        out += hex_to_bytes(item.sha);
+        put_be(out, offset, 4);
+        put_be(out, item.filter.size(), 4);
+        offset += item.filter.size();
+        if (item.filter == std::string(1, '\xff')) {
+            ++stats.too_large;
+        }
+    }
+    for (const auto &item : work) {
+        out += item.filter;
+    }
+    SHA1 hasher;
+    hasher.update(out);
+    out += hex_to_bytes(hasher.final());
+
+    fs::path path = changed_path_index_path(repo);
+    fs::create_directories(path.parent_path());
+    fs::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        file.write(out.data(), out.size());
+        if (!file) {
+            throw std::runtime_error("Failed to write " + tmp.string());
+        }
+    }
+    fs::rename(tmp, path);
+    stats.commits = work.size();
+    stats.bytes = out.size();
+    return stats;
+}
+
+PathLogStats log_path(const GitRepository &repo, const std::string &tip, const std::string &path,
+                      const PathLogOptions &options,
+                      const std::function<void(const std::string &sha, const std::string &message)> &visit) {
+    std::vector<std::string> components = split_tree_path(path);
+    std::string normalized = components.front();
+    for (size_t i = 1; i < components.size(); ++i) {
+        normalized += "/" + components[i];
+    }
+    std::vector<std::string> keys = ChangedPathFilter::keys(normalized);
+
+    std::unique_ptr<ChangedPathIndex> index;
+    if (options.use_filters) {
+        index = ChangedPathIndex::open(repo);
+    }
+    auto lease = repo.prefetchers().acquire();
+    ObjectPrefetcher &prefetcher = *lease;
+    PathLogStats stats;
+
+    // Newest committer date first; ties go to the commit queued first.
+    using Queued = std::tuple<int64_t, int64_t, std::string>;
+    std::priority_queue<Queued> queue;
+    std::unordered_set<std::string> queued;
+    int64_t sequence = 0;
+    auto enqueue = [&](const std::string &sha) {
+        if (queued.insert(sha).second) {
+            queue.emplace(committer_time(*load_commit(prefetcher, sha)), --sequence, sha);
+        }
+    };
+    enqueue(tip);
+    while (!queue.empty()) {
+        std::string sha = std::get<2>(queue.top());
+        queue.pop();
+        ++stats.commits;
+        auto commit = load_commit(prefetcher, sha);
+        auto parents = commit->get_value("parent");
+        prefetcher.prefetch(parents);
+
+        // Filters only describe the first-parent diff, so a merge always
+        // needs its trees compared.
+        bool changed = false;
+        if (parents.size() < 2 && index && index->query(sha, keys) == ChangedPathIndex::Answer::No) {
+            ++stats.filtered;
+        }
+        else {
+            ++stats.compared;
+            auto mine = lookup_path(prefetcher, commit_tree(*commit), components);
+            changed = parents.empty() && mine.has_value();
+            for (const auto &parent : parents) {
+                if (lookup_path(prefetcher, commit_tree(*load_commit(prefetcher, parent)), components) != mine) {
+                    changed = true;
+                    break;
+                }
+            }
+        }
+        if (changed) {
+            ++stats.shown;
+            if (visit) {
+                visit(sha, commit->get_message());
+            }
+        }
+        for (const auto &parent : parents) {
+            enqueue(parent);
+        }
+    }
+    return stats;
+}
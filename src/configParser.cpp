@@ -40,6 +40,16 @@ std::string ConfigParser::get(const std::string &section, const std::string &key
     throw std::runtime_error("Key not found");
     return "";
 }
+std::string ConfigParser::get(const std::string &section, const std::string &key, const std::string &fallback) const {
+    auto outer = configData.find(section);
+    if (outer != configData.end()) {
+        auto inner = outer->second.find(key);
+        if (inner != outer->second.end()) {
+            return inner->second;
+        }
+    }
+    return fallback;
+}
 std::string ConfigParser::repo_default_config() {
     configData["core"];
     configData["core"]["repositoryformatversion"] = "0";
@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <memory>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "dirSnapshot.h"
+#include "binaryIO.h"
+#include "object.h"
+#include "gitTree.h"
+#include "threadPool.h"
+
+namespace {
+
+std::string read_file(const fs::path &path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to read " + path.string());
+    }
+    struct stat st;
+    std::string data;
+    if (::fstat(fd, &st) == 0) {
+        data.resize(st.st_size);
+    }
+    size_t done = 0;
+    while (true) {
+        if (done == data.size()) {
+            // The file grew since fstat, or fstat failed.
+            data.resize(std::max<size_t>(4096, data.size() * 2));
+        }
+        ssize_t n = ::read(fd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to read " + path.string());
+        }
+        if (n == 0) {
+            break;
+        }
+        done += n;
+    }
+    ::close(fd);
+    data.resize(done);
+    return data;
+}
+
+// One directory being snapshotted. entries is sized by the scan before any
+// child task starts, so each child fills in its own slot; pending counts
+// the children still running.
+struct DirNode {
+    DirNode *parent = nullptr;
+    size_t slot = 0;
+    fs::path path;
+    std::vector<GitTreeEntry> entries;
+    std::vector<std::unique_ptr<DirNode>> children;
+    std::atomic<size_t> pending{0};
+};
+
+class Snapshot {
+public:
+    Snapshot(const GitRepository &repo, size_t threads) : repo(repo), pool(threads) {}
+
+    SnapshotStats run(const fs::path &dir) {
+        DirNode root;
+        root.path = dir;
+        pool.run([&]() { scan(root); });
+        SnapshotStats stats;
+        stats.tree = root_tree;
+        stats.files = files;
+        stats.trees = trees;
+        stats.written = written;
+        stats.bytes = bytes;
+        return stats;
+    }
+private:
+    void scan(DirNode &node) {
+        for (const auto &item : fs::directory_iterator(node.path)) {
+            std::string name = item.path().filename().string();
+            if (name == ".git") {
+                continue;
+            }
+            fs::file_status status = item.symlink_status();
+            if (fs::is_directory(status)) {
+                auto child = std::make_unique<DirNode>();
+                child->parent = &node;
+                child->slot = node.entries.size();
+                child->path = item.path();
+                node.children.push_back(std::move(child));
+                node.entries.push_back({"40000", name, ""});
+            }
+            else if (fs::is_symlink(status)) {
+                node.entries.push_back({"120000", name, ""});
+            }
+            else if (fs::is_regular_file(status)) {
+                bool executable = (status.permissions() & fs::perms::owner_exec) != fs::perms::none;
+                node.entries.push_back({executable ? "100755" : "100644", name, ""});
+            }
+        }
+        if (node.entries.empty()) {
+            finish(node);
+            return;
+        }
+        // The last child to finish sorts node.entries, so the tasks are
+        // all built before the first one can start.
+        std::vector<WorkStealingPool::Task> tasks;
+        for (auto &child : node.children) {
+            DirNode *dir = child.get();
+            tasks.push_back([this, dir]() { scan(*dir); });
+        }
+        for (size_t i = 0; i < node.entries.size(); ++i) {
+            if (node.entries[i].mode != "40000") {
+                tasks.push_back([this, &node, i]() { store_file(node, i); });
+            }
+        }
+        node.pending = tasks.size();
+        for (auto &task : tasks) {
+            pool.spawn(std::move(task));
+        }
+    }
+
+    void store_file(DirNode &node, size_t slot) {
+        GitTreeEntry &entry = node.entries[slot];
+        fs::path path = node.path / entry.path;
+        std::string content = entry.mode == "120000" ? fs::read_symlink(path).string() : read_file(path);
+        entry.sha = store("blob", content);
+        ++files;
+        bytes += content.size();
+        child_done(node);
+    }
+
+    void child_done(DirNode &node) {
+        if (node.pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            finish(node);
+        }
+    }
+
+    // Runs once every entry of node has its id. Subdirectories that turned
+    // out empty left theirs blank and are dropped.
+    void finish(DirNode &node) {
+        std::vector<GitTreeEntry> &entries = node.entries;
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                     [](const GitTreeEntry &entry) { return entry.sha.empty(); }),
+                      entries.end());
+        std::sort(entries.begin(), entries.end(), tree_entry_less);
+        if (node.parent && entries.empty()) {
+            child_done(*node.parent);
+            return;
+        }
+        std::string body;
+        for (const auto &entry : entries) {
+            body += entry.mode + " " + entry.path + std::string(1, '\0') + hex_to_bytes(entry.sha);
+        }
+        std::string sha = store("tree", body);
+        ++trees;
+        if (!node.parent) {
+            root_tree = sha;
+            return;
+        }
+        node.parent->entries[node.slot].sha = sha;
+        child_done(*node.parent);
+    }
+
+    std::string store(const std::string &type, const std::string &data) {
+        bool created = false;
+        std::string sha = write_raw_object(repo, type, data, &created);
+        if (created) {
+            ++written;
+        }
+        return sha;
+    }
+
+    const GitRepository &repo;
+    WorkStealingPool pool;
+    std::string root_tree;
+    std::atomic<size_t> files{0};
+    std::atomic<size_t> trees{0};
+    std::atomic<size_t> written{0};
+    std::atomic<size_t> bytes{0};
+};
+
+}
+
+SnapshotStats write_tree_from_dir(const GitRepository &repo, const fs::path &dir, const SnapshotOptions &options) {
+    if (!fs::is_directory(dir)) {
+        throw std::runtime_error("Not a directory: " + dir.string());
+    }
+    auto start = std::chrono::steady_clock::now();
+    SnapshotStats stats = Snapshot(repo, options.threads).run(dir);
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
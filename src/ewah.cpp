@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "ewah.h"
+#include "binaryIO.h"
+
+namespace {
+
+constexpr uint64_t max_run = (uint64_t(1) << 32) - 1;
+constexpr uint64_t max_literals = (uint64_t(1) << 31) - 1;
+
+bool is_clean(uint64_t word) {
+    return word == 0 || word == ~uint64_t(0);
+}
+
+}
+
+EwahBitmap EwahBitmap::compress(const std::vector<uint64_t> &plain, size_t bit_size) {
+    EwahBitmap bitmap;
+    bitmap.bits = bit_size;
+    size_t n = std::min(plain.size(), (bit_size + 63) / 64);
+    size_t i = 0;
+    while (i < n) {
+        size_t marker = bitmap.words.size();
+        bitmap.words.push_back(0);
+        uint64_t run_bit = 0;
+        uint64_t run = 0;
+        if (is_clean(plain[i])) {
+            uint64_t fill = plain[i];
+            run_bit = fill & 1;
+            while (i < n && plain[i] == fill && run < max_run) {
+                ++run;
+                ++i;
+            }
+        }
+        uint64_t literals = 0;
+        while (i < n && !is_clean(plain[i]) && literals < max_literals) {
+            bitmap.words.push_back(plain[i]);
+            ++literals;
+            ++i;
+        }
+        bitmap.words[marker] = run_bit | (run << 1) | (literals << 33);
+        bitmap.last_marker = marker;
+    }
+    return bitmap;
+}
+
+EwahBitmap EwahBitmap::deserialize(const unsigned char *data, size_t len, size_t &used) {
+    if (len < 8) {
+        throw std::runtime_error("Truncated EWAH bitmap");
+    }
+    EwahBitmap bitmap;
+    bitmap.bits = read_be(data, 4);
+    size_t count = read_be(data + 4, 4);
+    if (len < 8 + count * 8 + 4) {
+        throw std::runtime_error("Truncated EWAH bitmap");
+    }
+    bitmap.words.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        bitmap.words[i] = read_be(data + 8 + i * 8, 8);
+    }
+    bitmap.last_marker = read_be(data + 8 + count * 8, 4);
+    used = 8 + count * 8 + 4;
+    return bitmap;
+}
+
+void EwahBitmap::serialize(std::string &out) const {
+    put_be(out, bits, 4);
+    put_be(out, words.size(), 4);
+    for (uint64_t word : words) {
+        put_be(out, word, 8);
+    }
+    put_be(out, last_marker, 4);
+}
+
+void EwahBitmap::or_into(std::vector<uint64_t> &plain) const {
+    size_t pos = 0;
+    size_t i = 0;
+    size_t limit = plain.size();
+    while (i < words.size()) {
+        uint64_t marker = words[i++];
+        uint64_t run = (marker >> 1) & max_run;
+        uint64_t literals = marker >> 33;
+        if (marker & 1) {
+            for (uint64_t k = 0; k < run && pos + k < limit; ++k) {
+                plain[pos + k] = ~uint64_t(0);
+            }
+        }
+        pos += run;
+        for (uint64_t k = 0; k < literals && i < words.size(); ++k, ++i, ++pos) {
+            if (pos < limit) {
+                plain[pos] |= words[i];
+            }
+        }
+    }
+}
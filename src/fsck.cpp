@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "fsck.h"
+#include "object.h"
+#include "gitTree.h"
+#include "gitCommit.h"
+#include "threadPool.h"
+#include "refs.h"
+#include "pack.h"
+
+namespace {
+
+constexpr size_t chunk_size = 256;
+
+struct ObjectResult {
+    std::string sha;
+    std::string type;
+    std::string error;
+    std::vector<std::pair<std::string, std::string>> refs;
+};
+
+bool is_hex_sha(const std::string &s) {
+    return s.size() == 40 && std::all_of(s.begin(), s.end(), [](char c) {
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+    });
+}
+
+void check_object(const GitRepository &repo, ObjectResult &result) {
+    std::vector<unsigned char> raw = read_raw_object(repo, result.sha);
+    auto space_pos = std::find(raw.begin(), raw.end(), static_cast<unsigned char>(' '));
+    auto null_pos = std::find(raw.begin(), raw.end(), static_cast<unsigned char>('\0'));
+    if (space_pos == raw.end() || null_pos == raw.end() || null_pos < space_pos) {
+        throw std::runtime_error("malformed header");
+    }
+    result.type.assign(raw.begin(), space_pos);
+    std::string size_str(space_pos + 1, null_pos);
+    std::string payload(null_pos + 1, raw.end());
+    if (size_str.empty() || !std::all_of(size_str.begin(), size_str.end(), ::isdigit) || std::stoull(size_str) != payload.size()) {
+        throw std::runtime_error("size mismatch in header");
+    }
+
+    SHA1 hasher;
+    hasher.update(std::string(raw.begin(), raw.end()));
+    if (hasher.final() != result.sha) {
+        throw std::runtime_error("hash mismatch");
+    }
+
+    if (result.type == "tree") {
+        GitTree tree(repo);
+        tree.deserialize(std::move(payload));
+        for (const auto &entry : tree.get_entries()) {
+            if (entry.mode == "160000") {
+                continue;
+            }
+            result.refs.emplace_back(entry.mode == "40000" ? "tree" : "blob", entry.sha);
+        }
+    }
+    else if (result.type == "commit") {
+        GitCommit commit(repo);
+        commit.deserialize(std::move(payload));
+        auto trees = commit.get_value("tree");
+        if (trees.size() != 1 || !is_hex_sha(trees.front())) {
+            throw std::runtime_error("invalid tree line");
+        }
+        result.refs.emplace_back("tree", trees.front());
+        for (const auto &parent : commit.get_value("parent")) {
+            if (!is_hex_sha(parent)) {
+                throw std::runtime_error("invalid parent line");
+            }
+            result.refs.emplace_back("commit", parent);
+        }
+    }
+    else if (result.type == "tag") {
+        // Annotated tags share the commit header format.
+        GitCommit tag(repo);
+        tag.deserialize(std::move(payload));
+        auto objects = tag.get_value("object");
+        auto types = tag.get_value("type");
+        if (objects.size() != 1 || !is_hex_sha(objects.front()) || types.size() != 1) {
+            throw std::runtime_error("invalid tag header");
+        }
+        result.refs.emplace_back(types.front(), objects.front());
+    }
+    else if (result.type != "blob") {
+        throw std::runtime_error("unknown type '" + result.type + "'");
+    }
+}
+
+// HEAD and every ref under refs/, as (name, target) pairs.
+std::vector<std::pair<std::string, std::string>> ref_roots(const GitRepository &repo) {
+    std::vector<std::pair<std::string, std::string>> roots;
+    RefStore refs(repo);
+    if (auto head = refs.read("HEAD")) {
+        roots.emplace_back("HEAD", *head);
+    }
+    refs.for_each([&](const std::string &name, const std::string &sha) {
+        roots.emplace_back(name, sha);
+    });
+    return roots;
+}
+
+}
+
+FsckReport fsck_objects(const GitRepository &repo, const FsckOptions &options, std::ostream &out, std::ostream &err) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> ids = list_objects(repo);
+    std::vector<std::string> packed = repo.packs().list_ids();
+    ids.insert(ids.end(), packed.begin(), packed.end());
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    size_t chunks = (ids.size() + chunk_size - 1) / chunk_size;
+
+    std::mutex mutex;
+    std::condition_variable chunk_done;
+    size_t chunks_finished = 0;
+    size_t objects_finished = 0;
+    std::unordered_map<std::string, std::string> present;
+    std::unordered_map<std::string, std::string> referenced;
+    std::vector<std::pair<std::string, std::string>> errors;
+    present.reserve(ids.size());
+
+    {
+        ThreadPool pool(options.threads);
+        for (size_t c = 0; c < chunks; ++c) {
+            pool.submit([&, c]() {
+                std::vector<ObjectResult> results;
+                size_t end = std::min(ids.size(), (c + 1) * chunk_size);
+                for (size_t i = c * chunk_size; i < end; ++i) {
+                    ObjectResult result;
+                    result.sha = ids[i];
+                    try {
+                        check_object(repo, result);
+                    }
+                    catch (const std::exception &e) {
+                        result.error = e.what();
+                    }
+                    results.push_back(std::move(result));
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto &result : results) {
+                    present.emplace(result.sha, result.type);
+                    if (!result.error.empty()) {
+                        errors.emplace_back(result.sha, result.error);
+                    }
+                    for (auto &[type, sha] : result.refs) {
+                        referenced.emplace(std::move(sha), std::move(type));
+                    }
+                }
+                objects_finished += results.size();
+                ++chunks_finished;
+                chunk_done.notify_all();
+            });
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        auto next_report = std::chrono::steady_clock::now();
+        while (chunks_finished < chunks) {
+            chunk_done.wait_until(lock, next_report + std::chrono::milliseconds(250));
+            if (options.progress && std::chrono::steady_clock::now() >= next_report + std::chrono::milliseconds(250)) {
+                next_report = std::chrono::steady_clock::now();
+                err << "\rChecking objects: " << (ids.empty() ? 100 : objects_finished * 100 / ids.size())
+                    << "% (" << objects_finished << "/" << ids.size() << ")" << std::flush;
+            }
+        }
+    }
+    if (options.progress) {
+        err << "\rChecking objects: 100% (" << ids.size() << "/" << ids.size() << "), done." << std::endl;
+    }
+
+    FsckReport report;
+    report.objects = ids.size();
+    report.corrupt = errors.size();
+    std::sort(errors.begin(), errors.end());
+    for (const auto &[sha, message] : errors) {
+        out << "error in object " << sha << ": " << message << "\n";
+    }
+
+    std::vector<std::pair<std::string, std::string>> missing;
+    for (const auto &[sha, type] : referenced) {
+        if (!present.count(sha)) {
+            missing.emplace_back(sha, type);
+        }
+    }
+    std::sort(missing.begin(), missing.end());
+    for (const auto &[sha, type] : missing) {
+        out << "missing " << type << " " << sha << "\n";
+    }
+    report.missing = missing.size();
+
+    // A ref whose target is gone is the first sign of a lost object; each
+    // target is reported once, under the first name that points at it.
+    std::unordered_set<std::string> roots;
+    for (const auto &[name, sha] : ref_roots(repo)) {
+        if (!roots.insert(sha).second || present.count(sha) || referenced.count(sha)) {
+            continue;
+        }
+        out << "missing object " << sha << " from " << name << "\n";
+        ++report.missing;
+    }
+    for (const auto &sha : ids) {
+        if (!referenced.count(sha) && !roots.count(sha)) {
+            const std::string &type = present[sha];
+            out << "dangling " << (type.empty() ? "object" : type) << " " << sha << "\n";
+            ++report.dangling;
+        }
+    }
+
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return report;
+}
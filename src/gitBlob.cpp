@@ -5,6 +5,7 @@
 
 GitBlob::GitBlob(const GitRepository& repo, const std::string& data) : GitObject(repo, data) {
     this->fmt = "blob";
+    this->type = ObjectType::Blob;
     if (!data.empty()) {
         deserialize(data);
     }
@@ -14,11 +15,7 @@ std::string GitBlob::serialize() const {
     return content;
 }
 
-void GitBlob::deserialize(const std::string& data) {
-    auto pos = data.find('\0');
-    if (pos != std::string::npos) {
-        throw std::runtime_error("Invalid blob data: contains null byte");
-    }
-    this->content = data.substr(pos + 1);
+void GitBlob::deserialize(std::string data) {
+    this->content = std::move(data);
     this->size = content.size();
 }
@@ -1,8 +1,10 @@
 #include <algorithm>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
 #include "gitCommit.h"
+#include "trace.h"
 
 // KVLM: Key-Value List with Message
 std::vector<KVLMEntry> GitCommit::kvlm_parse(const std::string &input) {
@@ -73,7 +75,8 @@ std::string GitCommit::serialize() const {
     return serialize_kvlm(kvlm);
 }
 
-void GitCommit::deserialize(const std::string& data) {
+void GitCommit::deserialize(std::string data) {
+    TraceScope scope(TraceTimer::ParseCommit);
     this->kvlm = kvlm_parse(data);
     if (!this->kvlm.empty() && this->kvlm.back().key == "commit_msg") {
         this->message = this->kvlm.back().value;
@@ -92,4 +95,31 @@ std::vector<std::string> GitCommit::get_value(const std::string& key) const {
 
 std::string GitCommit::get_message() const {
     return this->message;
-}
\ No newline at end of file
+}
+
+std::string commit_tree(const GitCommit& commit) {
+    auto trees = commit.get_value("tree");
+    if (trees.empty()) {
+        throw std::runtime_error("Commit has no tree");
+    }
+    return trees.front();
+}
+
+int64_t committer_time(const GitCommit& commit) {
+    auto committer = commit.get_value("committer");
+    if (committer.empty()) {
+        return 0;
+    }
+    const std::string& line = committer.front();
+    size_t zone = line.rfind(' ');
+    size_t stamp = zone == std::string::npos ? std::string::npos : line.rfind(' ', zone - 1);
+    if (stamp == std::string::npos) {
+        return 0;
+    }
+    try {
+        return std::stoll(line.substr(stamp + 1, zone - stamp - 1));
+    }
+    catch (const std::exception&) {
+        return 0;
+    }
+}
@@ -3,70 +3,101 @@
 #include <sstream>
 #include <vector>   
 #include <array>
+#include <unordered_set>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "gitTree.h"
+#include "binaryIO.h"
 #include "gitBlob.h"
+#include "trace.h"
+#include "prefetch.h"
+#include "treeDiff.h"
+#include "refs.h"
 
-std::pair<size_t, GitTreeEntry> GitTree::parse_single_tree(const std::vector<unsigned char>& data, size_t pos) {
+std::pair<size_t, GitTreeEntry> GitTree::parse_single_tree(std::string_view data, size_t pos) {
     GitTreeEntry entry;
 
-    while (pos < data.size() && data[pos] != ' ') {
-        entry.mode.push_back(static_cast<char>(data[pos]));
-        ++pos;
-    }
-    if (pos == data.size()) {
+    size_t space = data.find(' ', pos);
+    if (space == std::string_view::npos) {
         throw std::runtime_error("Invalid tree format: no space found");
     }
-    ++pos;
+    entry.mode.assign(data.substr(pos, space - pos));
+    pos = space + 1;
 
-    while (pos < data.size() && data[pos] != '\0') {
-        entry.path.push_back(static_cast<char>(data[pos]));
-        ++pos;
-    }
-    if (pos == data.size()) {
+    size_t nul = data.find('\0', pos);
+    if (nul == std::string_view::npos) {
         throw std::runtime_error("Invalid tree format: no null terminator found");
     }
-    ++pos;
+    entry.path.assign(data.substr(pos, nul - pos));
+    pos = nul + 1;
 
     if (pos + 20 > data.size()) {
         throw std::runtime_error("Invalid tree format: not enough data for SHA");
     }
-    std::ostringstream hexsha;
-    for (int i = 0; i < 20; ++i)
-    {
-        hexsha << std::hex << std::setw(2) << std::setfill('0')
-               << static_cast<int>(data[pos + i]);
-    }
-    entry.sha = hexsha.str();
+    entry.sha = to_hex(reinterpret_cast<const unsigned char*>(data.data() + pos), 20);
     pos += 20;
 
-    return {pos, entry};
+    return {pos, std::move(entry)};
 }
 
-std::vector<GitTreeEntry> GitTree::parse_tree(const std::vector<unsigned char>& data) {
+std::vector<GitTreeEntry> GitTree::parse_tree(std::string_view data) {
     size_t pos = 0;
     std::vector<GitTreeEntry> entries;
     while (pos < data.size()) {
         auto [new_pos, tree_data] = parse_single_tree(data, pos);
-        entries.push_back(tree_data);
+        entries.push_back(std::move(tree_data));
         pos = new_pos;
     }
     return entries;
 }
 
+bool tree_entry_less(const GitTreeEntry& a, const GitTreeEntry& b) {
+    size_t common = std::min(a.path.size(), b.path.size());
+    int cmp = std::memcmp(a.path.data(), b.path.data(), common);
+    if (cmp != 0) {
+        return cmp < 0;
+    }
+    // The shorter name continues with '/' if it is a subtree.
+    auto next = [common](const GitTreeEntry& entry) -> unsigned char {
+        if (entry.path.size() > common) {
+            return entry.path[common];
+        }
+        return entry.mode == "40000" ? '/' : '\0';
+    };
+    return next(a) < next(b);
+}
+
+const char* tree_entry_type(const GitTreeEntry& entry) {
+    if (entry.mode == "40000") {
+        return "tree";
+    }
+    return entry.mode == "160000" ? "commit" : "blob";
+}
+
+std::vector<std::string> split_tree_path(const std::string& path) {
+    std::vector<std::string> components;
+    for (size_t start = 0; start < path.size();) {
+        size_t slash = path.find('/', start);
+        if (slash == std::string::npos) {
+            slash = path.size();
+        }
+        if (slash > start) {
+            components.push_back(path.substr(start, slash - start));
+        }
+        start = slash + 1;
+    }
+    if (components.empty()) {
+        throw std::runtime_error("Empty path");
+    }
+    return components;
+}
+
 std::vector<GitTreeEntry> GitTree::sort_tree_leaf(const std::vector<GitTreeEntry>& entries) const {
     std::vector<GitTreeEntry> sorted_entries = entries;
-    std::sort(sorted_entries.begin(), sorted_entries.end(),
-        [](const GitTreeEntry& a, const GitTreeEntry& b) {
-            auto key = [](const GitTreeEntry& entry) {
-                if (entry.mode.rfind("10", 0) == 0) {
-                    return entry.path;
-                } else {
-                    return entry.path + "/";
-                }
-            };
-            return key(a) < key(b);
-        });
+    std::sort(sorted_entries.begin(), sorted_entries.end(), tree_entry_less);
     return sorted_entries;
 }
 
@@ -86,71 +117,290 @@ std::string GitTree::serialize() const {
     return serialize_tree(sort_tree_leaf(this->entries));
 }
 
-void GitTree::deserialize(const std::string& data) {
-    this->content = data;
-    this->size = data.size();
-    this->entries = parse_tree(std::vector<unsigned char>(data.begin(), data.end()));
+void GitTree::deserialize(std::string data) {
+    TraceScope scope(TraceTimer::ParseTree);
+    this->content = std::move(data);
+    this->size = content.size();
+    this->entries = parse_tree(content);
 }
 
-void GitTree::recursive_ls_tree(const GitRepository& repo, const std::string& tree_sha, const std::string& prefix) {
-    auto obj = read_object(repo, tree_sha);
-    if (obj->get_type() != "tree") {
-        throw std::runtime_error("Object is not a tree: " + tree_sha);
+// Queue every child of a tree before visiting any of them, so the
+// prefetcher reads ahead while the walk handles the current entry.
+static void prefetch_children(ObjectPrefetcher& prefetcher, const std::vector<GitTreeEntry>& entries, bool trees_only = false) {
+    std::vector<std::string> children;
+    children.reserve(entries.size());
+    for (const auto& entry : entries) {
+        if (!trees_only || entry.mode == "40000") {
+            children.push_back(entry.sha);
+        }
+    }
+    prefetcher.prefetch(children);
+}
+
+static std::string join_path(const std::string& dir, const std::string& name) {
+    return dir.empty() ? name : dir + "/" + name;
+}
+
+// Entries of a tree the pathspec can reach. Subtrees that cannot contain a
+// match are dropped here, so they are never read or prefetched.
+std::vector<GitTreeEntry> select_entries(const std::vector<GitTreeEntry>& entries, const std::string& dir, const Pathspec& pathspec) {
+    if (pathspec.empty()) {
+        return entries;
+    }
+    std::vector<GitTreeEntry> selected;
+    for (const auto& entry : entries) {
+        std::string path = join_path(dir, entry.path);
+        if (entry.mode == "40000" ? pathspec.may_match_under(path) : pathspec.matches(path)) {
+            selected.push_back(entry);
+        }
     }
-    auto tree = std::dynamic_pointer_cast<GitTree>(obj);
-    auto entries = tree->get_entries();
+    return selected;
+}
+
+static void ls_tree_walk(ObjectPrefetcher& prefetcher, const GitTree& tree, const std::string& dir, const std::string& prefix,
+                         const Pathspec& pathspec, std::ostream& out) {
+    auto entries = select_entries(tree.get_entries(), dir, pathspec);
+    // The mode gives each entry's type, so only subtrees are ever read.
+    prefetch_children(prefetcher, entries, true);
     for (const auto& entry : entries) {
-        auto entry_obj = read_object(repo, entry.sha);
-        std::string full_path = prefix.empty() ? entry.path : prefix + "/" + entry.path;
-        std::cout << entry.mode << " " << entry_obj->get_type() << " " << entry.sha << "\t" << full_path << std::endl;
+        std::string full_path = join_path(prefix, entry.path);
+        out << entry.mode << " " << tree_entry_type(entry) << " " << entry.sha << "\t" << full_path << std::endl;
         if (entry.mode == "40000") {
-            tree->recursive_ls_tree(repo, entry.sha, full_path);
+            ls_tree_walk(prefetcher, *object_as<GitTree>(prefetcher.get(entry.sha), entry.sha), join_path(dir, entry.path), full_path, pathspec, out);
         }
     }
 }
 
-std::vector<GitTreeEntry> GitTree::get_entries() const {
+void GitTree::recursive_ls_tree(const GitRepository& repo, const std::string& tree_sha, const std::string& prefix, std::ostream& out,
+                                const Pathspec& pathspec) {
+    auto tree = read_tree(repo, tree_sha);
+    auto lease = repo.prefetchers().acquire();
+    ObjectPrefetcher &prefetcher = *lease;
+    ls_tree_walk(prefetcher, *tree, "", prefix, pathspec, out);
+}
+
+const std::vector<GitTreeEntry>& GitTree::get_entries() const {
     return this->entries;
 }
 
 std::string branch_sha(const GitRepository &repo, const std::string &branch) {
-    fs::path head_path = repo.get_gitdir() / "refs" / "heads" / branch;
-    if (!fs::exists(head_path)) {
+    auto sha = RefStore(repo).read("refs/heads/" + branch);
+    if (!sha) {
         throw std::runtime_error("Branch not found: " + branch);
     }
-    std::ifstream head_file(head_path);
-    std::string sha;
-    std::getline(head_file, sha);
-    return sha;
+    return *sha;
 }
 
-void tree_checkout(const GitRepository &repo, const std::string &tree_sha, const fs::path &target_path) {
-    auto obj = read_object(repo, tree_sha);
-    if (!obj) {
-        throw std::runtime_error("Object not found.");
+static void apply_mode(const fs::path &path, const std::string &mode) {
+    constexpr auto exec = fs::perms::owner_exec | fs::perms::group_exec | fs::perms::others_exec;
+    fs::permissions(path, exec, mode == "100755" ? fs::perm_options::add : fs::perm_options::remove);
+}
+
+// Files at least this large get their blocks reserved up front, which
+// avoids fragmentation when writing large assets chunk by chunk.
+static constexpr size_t preallocate_threshold = 1 << 20;
+
+// Inflates a blob straight into the destination file in fixed-size chunks;
+// the blob is never held in memory as a whole. Whatever sits at the path and
+// is not a regular file is replaced rather than written through, so a
+// symlink there never redirects the write to its target.
+static void checkout_blob(const GitRepository &repo, const std::string &sha, const fs::path &path, const std::string &mode) {
+    TraceScope scope(TraceTimer::CheckoutWrite);
+    std::error_code ec;
+    fs::file_status status = fs::symlink_status(path, ec);
+    if (fs::exists(status) && !fs::is_regular_file(status)) {
+        // A non-empty directory stays, and the open below reports it.
+        fs::remove(path, ec);
     }
-    if (obj->get_type() != "tree") {
-        throw std::runtime_error("Object is not a tree: " + tree_sha);
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW, 0666);
+    if (fd < 0) {
+        if (errno == ELOOP) {
+            throw std::runtime_error("Refusing to write through symlink " + path.string());
+        }
+        throw std::runtime_error("Failed to write " + path.string() + ": " + std::strerror(errno));
     }
-    auto tree = std::dynamic_pointer_cast<GitTree>(obj);
-    auto entries = tree->get_entries();
+    bool preallocate = repo.config.get("core", "checkoutpreallocate", "true") != "false";
+    size_t written = 0;
+    try {
+        stream_object(repo, sha, [&](const ObjectHeader &header) {
+            if (header.type != "blob") {
+                throw std::runtime_error("Unsupported object type: " + header.type);
+            }
+            if (preallocate && header.size >= preallocate_threshold) {
+                // Best effort: filesystems without fallocate just grow the file.
+                [[maybe_unused]] int rc = ::fallocate(fd, 0, 0, header.size);
+                Trace::count(TraceCounter::Syscalls);
+            }
+        }, [&](const unsigned char *data, size_t len) {
+            while (len > 0) {
+                ssize_t n = ::write(fd, data, len);
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw std::runtime_error("Failed to write " + path.string() + ": " + std::strerror(errno));
+                }
+                Trace::count(TraceCounter::Syscalls);
+                data += n;
+                len -= n;
+                written += n;
+            }
+        });
+    }
+    catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+    apply_mode(path, mode);
+    Trace::count(TraceCounter::Syscalls, 3);
+    Trace::count(TraceCounter::FilesCheckedOut);
+    Trace::count(TraceCounter::BytesWritten, written);
+}
+
+// With a pathspec, directories that are only partly selected are created
+// when their first file is written, so no empty directories are left behind.
+static void checkout_walk(ObjectPrefetcher &prefetcher, const GitTree &tree, const std::string &dir, const fs::path &target_path,
+                          const Pathspec &pathspec, bool dir_ready) {
+    auto entries = select_entries(tree.get_entries(), dir, pathspec);
+    // Only subtrees are read ahead; blobs are streamed to disk below.
+    prefetch_children(prefetcher, entries, true);
     for (const auto &entry : entries) {
-        auto entry_obj = read_object(repo, entry.sha);
-        if (!entry_obj) {
-            throw std::runtime_error("Object not found.");
-        }
         fs::path entry_path = target_path / entry.path;
-        if (entry_obj->get_type() == "tree") {
-            fs::create_directories(entry_path);
-            tree_checkout(repo, entry.sha, entry_path);
-        }
-        else if (entry_obj->get_type() == "blob") {
-            std::shared_ptr<GitBlob> blob_obj = std::dynamic_pointer_cast<GitBlob>(entry_obj);
-            std::ofstream ofs(entry_path, std::ios::binary);
-            ofs << blob_obj->serialize();
+        std::string rel_path = join_path(dir, entry.path);
+        if (entry.mode == "40000") {
+            auto subtree = object_as<GitTree>(prefetcher.get(entry.sha), entry.sha);
+            bool whole = pathspec.matches(rel_path);
+            if (whole) {
+                fs::create_directories(entry_path);
+            }
+            checkout_walk(prefetcher, *subtree, rel_path, entry_path, pathspec, whole);
         }
         else {
-            throw std::runtime_error("Unsupported object type: " + entry_obj->get_type());
+            if (!dir_ready) {
+                fs::create_directories(target_path);
+                dir_ready = true;
+            }
+            checkout_blob(prefetcher.repository(), entry.sha, entry_path, entry.mode);
+        }
+    }
+}
+
+void tree_checkout(const GitRepository &repo, const std::string &tree_sha, const fs::path &target_path, const Pathspec &pathspec) {
+    auto tree = read_tree(repo, tree_sha);
+    auto lease = repo.prefetchers().acquire();
+    ObjectPrefetcher &prefetcher = *lease;
+    checkout_walk(prefetcher, *tree, "", target_path, pathspec, true);
+}
+// A worktree file still holds `sha` if its size and blob hash agree.
+static bool file_matches_blob(const GitRepository &repo, const fs::path &path, const std::string &sha) {
+    std::error_code ec;
+    if (!fs::is_regular_file(fs::symlink_status(path, ec))) {
+        return false;
+    }
+    size_t size = read_object_header(repo, sha).size;
+    if (fs::file_size(path, ec) != size) {
+        return false;
+    }
+    std::ifstream ifs(path, std::ios::binary);
+    SHA1 hasher;
+    hasher.update("blob " + std::to_string(size) + std::string(1, '\0'));
+    hasher.update(ifs);
+    return hasher.final() == sha;
+}
+
+// "work", "work/" and "./work/." all name the same directory.
+static fs::path normalized_dir(const fs::path &path) {
+    fs::path normal = path.lexically_normal();
+    if (!normal.has_filename() && normal.has_relative_path()) {
+        normal = normal.parent_path();
+    }
+    return normal;
+}
+
+// Removes dir and its parents while they are empty, stopping at root.
+static void remove_empty_parents(const fs::path &start, const fs::path &root) {
+    fs::path stop = normalized_dir(root);
+    std::error_code ec;
+    for (fs::path dir = normalized_dir(start); dir != stop && dir.has_relative_path() && fs::is_empty(dir, ec) && !ec;
+         dir = dir.parent_path()) {
+        fs::remove(dir, ec);
+    }
+}
+
+CheckoutStats tree_checkout_update(const GitRepository &repo, const std::string &old_tree, const std::string &new_tree,
+                                   const fs::path &target_path, bool check_local, const Pathspec &pathspec) {
+    std::vector<TreeDiffEntry> changes;
+    diff_trees(repo, old_tree, new_tree, [&](const TreeDiffEntry &change) {
+        changes.push_back(change);
+    }, pathspec);
+
+    if (check_local) {
+        // Directories this diff empties: a file added in place of one of
+        // them finds the old directory still on disk, since the check runs
+        // before the deletions.
+        std::unordered_set<std::string> deleted_dirs;
+        for (const auto &change : changes) {
+            if (change.change == TreeChange::Deleted) {
+                for (size_t slash = change.path.find('/'); slash != std::string::npos;
+                     slash = change.path.find('/', slash + 1)) {
+                    deleted_dirs.insert(change.path.substr(0, slash));
+                }
+            }
+        }
+        std::vector<std::string> conflicts;
+        for (const auto &change : changes) {
+            fs::path path = target_path / change.path;
+            std::error_code ec;
+            fs::file_status status = fs::symlink_status(path, ec);
+            bool present = fs::exists(status);
+            if (change.change == TreeChange::Added) {
+                if (fs::is_directory(status) && deleted_dirs.count(change.path)) {
+                    continue;
+                }
+                // Never clobber an untracked file unless it already has the new content.
+                if (present && !file_matches_blob(repo, path, change.new_entry.sha)) {
+                    conflicts.push_back(change.path);
+                }
+            }
+            else if (present && !file_matches_blob(repo, path, change.old_entry.sha)) {
+                conflicts.push_back(change.path);
+            }
+        }
+        if (!conflicts.empty()) {
+            std::string message = "Local changes would be overwritten:";
+            for (const auto &path : conflicts) {
+                message += "\n  " + path;
+            }
+            throw std::runtime_error(message);
+        }
+    }
+
+    CheckoutStats stats;
+    // Deletions go first so a file can be replaced by a directory of the same name.
+    for (const auto &change : changes) {
+        if (change.change == TreeChange::Deleted) {
+            fs::path path = target_path / change.path;
+            std::error_code ec;
+            if (fs::remove(path, ec)) {
+                ++stats.deleted;
+            }
+            remove_empty_parents(path.parent_path(), target_path);
         }
     }
-}
\ No newline at end of file
+    for (const auto &change : changes) {
+        if (change.change == TreeChange::Deleted) {
+            continue;
+        }
+        fs::path path = target_path / change.path;
+        if (change.change == TreeChange::Modified && change.old_entry.sha == change.new_entry.sha && fs::exists(path)) {
+            apply_mode(path, change.new_entry.mode);
+            ++stats.chmodded;
+            continue;
+        }
+        fs::create_directories(path.parent_path());
+        checkout_blob(repo, change.new_entry.sha, path, change.new_entry.mode);
+        ++stats.written;
+    }
+    return stats;
+}
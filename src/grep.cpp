@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <future>
+#include <vector>
+
+#include "grep.h"
+#include "object.h"
+#include "gitTree.h"
+#include "prefetch.h"
+#include "threadPool.h"
+
+namespace {
+
+// Same heuristic as git: a NUL in the first 8000 bytes means binary.
+constexpr size_t binary_probe = 8000;
+constexpr size_t window_per_thread = 4;
+
+bool has_regex_meta(const std::string &pattern, GrepSyntax syntax) {
+    // In basic syntax + ? | ( ) { } are literals unless escaped.
+    const char *meta = syntax == GrepSyntax::Extended ? ".[]\\*^$+?|(){}" : ".[]\\*^$";
+    return pattern.find_first_of(meta) != std::string::npos;
+}
+
+struct FileEntry {
+    std::string path;
+    std::string sha;
+};
+
+void collect_files(ObjectPrefetcher &prefetcher, const std::string &tree_sha, const std::string &dir,
+                   const Pathspec &pathspec, std::vector<FileEntry> &out) {
+    auto tree = object_as<GitTree>(prefetcher.get(tree_sha), tree_sha);
+    auto entries = select_entries(tree->get_entries(), dir, pathspec);
+    std::vector<std::string> subtrees;
+    for (const auto &entry : entries) {
+        if (entry.mode == "40000") {
+            subtrees.push_back(entry.sha);
+        }
+    }
+    prefetcher.prefetch(subtrees);
+    for (const auto &entry : entries) {
+        std::string path = dir.empty() ? entry.path : dir + "/" + entry.path;
+        if (entry.mode == "40000") {
+            collect_files(prefetcher, entry.sha, path, pathspec, out);
+        }
+        else if (entry.mode == "100644" || entry.mode == "100755") {
+            out.push_back({path, entry.sha});
+        }
+    }
+}
+
+// Formats the matches of one blob so the writer only has to copy them out.
+std::string scan_blob(const GitRepository &repo, const FileEntry &file, const GrepMatcher &matcher,
+                      const GrepOptions &options) {
+    std::string data;
+    stream_object(repo, file.sha, [&](const ObjectHeader &header) {
+        data.reserve(header.size);
+    }, [&](const unsigned char *chunk, size_t len) {
+        data.append(reinterpret_cast<const char *>(chunk), len);
+    });
+    if (std::memchr(data.data(), '\0', std::min(data.size(), binary_probe))) {
+        return "";
+    }
+
+    std::string result;
+    std::string_view text(data);
+    size_t pos = 0;
+    size_t line_no = 1;
+    const char *counted = text.data();
+    while (pos < text.size()) {
+        std::string_view line = matcher.next_line(text, pos);
+        if (!line.data()) {
+            break;
+        }
+        if (options.files_only) {
+            return options.label + file.path + "\n";
+        }
+        result += options.label;
+        result += file.path;
+        result += ':';
+        if (options.line_numbers) {
+            line_no += std::count(counted, line.data(), '\n');
+            counted = line.data();
+            result += std::to_string(line_no);
+            result += ':';
+        }
+        result += line;
+        result += '\n';
+        pos = line.data() + line.size() - text.data() + 1;
+    }
+    return result;
+}
+
+}
+
+GrepMatcher::GrepMatcher(const std::string &pattern, GrepSyntax syntax, bool ignore_case)
+    : pattern(pattern), ignore_case(ignore_case), literal(syntax == GrepSyntax::Fixed || !has_regex_meta(pattern, syntax)) {
+    if (literal) {
+        if (ignore_case) {
+            std::transform(this->pattern.begin(), this->pattern.end(), this->pattern.begin(),
+                           [](unsigned char c) { return std::tolower(c); });
+        }
+        return;
+    }
+    auto flags = syntax == GrepSyntax::Extended ? std::regex::extended : std::regex::basic;
+    if (ignore_case) {
+        flags |= std::regex::icase;
+    }
+    try {
+        regex = std::make_unique<std::regex>(pattern, flags | std::regex::optimize);
+    }
+    catch (const std::regex_error &e) {
+        throw std::runtime_error("Invalid pattern '" + pattern + "': " + e.what());
+    }
+}
+
+const char *GrepMatcher::find_literal(const char *begin, const char *end) const {
+    size_t n = pattern.size();
+    if (n == 0) {
+        return begin;
+    }
+    if (!ignore_case) {
+        return static_cast<const char *>(memmem(begin, end - begin, pattern.data(), n));
+    }
+    // Jump between candidate first bytes of either case with memchr, then
+    // confirm the rest case-insensitively.
+    char lower = pattern[0];
+    char upper = static_cast<char>(std::toupper(static_cast<unsigned char>(lower)));
+    const char *p = begin;
+    while (end - p >= static_cast<ptrdiff_t>(n)) {
+        size_t avail = end - p - n + 1;
+        auto a = static_cast<const char *>(std::memchr(p, lower, avail));
+        auto b = lower == upper ? nullptr : static_cast<const char *>(std::memchr(p, upper, a ? a - p : avail));
+        const char *hit = b ? b : a;
+        if (!hit) {
+            return nullptr;
+        }
+        if (strncasecmp(hit + 1, pattern.data() + 1, n - 1) == 0) {
+            return hit;
+        }
+        p = hit + 1;
+    }
+    return nullptr;
+}
+
+std::string_view GrepMatcher::next_line(std::string_view text, size_t pos) const {
+    const char *begin = text.data();
+    const char *end = begin + text.size();
+    const char *p = begin + pos;
+    auto line_of = [&](const char *hit) {
+        const char *start = hit;
+        while (start > begin && start[-1] != '\n') {
+            --start;
+        }
+        auto stop = static_cast<const char *>(std::memchr(hit, '\n', end - hit));
+        return std::string_view(start, (stop ? stop : end) - start);
+    };
+    if (literal) {
+        const char *hit = find_literal(p, end);
+        return hit ? line_of(hit) : std::string_view();
+    }
+    while (p < end) {
+        auto stop = static_cast<const char *>(std::memchr(p, '\n', end - p));
+        const char *line_end = stop ? stop : end;
+        if (std::regex_search(p, line_end, *regex)) {
+            return std::string_view(p, line_end - p);
+        }
+        p = line_end + 1;
+    }
+    return std::string_view();
+}
+
+size_t grep_tree(const GitRepository &repo, const std::string &tree_sha, const std::string &pattern,
+                 const GrepOptions &options, std::ostream &out) {
+    GrepMatcher matcher(pattern, options.syntax, options.ignore_case);
+    std::vector<FileEntry> files;
+    {
+        auto lease = repo.prefetchers().acquire();
+        ObjectPrefetcher &prefetcher = *lease;
+        collect_files(prefetcher, tree_sha, "", options.pathspec, files);
+    }
+
+    std::vector<std::future<std::string>> results(files.size());
+    // Declared after the futures so it drains before they go away.
+    ThreadPool pool(options.threads);
+    size_t window = pool.size() * window_per_thread;
+    size_t submitted = 0;
+    auto submit_until = [&](size_t limit) {
+        for (; submitted < std::min(limit, files.size()); ++submitted) {
+            auto promise = std::make_shared<std::promise<std::string>>();
+            results[submitted] = promise->get_future();
+            pool.submit([&, promise, i = submitted]() {
+                try {
+                    promise->set_value(scan_blob(repo, files[i], matcher, options));
+                }
+                catch (...) {
+                    promise->set_exception(std::current_exception());
+                }
+            });
+        }
+    };
+    submit_until(window);
+
+    size_t matched = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        std::string lines = results[i].get();
+        submit_until(i + 1 + window);
+        if (!lines.empty()) {
+            ++matched;
+            out.write(lines.data(), lines.size());
+        }
+    }
+    out.flush();
+    return matched;
+}
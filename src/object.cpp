@@ -5,6 +5,13 @@
 #include <zlib.h>
 #include <vector>
 #include <algorithm>
+#include <optional>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "repository.h"
 #include "sha1/sha1.hpp"
@@ -12,6 +19,8 @@
 #include "gitBlob.h"
 #include "gitCommit.h"
 #include "gitTree.h"
+#include "trace.h"
+#include "pack.h"
 
 namespace fs = std::filesystem;
 
@@ -25,7 +34,7 @@ std::string GitObject::serialize() const {
     throw std::runtime_error("Not implemented");
 }
 
-void GitObject::deserialize(const std::string& data) {
+void GitObject::deserialize(std::string data) {
     throw std::runtime_error("Not implemented");
 }
 
@@ -37,93 +46,585 @@ size_t GitObject::get_size() const {
     return size;
 }
 
-std::string GitObject::get_content() const {
+const std::string& GitObject::get_content() const {
     return content;
 }
 
-std::vector<unsigned char> compress_data(const std::vector<unsigned char>& data) {
-    uLongf compressed_size = compressBound(data.size());
-    std::vector<unsigned char> compressed_data(compressed_size);
-    if (compress(compressed_data.data(), &compressed_size, data.data(), data.size()) != Z_OK) {
-        throw std::runtime_error("Failed to compress data");
+ObjectType parse_object_type(const std::string& name) {
+    if (name == "blob") {
+        return ObjectType::Blob;
+    }
+    if (name == "tree") {
+        return ObjectType::Tree;
+    }
+    if (name == "commit") {
+        return ObjectType::Commit;
     }
-    compressed_data.resize(compressed_size);
-    return compressed_data;
+    if (name == "tag") {
+        return ObjectType::Tag;
+    }
+    throw std::runtime_error("Unknown object type: " + name);
 }
 
-std::vector<unsigned char> decompress_data(const std::vector<unsigned char>& compressed_data) {
-    uLongf buffer = 1000000000;
-    std::vector<unsigned char> decompressed_data(buffer);
-    if (uncompress(decompressed_data.data(), &buffer, compressed_data.data(), compressed_data.size()) != Z_OK) {
-        throw std::runtime_error("Failed to decompress data");
+const char* object_type_name(ObjectType type) {
+    switch (type) {
+    case ObjectType::Blob:
+        return "blob";
+    case ObjectType::Tree:
+        return "tree";
+    case ObjectType::Commit:
+        return "commit";
+    case ObjectType::Tag:
+        return "tag";
     }
-    decompressed_data.resize(buffer);
-    return decompressed_data;
+    return "unknown";
 }
 
-std::shared_ptr<GitObject> read_object(const GitRepository &repo, const std::string &sha) {
-    fs::path path = GitRepository::repo_file(repo, "objects/" + sha.substr(0, 2) + "/" + sha.substr(2));
-    std::ifstream file(path, std::ios::binary);
-    if (!file) {
-        throw std::runtime_error("Failed to open object file");
+// Compressed loose objects smaller than this are pread into a per-thread
+// buffer; larger ones are mapped rather than copied.
+static constexpr size_t loose_mmap_threshold = 64 * 1024;
+
+namespace {
+
+// The compressed bytes of one loose object file. A thread may hold only
+// one at a time, since small files share that thread's read buffer.
+class LooseObjectFile {
+public:
+    // Unless required, a missing file leaves found() false instead of
+    // throwing, so the caller can look in the packs.
+    LooseObjectFile(const GitRepository &repo, const std::string &sha, bool required = true) {
+        // Straight to open(2): a missing fan-out directory fails there too.
+        fs::path path = repo.get_gitdir() / "objects" / sha.substr(0, 2) / sha.substr(2);
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            if (!required && (errno == ENOENT || errno == ENOTDIR)) {
+                return;
+            }
+            throw std::runtime_error("Failed to open object file");
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            throw std::runtime_error("Empty object file");
+        }
+        length = st.st_size;
+        if (length >= loose_mmap_threshold) {
+            void *p = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                map = p;
+                bytes = static_cast<const unsigned char*>(p);
+            }
+        }
+        if (!bytes) {
+            thread_local std::vector<unsigned char> buffer;
+            if (buffer.size() < length) {
+                buffer.resize(length);
+            }
+            size_t done = 0;
+            while (done < length) {
+                ssize_t n = ::pread(fd, buffer.data() + done, length - done, done);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    ::close(fd);
+                    throw std::runtime_error("Truncated object file: " + sha);
+                }
+                done += n;
+            }
+            bytes = buffer.data();
+        }
+        ::close(fd);
+        Trace::count(TraceCounter::Syscalls, 4);
+        Trace::count(TraceCounter::ObjectsRead);
+        Trace::count(TraceCounter::BytesRead, length);
     }
-    
-    std::vector<unsigned char> compressed_data;
-    char dataByte;
-    while (file.get(dataByte)) {
-        compressed_data.push_back(static_cast<unsigned char>(dataByte));
+    ~LooseObjectFile() {
+        if (map) {
+            ::munmap(map, length);
+        }
     }
-    file.close();
+    LooseObjectFile(const LooseObjectFile &) = delete;
+    LooseObjectFile &operator=(const LooseObjectFile &) = delete;
 
-    if (compressed_data.empty()) {
-        throw std::runtime_error("Empty object file");
+    bool found() const {
+        return bytes != nullptr;
+    }
+    const unsigned char *data() const {
+        return bytes;
     }
+    size_t size() const {
+        return length;
+    }
+private:
+    const unsigned char *bytes = nullptr;
+    size_t length = 0;
+    void *map = nullptr;
+};
+
+struct ZInflate {
+    z_stream stream{};
+    ZInflate() {
+        if (inflateInit(&stream) != Z_OK) {
+            throw std::runtime_error("Failed to decompress data");
+        }
+    }
+    ~ZInflate() {
+        inflateEnd(&stream);
+    }
+};
+
+// Inflates a loose object into out, sized once from its header, so the
+// payload is written exactly once. on_header runs before the payload is
+// inflated and may throw to reject the object. With keep_header, out also
+// starts with the "<type> <size>\0" header.
+template <typename Buffer, typename OnHeader>
+ObjectHeader inflate_loose(const unsigned char *data, size_t len, const std::string &sha, bool keep_header, Buffer &out,
+                           const OnHeader &on_header) {
+    TraceScope scope(TraceTimer::Inflate);
+    ZInflate z;
+    z.stream.next_in = const_cast<Bytef*>(data);
+    z.stream.avail_in = len;
 
-    std::vector<unsigned char> decompressed_data = decompress_data(compressed_data);
-    auto space_pos = std::find(decompressed_data.begin(), decompressed_data.end(), static_cast<unsigned char>(' '));
-    auto null_pos = std::find(decompressed_data.begin(), decompressed_data.end(), static_cast<unsigned char>('\0'));
-    if (space_pos == decompressed_data.end() || null_pos == decompressed_data.end()) {
+    // "commit 18446744073709551615\0" is the longest possible header.
+    unsigned char head[64];
+    z.stream.next_out = head;
+    z.stream.avail_out = sizeof(head);
+    int status = Z_OK;
+    const unsigned char *nul = nullptr;
+    while (!nul && status != Z_STREAM_END && z.stream.avail_out) {
+        status = inflate(&z.stream, Z_NO_FLUSH);
+        if (status != Z_OK && status != Z_STREAM_END) {
+            throw std::runtime_error("Failed to decompress data");
+        }
+        nul = static_cast<const unsigned char*>(std::memchr(head, '\0', sizeof(head) - z.stream.avail_out));
+    }
+    size_t produced = sizeof(head) - z.stream.avail_out;
+    const unsigned char *space = static_cast<const unsigned char*>(std::memchr(head, ' ', produced));
+    if (!nul || !space || space > nul) {
         throw std::runtime_error("Invalid object format: space or null not found");
     }
-    std::string original_size_str(reinterpret_cast<char*>(&*(space_pos+1)), std::distance(space_pos+1, null_pos));
-    std::string fmt(decompressed_data.begin(), space_pos);
-    std::vector<unsigned char> content(null_pos + 1, decompressed_data.end());
+    ObjectHeader header;
+    header.type.assign(reinterpret_cast<const char*>(head), space - head);
+    header.size = std::stoull(std::string(reinterpret_cast<const char*>(space + 1), nul - space - 1));
+    on_header(header);
+
+    size_t header_len = nul + 1 - head;
+    size_t spill = produced - header_len;
+    if (spill > header.size) {
+        throw std::runtime_error("Object size does not match header: " + sha);
+    }
+    size_t offset = keep_header ? header_len : 0;
+    out.resize(offset + header.size);
+    auto *dest = reinterpret_cast<unsigned char*>(out.data());
+    if (keep_header) {
+        std::memcpy(dest, head, header_len);
+    }
+    std::memcpy(dest + offset, nul + 1, spill);
+    z.stream.next_out = dest + offset + spill;
+    z.stream.avail_out = header.size - spill;
+    while (status != Z_STREAM_END) {
+        if (z.stream.avail_out == 0) {
+            // The payload is full; the stream must end without more output.
+            unsigned char extra;
+            z.stream.next_out = &extra;
+            z.stream.avail_out = 1;
+            status = inflate(&z.stream, Z_NO_FLUSH);
+            if (status != Z_STREAM_END || z.stream.avail_out == 0) {
+                throw std::runtime_error("Object size does not match header: " + sha);
+            }
+            z.stream.avail_out = 0;
+            break;
+        }
+        status = inflate(&z.stream, Z_NO_FLUSH);
+        if (status != Z_OK && status != Z_STREAM_END) {
+            throw std::runtime_error("Failed to decompress data");
+        }
+    }
+    if (z.stream.avail_out != 0) {
+        throw std::runtime_error("Object size does not match header: " + sha);
+    }
+    Trace::count(TraceCounter::BytesInflated, header_len + header.size);
+    return header;
+}
+
+}
+
+// A packed object, after a rescan of objects/pack if the first lookup
+// misses; throws like a missing loose object when there is none.
+static PackedObject read_packed(const GitRepository &repo, const std::string &sha) {
+    auto packed = repo.packs().read(repo, sha);
+    if (!packed && repo.packs().refresh()) {
+        packed = repo.packs().read(repo, sha);
+    }
+    if (!packed) {
+        throw std::runtime_error("Failed to open object file");
+    }
+    return std::move(*packed);
+}
+
+std::vector<unsigned char> read_raw_object(const GitRepository &repo, const std::string &sha) {
+    LooseObjectFile file(repo, sha, false);
+    std::vector<unsigned char> raw;
+    if (!file.found()) {
+        PackedObject packed = read_packed(repo, sha);
+        std::string header = std::string(object_type_name(packed.type)) + " " + std::to_string(packed.data.size());
+        raw.reserve(header.size() + 1 + packed.data.size());
+        raw.assign(header.begin(), header.end());
+        raw.push_back('\0');
+        raw.insert(raw.end(), packed.data.begin(), packed.data.end());
+        return raw;
+    }
+    inflate_loose(file.data(), file.size(), sha, true, raw, [](const ObjectHeader &) {});
+    return raw;
+}
+
+std::vector<unsigned char> inflate_loose_object(const std::string &sha, const std::string &compressed) {
+    std::vector<unsigned char> raw;
+    inflate_loose(reinterpret_cast<const unsigned char*>(compressed.data()), compressed.size(), sha, true, raw,
+                  [](const ObjectHeader &) {});
+    return raw;
+}
+
+static void check_type(const std::string &sha, ObjectType actual, std::optional<ObjectType> expected) {
+    if (expected && actual != *expected) {
+        throw std::runtime_error("Object " + sha + " is " + object_type_name(actual) + ", not a " +
+                                 object_type_name(*expected));
+    }
+}
+
+static std::shared_ptr<GitObject> make_object(const GitRepository &repo, ObjectType type) {
     std::shared_ptr<GitObject> obj;
-    if (fmt == "blob") {
+    switch (type) {
+    case ObjectType::Blob:
         obj = std::make_shared<GitBlob>(repo);
-    }
-    else if (fmt == "commit") {
+        break;
+    case ObjectType::Tree:
+        obj = std::make_shared<GitTree>(repo);
+        break;
+    case ObjectType::Commit:
         obj = std::make_shared<GitCommit>(repo);
+        break;
+    default:
+        throw std::runtime_error(std::string("Unknown object type: ") + object_type_name(type));
     }
-    else if (fmt == "tree") {
-        obj = std::make_shared<GitTree>(repo);
+    return obj;
+}
+
+static std::shared_ptr<GitObject> build_object(const GitRepository &repo, const std::string &sha,
+                                               const unsigned char *data, size_t len,
+                                               std::optional<ObjectType> expected) {
+    ObjectType type = ObjectType::Blob;
+    std::string payload;
+    inflate_loose(data, len, sha, false, payload, [&](const ObjectHeader &header) {
+        type = parse_object_type(header.type);
+        check_type(sha, type, expected);
+    });
+    auto obj = make_object(repo, type);
+    obj->deserialize(std::move(payload));
+    repo.object_cache().put(sha, obj);
+    return obj;
+}
+
+static std::shared_ptr<GitObject> build_packed(const GitRepository &repo, const std::string &sha,
+                                               std::optional<ObjectType> expected) {
+    PackedObject packed = read_packed(repo, sha);
+    check_type(sha, packed.type, expected);
+    auto obj = make_object(repo, packed.type);
+    obj->deserialize(std::move(packed.data));
+    repo.object_cache().put(sha, obj);
+    return obj;
+}
+
+// Shared by read_object and the typed readers; with expected set, the type
+// is checked straight after the header is parsed.
+static std::shared_ptr<GitObject> load_object(const GitRepository &repo, const std::string &sha,
+                                              std::optional<ObjectType> expected) {
+    TraceScope scope(TraceTimer::ReadObject);
+    if (auto cached = repo.object_cache().get(sha)) {
+        check_type(sha, cached->get_object_type(), expected);
+        return cached;
     }
-    else {
-        throw std::runtime_error("Unknown object type: " + fmt);
+    LooseObjectFile file(repo, sha, false);
+    if (!file.found()) {
+        return build_packed(repo, sha, expected);
     }
-    obj->deserialize(std::string(content.begin(), content.end()));
-    return obj;
-};
+    return build_object(repo, sha, file.data(), file.size(), expected);
+}
+
+std::shared_ptr<GitObject> parse_loose_object(const GitRepository &repo, const std::string &sha,
+                                              const std::string &compressed) {
+    TraceScope scope(TraceTimer::ReadObject);
+    return build_object(repo, sha, reinterpret_cast<const unsigned char*>(compressed.data()), compressed.size(),
+                        std::nullopt);
+}
+
+std::shared_ptr<GitObject> read_object(const GitRepository &repo, const std::string &sha) {
+    return load_object(repo, sha, std::nullopt);
+}
+
+std::shared_ptr<GitBlob> read_blob(const GitRepository &repo, const std::string &sha) {
+    return std::static_pointer_cast<GitBlob>(load_object(repo, sha, ObjectType::Blob));
+}
+
+std::shared_ptr<GitTree> read_tree(const GitRepository &repo, const std::string &sha) {
+    return std::static_pointer_cast<GitTree>(load_object(repo, sha, ObjectType::Tree));
+}
+
+std::shared_ptr<GitCommit> read_commit(const GitRepository &repo, const std::string &sha) {
+    return std::static_pointer_cast<GitCommit>(load_object(repo, sha, ObjectType::Commit));
+}
 
 std::string write_object(const GitRepository &repo, const GitObject &obj) {
-    std::string serialize_data = obj.serialize();
-    std::vector<unsigned char> data(serialize_data.begin(), serialize_data.end());
-    std::string header_str = obj.get_type() + " " + std::to_string(data.size()) + std::string(1, '\0') + std::string(data.begin(), data.end());
-    
-    SHA1 hasher;
-    hasher.update(header_str);
-    std::string sha = hasher.final();
-    std::vector<unsigned char> header(header_str.begin(), header_str.end());
-    std::vector<unsigned char> compressed_data = compress_data(header);
+    return write_raw_object(repo, obj.get_type(), obj.serialize());
+}
+
+// Deflates header and data as one stream without joining them first.
+static std::string deflate_object(const std::string &header, const std::string &data) {
+    TraceScope scope(TraceTimer::Deflate);
+    z_stream stream{};
+    if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        throw std::runtime_error("Failed to compress data");
+    }
+    std::string out(deflateBound(&stream, header.size() + data.size()), '\0');
+    stream.next_out = reinterpret_cast<Bytef*>(out.data());
+    stream.avail_out = out.size();
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(header.data()));
+    stream.avail_in = header.size();
+    int status = deflate(&stream, Z_NO_FLUSH);
+    if (status == Z_OK) {
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        stream.avail_in = data.size();
+        status = deflate(&stream, Z_FINISH);
+    }
+    size_t length = stream.total_out;
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END) {
+        throw std::runtime_error("Failed to compress data");
+    }
+    out.resize(length);
+    Trace::count(TraceCounter::BytesDeflated, header.size() + data.size());
+    return out;
+}
+
+// Writes to a temporary file in the same directory and renames it into
+// place, so readers and concurrent writers of the same id never see a
+// partial object.
+static void write_loose_file(const fs::path &path, const std::string &compressed) {
+    std::string tmp = (path.parent_path() / "tmp_obj_XXXXXX").string();
+    int fd = ::mkstemp(tmp.data());
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create object file in " + path.parent_path().string());
+    }
+    size_t done = 0;
+    while (done < compressed.size()) {
+        ssize_t n = ::write(fd, compressed.data() + done, compressed.size() - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ::close(fd);
+            ::unlink(tmp.c_str());
+            throw std::runtime_error("Failed to write object file " + path.string());
+        }
+        done += n;
+    }
+    // Loose objects are read-only, as git leaves them.
+    ::fchmod(fd, 0444);
+    ::close(fd);
+    if (::rename(tmp.c_str(), path.c_str()) != 0) {
+        ::unlink(tmp.c_str());
+        throw std::runtime_error("Failed to write object file " + path.string());
+    }
+    Trace::count(TraceCounter::Syscalls, 5);
+}
+
+std::string write_raw_object(const GitRepository &repo, const std::string &type, const std::string &data, bool *created) {
+    TraceScope scope(TraceTimer::WriteObject);
+    std::string header = type + " " + std::to_string(data.size()) + std::string(1, '\0');
+
+    std::string sha;
+    {
+        TraceScope sha_scope(TraceTimer::Sha1);
+        SHA1 hasher;
+        hasher.update(header);
+        hasher.update(data);
+        sha = hasher.final();
+    }
+    if (created) {
+        *created = false;
+    }
+    // An object already in the store is not compressed again.
     fs::path file = fs::path("objects") / sha.substr(0, 2) / sha.substr(2);
-    fs::path path = GitRepository::repo_file(repo, file, true);
-    if (!fs::exists(path)) {
-        std::ofstream file(path, std::ios::binary);
-        file.write(reinterpret_cast<const char*>(compressed_data.data()), compressed_data.size());
+    fs::path path = repo.get_gitdir() / file;
+    if (::access(path.c_str(), F_OK) == 0 || repo.packs().contains(sha)) {
+        return sha;
+    }
+    std::string compressed = deflate_object(header, data);
+    write_loose_file(GitRepository::repo_file(repo, file, true), compressed);
+    Trace::count(TraceCounter::ObjectsWritten);
+    Trace::count(TraceCounter::BytesWritten, compressed.size());
+    if (created) {
+        *created = true;
     }
     return sha;
 }
 
+// Inflate buffers for stream_object, reused by every object a thread reads.
+static constexpr size_t stream_chunk = 128 * 1024;
+
+namespace {
+
+struct InflateStream {
+    z_stream stream{};
+    int fd = -1;
+    InflateStream() {
+        if (inflateInit(&stream) != Z_OK) {
+            throw std::runtime_error("Failed to decompress data");
+        }
+    }
+    ~InflateStream() {
+        inflateEnd(&stream);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+};
+
+}
+
+// A header read parses only pack entry headers. Non-delta entries stream in
+// fixed-size chunks; deltas are resolved in memory and sent as one chunk.
+static ObjectHeader inflate_packed(const GitRepository &repo, const std::string &sha, bool header_only,
+                                   const std::function<void(const ObjectHeader&)> &on_header,
+                                   const std::function<void(const unsigned char*, size_t)> &sink) {
+    auto attempt = [&]() {
+        return header_only ? repo.packs().read_header(repo, sha) : repo.packs().stream(repo, sha, on_header, sink);
+    };
+    auto header = attempt();
+    if (!header && repo.packs().refresh()) {
+        header = attempt();
+    }
+    if (!header) {
+        throw std::runtime_error("Failed to open object file");
+    }
+    return *header;
+}
+
+static ObjectHeader inflate_object(const GitRepository &repo, const std::string &sha, bool header_only,
+                                   const std::function<void(const ObjectHeader&)> &on_header,
+                                   const std::function<void(const unsigned char*, size_t)> &sink) {
+    thread_local std::vector<unsigned char> in_buf(stream_chunk);
+    thread_local std::vector<unsigned char> out_buf(stream_chunk);
+
+    fs::path path = repo.get_gitdir() / "objects" / sha.substr(0, 2) / sha.substr(2);
+    InflateStream z;
+    z.fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (z.fd < 0) {
+        return inflate_packed(repo, sha, header_only, on_header, sink);
+    }
+    Trace::count(TraceCounter::ObjectsRead);
+    Trace::count(TraceCounter::Syscalls, 2);
+
+    ObjectHeader header;
+    std::string header_bytes;
+    bool have_header = false;
+    size_t delivered = 0;
+    int status = Z_OK;
+    while (status != Z_STREAM_END) {
+        if (z.stream.avail_in == 0) {
+            ssize_t n = ::read(z.fd, in_buf.data(), in_buf.size());
+            Trace::count(TraceCounter::Syscalls);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                throw std::runtime_error("Truncated object file: " + sha);
+            }
+            Trace::count(TraceCounter::BytesRead, n);
+            z.stream.next_in = in_buf.data();
+            z.stream.avail_in = n;
+        }
+        z.stream.next_out = out_buf.data();
+        z.stream.avail_out = out_buf.size();
+        {
+            TraceScope scope(TraceTimer::Inflate);
+            status = inflate(&z.stream, Z_NO_FLUSH);
+        }
+        if (status != Z_OK && status != Z_STREAM_END) {
+            throw std::runtime_error("Failed to decompress data");
+        }
+        const unsigned char *p = out_buf.data();
+        size_t produced = out_buf.size() - z.stream.avail_out;
+        Trace::count(TraceCounter::BytesInflated, produced);
+        if (!have_header) {
+            auto nul = static_cast<const unsigned char*>(std::memchr(p, '\0', produced));
+            header_bytes.append(reinterpret_cast<const char*>(p), nul ? nul - p : produced);
+            if (!nul) {
+                if (header_bytes.size() > 64) {
+                    throw std::runtime_error("Invalid object format: space or null not found");
+                }
+                continue;
+            }
+            auto space = header_bytes.find(' ');
+            if (space == std::string::npos) {
+                throw std::runtime_error("Invalid object format: space or null not found");
+            }
+            header.type = header_bytes.substr(0, space);
+            header.size = std::stoull(header_bytes.substr(space + 1));
+            have_header = true;
+            if (header_only) {
+                return header;
+            }
+            if (on_header) {
+                on_header(header);
+            }
+            produced -= nul + 1 - p;
+            p = nul + 1;
+        }
+        if (produced) {
+            sink(p, produced);
+            delivered += produced;
+        }
+    }
+    if (!have_header || delivered != header.size) {
+        throw std::runtime_error("Object size does not match header: " + sha);
+    }
+    return header;
+}
+
+ObjectHeader stream_object(const GitRepository &repo, const std::string &sha,
+                           const std::function<void(const ObjectHeader&)> &on_header,
+                           const std::function<void(const unsigned char*, size_t)> &sink) {
+    return inflate_object(repo, sha, false, on_header, sink);
+}
+
+ObjectHeader read_object_header(const GitRepository &repo, const std::string &sha) {
+    return inflate_object(repo, sha, true, nullptr, nullptr);
+}
+
+std::vector<std::string> list_objects(const GitRepository &repo) {
+    std::vector<std::string> objects;
+    fs::path objects_dir = repo.get_gitdir() / "objects";
+    if (!fs::is_directory(objects_dir)) {
+        return objects;
+    }
+    for (const auto &dir : fs::directory_iterator(objects_dir)) {
+        std::string prefix = dir.path().filename().string();
+        if (!dir.is_directory() || prefix.size() != 2 || !std::isxdigit(prefix[0]) || !std::isxdigit(prefix[1])) {
+            continue;
+        }
+        for (const auto &entry : fs::directory_iterator(dir.path())) {
+            std::string rest = entry.path().filename().string();
+            if (rest.size() == 38 && std::all_of(rest.begin(), rest.end(), [](char c) { return std::isxdigit(c); })) {
+                objects.push_back(prefix + rest);
+            }
+        }
+    }
+    std::sort(objects.begin(), objects.end());
+    return objects;
+}
+
 std::string find_object(const GitRepository &repo, const std::string &sha) {
     if (sha.size() == 40) {
         return sha;
@@ -139,16 +640,20 @@ std::string find_object(const GitRepository &repo, const std::string &sha) {
                    matches.push_back(sha.substr(0, 2) + filename);
                 }
             }
-            if (matches.empty()) {
-                throw std::runtime_error("Object not found");
-            }
-            if(matches.size() > 1) {
-               throw std::runtime_error("Ambiguous object reference");
-            }
         }
-        else {
+        // Two packed matches are enough to call the prefix ambiguous.
+        repo.packs().find_prefix(sha, matches, matches.size() + 2);
+        if (matches.empty() && repo.packs().refresh()) {
+            repo.packs().find_prefix(sha, matches, 2);
+        }
+        std::sort(matches.begin(), matches.end());
+        matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+        if (matches.empty()) {
             throw std::runtime_error("Object not found");
         }
+        if(matches.size() > 1) {
+           throw std::runtime_error("Ambiguous object reference");
+        }
         return matches.front();
     }
 }
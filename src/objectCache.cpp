@@ -0,0 +1,60 @@
+#include <functional>
+
+#include "objectCache.h"
+#include "object.h"
+#include "trace.h"
+
+// Rough per-entry bookkeeping cost on top of the object payload.
+static size_t cost(const std::shared_ptr<GitObject> &obj) {
+    return obj->get_size() + 128;
+}
+
+ObjectCache::ObjectCache(size_t capacity_bytes) : capacity_bytes(capacity_bytes) {}
+
+ObjectCache::Shard &ObjectCache::shard_for(const std::string &sha) {
+    return shards[std::hash<std::string>{}(sha) % shard_count];
+}
+
+std::shared_ptr<GitObject> ObjectCache::get(const std::string &sha) {
+    Shard &shard = shard_for(sha);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(sha);
+    if (it == shard.index.end()) {
+        Trace::count(TraceCounter::CacheMisses);
+        return nullptr;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    Trace::count(TraceCounter::CacheHits);
+    return it->second->second;
+}
+
+void ObjectCache::put(const std::string &sha, const std::shared_ptr<GitObject> &obj) {
+    size_t limit = capacity_bytes / shard_count;
+    size_t obj_cost = cost(obj);
+    if (obj_cost > limit) {
+        return;
+    }
+    Shard &shard = shard_for(sha);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.index.count(sha)) {
+        return;
+    }
+    shard.lru.emplace_front(sha, obj);
+    shard.index[sha] = shard.lru.begin();
+    shard.bytes += obj_cost;
+    while (shard.bytes > limit) {
+        auto &victim = shard.lru.back();
+        shard.bytes -= cost(victim.second);
+        shard.index.erase(victim.first);
+        shard.lru.pop_back();
+    }
+}
+
+void ObjectCache::clear() {
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.lru.clear();
+        shard.index.clear();
+        shard.bytes = 0;
+    }
+}
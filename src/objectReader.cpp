@@ -0,0 +1,413 @@
+#include "objectReader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef GIT_CLI_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "threadPool.h"
+#include "trace.h"
+
+namespace {
+
+// First read size for io_uring; nearly every compressed loose object fits,
+// and the rest are finished with a plain pread.
+constexpr size_t ring_read_size = 64 * 1024;
+
+std::string object_path(const GitRepository &repo, const std::string &sha) {
+    return (repo.get_gitdir() / "objects" / sha.substr(0, 2) / sha.substr(2)).string();
+}
+
+// Reads from offset done to the end of the file into out.
+void pread_rest(int fd, const std::string &sha, std::string &out, size_t done) {
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        throw std::runtime_error("Failed to stat object file: " + sha);
+    }
+    out.resize(st.st_size);
+    while (done < out.size()) {
+        ssize_t n = ::pread(fd, out.data() + done, out.size() - done, done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            throw std::runtime_error("Truncated object file: " + sha);
+        }
+        done += n;
+    }
+}
+
+std::string read_file(const std::string &path, const std::string &sha) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open object file: " + sha);
+    }
+    std::string out;
+    try {
+        pread_rest(fd, sha, out, 0);
+    }
+    catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+    if (out.empty()) {
+        throw std::runtime_error("Empty object file: " + sha);
+    }
+    Trace::count(TraceCounter::Syscalls, 4);
+    Trace::count(TraceCounter::ObjectsRead);
+    Trace::count(TraceCounter::BytesRead, out.size());
+    return out;
+}
+
+// Shared by every reader using the Threads backend; blocking reads only,
+// so walks that run their own pools cannot deadlock on it.
+ThreadPool &io_pool() {
+    static ThreadPool pool(std::max<size_t>(ThreadPool::default_threads(), 8));
+    return pool;
+}
+
+} // namespace
+
+ObjectReadBackend parse_read_backend(const std::string &name) {
+    if (name == "sync") {
+        return ObjectReadBackend::Sync;
+    }
+    if (name == "threads") {
+        return ObjectReadBackend::Threads;
+    }
+    if (name == "io_uring") {
+        return ObjectReadBackend::IoUring;
+    }
+    throw std::runtime_error("Unknown object reader: " + name);
+}
+
+const char *read_backend_name(ObjectReadBackend backend) {
+    switch (backend) {
+        case ObjectReadBackend::Sync: return "sync";
+        case ObjectReadBackend::Threads: return "threads";
+        case ObjectReadBackend::IoUring: return "io_uring";
+    }
+    return "sync";
+}
+
+ObjectReadBackend configured_read_backend(const GitRepository &repo) {
+    std::string configured = repo.config.get("core", "objectreader", "");
+    return configured.empty() ? ObjectReadBackend::Sync : parse_read_backend(configured);
+}
+
+bool io_uring_available() {
+#ifdef GIT_CLI_HAVE_LIBURING
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef GIT_CLI_HAVE_LIBURING
+struct BatchObjectReader::Ring {
+    io_uring ring;
+    // Set when the kernel may still own buffers or fds a failed run() was
+    // given; the ring and those buffers must then never be released.
+    bool broken = false;
+
+    explicit Ring(unsigned entries) {
+        if (io_uring_queue_init(entries, &ring, 0) != 0) {
+            throw std::runtime_error("io_uring unavailable");
+        }
+    }
+    Ring(const Ring &) = delete;
+    Ring &operator=(const Ring &) = delete;
+    ~Ring() {
+        io_uring_queue_exit(&ring);
+    }
+
+    io_uring_sqe *next_sqe() {
+        io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+        if (!sqe) {
+            // Entries already queued would go out with the next submit.
+            broken = true;
+            throw std::runtime_error("io_uring submission queue full");
+        }
+        return sqe;
+    }
+
+    // Submits the count entries queued and reaps their completions, passing
+    // each one's user data and result to on_cqe. Even when something fails,
+    // every operation the kernel accepted is reaped before this returns or
+    // throws, so the caller may free the buffers; if that is impossible,
+    // broken is set instead.
+    template <typename OnCqe>
+    void run(size_t count, OnCqe on_cqe) {
+        std::exception_ptr error;
+        size_t submitted = 0;
+        while (submitted < count) {
+            int n = io_uring_submit(&ring);
+            Trace::count(TraceCounter::Syscalls);
+            if (n == -EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                error = std::make_exception_ptr(std::runtime_error("io_uring submit failed"));
+                broken = true;
+                break;
+            }
+            submitted += n;
+        }
+        for (size_t reaped = 0; reaped < submitted;) {
+            io_uring_cqe *cqe = nullptr;
+            int rc = io_uring_wait_cqe(&ring, &cqe);
+            if (rc == -EINTR) {
+                continue;
+            }
+            if (rc < 0) {
+                broken = true;
+                throw std::runtime_error("io_uring wait failed");
+            }
+            uintptr_t data = reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(cqe));
+            int res = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            ++reaped;
+            if (!error) {
+                try {
+                    on_cqe(data, res);
+                }
+                catch (...) {
+                    error = std::current_exception();
+                }
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+};
+#else
+struct BatchObjectReader::Ring {};
+#endif
+
+BatchObjectReader::BatchObjectReader(const GitRepository &repo, ObjectReadBackend backend, size_t depth)
+    : repo(repo), active(backend), depth(std::max<size_t>(depth, 1)) {
+    if (active != ObjectReadBackend::IoUring) {
+        return;
+    }
+#ifdef GIT_CLI_HAVE_LIBURING
+    try {
+        ring = std::make_unique<Ring>(this->depth);
+        return;
+    }
+    catch (const std::runtime_error &) {
+        // Kernels without io_uring, or with it disabled by sysctl.
+    }
+#endif
+    active = ObjectReadBackend::Threads;
+}
+
+BatchObjectReader::~BatchObjectReader() = default;
+
+void BatchObjectReader::read(const std::vector<std::string> &ids, const Completion &on_read) {
+    if (ids.empty()) {
+        return;
+    }
+    Trace::count(TraceCounter::ReadBatches);
+    switch (active) {
+        case ObjectReadBackend::Sync:
+            read_sync(ids, on_read);
+            break;
+        case ObjectReadBackend::Threads:
+            read_threads(ids, on_read);
+            break;
+        case ObjectReadBackend::IoUring:
+            read_ring(ids, on_read);
+            break;
+    }
+}
+
+void BatchObjectReader::read_sync(const std::vector<std::string> &ids, const Completion &on_read) {
+    for (size_t i = 0; i < ids.size(); ++i) {
+        std::string data;
+        std::exception_ptr error;
+        try {
+            data = read_file(object_path(repo, ids[i]), ids[i]);
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+        on_read(i, std::move(data), error);
+    }
+}
+
+void BatchObjectReader::read_threads(const std::vector<std::string> &ids, const Completion &on_read) {
+    struct Done {
+        size_t index;
+        std::string data;
+        std::exception_ptr error;
+    };
+    // Owned jointly with the tasks, so an on_read that throws can leave
+    // reads in flight behind it.
+    struct Queue {
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::deque<Done> done;
+    };
+    auto queue = std::make_shared<Queue>();
+    ThreadPool &pool = io_pool();
+    size_t next = 0;
+    auto submit = [&]() {
+        size_t index = next++;
+        pool.submit([queue, index, path = object_path(repo, ids[index]), sha = ids[index]]() {
+            Done result{index, {}, nullptr};
+            try {
+                result.data = read_file(path, sha);
+            }
+            catch (...) {
+                result.error = std::current_exception();
+            }
+            {
+                std::lock_guard<std::mutex> lock(queue->mutex);
+                queue->done.push_back(std::move(result));
+            }
+            queue->ready.notify_one();
+        });
+    };
+    while (next < ids.size() && next < depth) {
+        submit();
+    }
+    for (size_t delivered = 0; delivered < ids.size(); ++delivered) {
+        Done result;
+        {
+            std::unique_lock<std::mutex> lock(queue->mutex);
+            queue->ready.wait(lock, [&]() { return !queue->done.empty(); });
+            result = std::move(queue->done.front());
+            queue->done.pop_front();
+        }
+        if (next < ids.size()) {
+            submit();
+        }
+        on_read(result.index, std::move(result.data), result.error);
+    }
+}
+
+#ifdef GIT_CLI_HAVE_LIBURING
+void BatchObjectReader::read_ring(const std::vector<std::string> &ids, const Completion &on_read) {
+    struct Pending {
+        std::string path;
+        int fd = -1;
+        std::string data;
+        std::exception_ptr error;
+    };
+    std::vector<Pending> batch;
+    // Closes whatever is still open if a ring operation throws.
+    struct CloseOnError {
+        std::vector<Pending> &batch;
+        ~CloseOnError() {
+            for (auto &p : batch) {
+                if (p.fd >= 0) {
+                    ::close(p.fd);
+                }
+            }
+        }
+    } guard{batch};
+    try {
+        for (size_t start = 0; start < ids.size(); start += depth) {
+            size_t count = std::min(depth, ids.size() - start);
+            batch.assign(count, Pending{});
+
+            // Open the whole batch with one submission.
+            for (size_t i = 0; i < count; ++i) {
+                batch[i].path = object_path(repo, ids[start + i]);
+                io_uring_sqe *sqe = ring->next_sqe();
+                io_uring_prep_openat(sqe, AT_FDCWD, batch[i].path.c_str(), O_RDONLY | O_CLOEXEC, 0);
+                io_uring_sqe_set_data(sqe, reinterpret_cast<void *>(uintptr_t(i)));
+            }
+            ring->run(count, [&](uintptr_t i, int res) {
+                if (res < 0) {
+                    batch[i].error = std::make_exception_ptr(std::runtime_error("Failed to open object file: " + ids[start + i]));
+                }
+                else {
+                    batch[i].fd = res;
+                }
+            });
+
+            // Then read every file that opened.
+            size_t reads = 0;
+            for (size_t i = 0; i < count; ++i) {
+                if (batch[i].fd < 0) {
+                    continue;
+                }
+                batch[i].data.resize(ring_read_size);
+                io_uring_sqe *sqe = ring->next_sqe();
+                io_uring_prep_read(sqe, batch[i].fd, batch[i].data.data(), ring_read_size, 0);
+                io_uring_sqe_set_data(sqe, reinterpret_cast<void *>(uintptr_t(i)));
+                ++reads;
+            }
+            ring->run(reads, [&](uintptr_t i, int res) {
+                Pending &p = batch[i];
+                try {
+                    if (res < 0) {
+                        throw std::runtime_error("Failed to read object file: " + ids[start + i]);
+                    }
+                    if (res == 0) {
+                        throw std::runtime_error("Empty object file: " + ids[start + i]);
+                    }
+                    if (size_t(res) == ring_read_size) {
+                        pread_rest(p.fd, ids[start + i], p.data, ring_read_size);
+                    }
+                    else {
+                        p.data.resize(res);
+                    }
+                    Trace::count(TraceCounter::ObjectsRead);
+                    Trace::count(TraceCounter::BytesRead, p.data.size());
+                }
+                catch (...) {
+                    p.error = std::current_exception();
+                }
+            });
+
+            // Close before handing anything out, so a throwing on_read leaks nothing.
+            size_t closes = 0;
+            for (size_t i = 0; i < count; ++i) {
+                if (batch[i].fd >= 0) {
+                    io_uring_sqe *sqe = ring->next_sqe();
+                    io_uring_prep_close(sqe, batch[i].fd);
+                    io_uring_sqe_set_data(sqe, reinterpret_cast<void *>(uintptr_t(i)));
+                    ++closes;
+                }
+            }
+            ring->run(closes, [&](uintptr_t i, int) {
+                batch[i].fd = -1;
+            });
+            Trace::count(TraceCounter::Syscalls, 3);
+
+            for (size_t i = 0; i < count; ++i) {
+                on_read(start + i, std::move(batch[i].data), batch[i].error);
+            }
+        }
+    }
+    catch (...) {
+        if (ring->broken) {
+            // The kernel may still write into batch's buffers or use its
+            // fds. Keep them, and the ring, alive for good and stop using
+            // io_uring in this reader.
+            [[maybe_unused]] auto *kept = new std::vector<Pending>(std::move(batch));
+            [[maybe_unused]] Ring *kept_ring = ring.release();
+            active = ObjectReadBackend::Threads;
+        }
+        throw;
+    }
+}
+#else
+void BatchObjectReader::read_ring(const std::vector<std::string> &ids, const Completion &on_read) {
+    // Unreachable: the constructor switches to Threads without liburing.
+    read_threads(ids, on_read);
+}
+#endif
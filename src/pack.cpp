@@ -0,0 +1,1293 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <zlib.h>
+
+#include "pack.h"
+#include "binaryIO.h"
+#include "object.h"
+#include "threadPool.h"
+#include "trace.h"
+
+namespace {
+
+enum PackObjectType {
+    OBJ_COMMIT = 1,
+    OBJ_TREE = 2,
+    OBJ_BLOB = 3,
+    OBJ_TAG = 4,
+    OBJ_OFS_DELTA = 6,
+    OBJ_REF_DELTA = 7
+};
+
+constexpr size_t pack_header_size = 12;
+constexpr size_t checksum_size = 20;
+constexpr size_t scan_chunk = 64 * 1024;
+// Output buffer for streamed reads, the same size as the loose-object one.
+constexpr size_t stream_chunk = 128 * 1024;
+
+const char *type_name(int type) {
+    switch (type) {
+    case OBJ_COMMIT: return "commit";
+    case OBJ_TREE: return "tree";
+    case OBJ_BLOB: return "blob";
+    case OBJ_TAG: return "tag";
+    }
+    throw std::runtime_error("Unknown pack object type: " + std::to_string(type));
+}
+
+int type_from_name(const std::string &name) {
+    for (int type : {OBJ_COMMIT, OBJ_TREE, OBJ_BLOB, OBJ_TAG}) {
+        if (name == type_name(type)) {
+            return type;
+        }
+    }
+    throw std::runtime_error("Unknown object type: " + name);
+}
+
+struct PackEntry {
+    uint64_t offset = 0;
+    uint64_t data_offset = 0;
+    uint64_t end = 0;
+    // Inflated size; for deltas, the size of the delta itself.
+    uint64_t size = 0;
+    int type = 0;
+    uint64_t base_offset = 0;
+    std::string base_sha;
+    uint32_t crc = 0;
+    // Filled in once resolved.
+    int real_type = 0;
+    std::string sha;
+};
+
+struct MappedPack : MappedFile {
+    explicit MappedPack(const fs::path &path) : MappedFile(path, pack_header_size + checksum_size, "pack") {}
+};
+
+struct Inflater {
+    Inflater() {
+        if (inflateInit(&stream) != Z_OK) {
+            throw std::runtime_error("Failed to initialize zlib");
+        }
+    }
+    ~Inflater() {
+        inflateEnd(&stream);
+    }
+    z_stream stream{};
+};
+
+void parse_entry_header(const MappedPack &pack, size_t limit, PackEntry &entry) {
+    size_t pos = entry.offset;
+    auto next_byte = [&]() {
+        if (pos >= limit) {
+            throw std::runtime_error("Truncated pack entry at offset " + std::to_string(entry.offset));
+        }
+        return pack.data[pos++];
+    };
+    unsigned char c = next_byte();
+    entry.type = (c >> 4) & 7;
+    uint64_t size = c & 15;
+    int shift = 4;
+    while (c & 0x80) {
+        c = next_byte();
+        if (shift > 57) {
+            throw std::runtime_error("Pack entry size overflows at offset " + std::to_string(entry.offset));
+        }
+        size |= uint64_t(c & 0x7f) << shift;
+        shift += 7;
+    }
+    entry.size = size;
+    if (entry.type == OBJ_OFS_DELTA) {
+        c = next_byte();
+        uint64_t distance = c & 0x7f;
+        while (c & 0x80) {
+            c = next_byte();
+            distance = ((distance + 1) << 7) | (c & 0x7f);
+        }
+        if (distance == 0 || distance > entry.offset) {
+            throw std::runtime_error("Invalid delta base offset at " + std::to_string(entry.offset));
+        }
+        entry.base_offset = entry.offset - distance;
+    }
+    else if (entry.type == OBJ_REF_DELTA) {
+        if (pos + 20 > limit) {
+            throw std::runtime_error("Truncated pack entry at offset " + std::to_string(entry.offset));
+        }
+        entry.base_sha = to_hex(pack.data + pos, 20);
+        pos += 20;
+    }
+    else {
+        type_name(entry.type);
+    }
+    entry.data_offset = pos;
+}
+
+// Inflates the zlib stream at entry.data_offset; when out is null the bytes
+// are discarded and only the stream's extent is recorded in entry.end.
+void inflate_entry(z_stream &stream, const MappedPack &pack, size_t limit, PackEntry &entry, std::string *out) {
+    thread_local std::vector<unsigned char> scratch(scan_chunk);
+    TraceScope scope(TraceTimer::Inflate);
+    inflateReset(&stream);
+    stream.avail_in = 0;
+    const unsigned char *in = pack.data + entry.data_offset;
+    size_t remaining = limit - entry.data_offset;
+    if (out) {
+        out->resize(entry.size);
+    }
+    uint64_t produced = 0;
+    int status = Z_OK;
+    while (status != Z_STREAM_END) {
+        if (stream.avail_in == 0) {
+            size_t n = std::min<size_t>(remaining, UINT_MAX);
+            stream.next_in = const_cast<unsigned char *>(in);
+            stream.avail_in = n;
+            in += n;
+            remaining -= n;
+        }
+        if (out) {
+            // One spare byte so a stream longer than its header says is caught.
+            if (produced >= entry.size) {
+                stream.next_out = scratch.data();
+                stream.avail_out = 1;
+            }
+            else {
+                stream.next_out = reinterpret_cast<unsigned char *>(out->data()) + produced;
+                stream.avail_out = std::min<uint64_t>(entry.size - produced, UINT_MAX);
+            }
+        }
+        else {
+            stream.next_out = scratch.data();
+            stream.avail_out = scratch.size();
+        }
+        uInt before = stream.avail_out;
+        status = inflate(&stream, Z_NO_FLUSH);
+        produced += before - stream.avail_out;
+        if (status == Z_BUF_ERROR && stream.avail_in == 0 && remaining == 0) {
+            throw std::runtime_error("Truncated pack entry at offset " + std::to_string(entry.offset));
+        }
+        if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+            throw std::runtime_error("Corrupt pack entry at offset " + std::to_string(entry.offset));
+        }
+        if (produced > entry.size) {
+            break;
+        }
+    }
+    if (produced != entry.size) {
+        throw std::runtime_error("Pack entry size mismatch at offset " + std::to_string(entry.offset));
+    }
+    Trace::count(TraceCounter::BytesInflated, produced);
+    entry.end = entry.data_offset + stream.total_in;
+}
+
+// Inflates a non-delta entry through a fixed-size buffer, handing each chunk
+// to sink; memory use does not depend on the object's size.
+void stream_entry(z_stream &stream, const MappedPack &pack, size_t limit, const PackEntry &entry,
+                  const std::function<void(const unsigned char *, size_t)> &sink) {
+    thread_local std::vector<unsigned char> buffer(stream_chunk);
+    inflateReset(&stream);
+    stream.next_in = const_cast<unsigned char *>(pack.data + entry.data_offset);
+    stream.avail_in = std::min<size_t>(limit - entry.data_offset, UINT_MAX);
+    uint64_t produced = 0;
+    int status = Z_OK;
+    while (status != Z_STREAM_END) {
+        stream.next_out = buffer.data();
+        stream.avail_out = buffer.size();
+        {
+            TraceScope scope(TraceTimer::Inflate);
+            status = inflate(&stream, Z_NO_FLUSH);
+        }
+        if (status != Z_OK && status != Z_STREAM_END) {
+            throw std::runtime_error("Corrupt pack entry at offset " + std::to_string(entry.offset));
+        }
+        size_t n = buffer.size() - stream.avail_out;
+        if (produced + n > entry.size) {
+            throw std::runtime_error("Pack entry size mismatch at offset " + std::to_string(entry.offset));
+        }
+        produced += n;
+        Trace::count(TraceCounter::BytesInflated, n);
+        if (n) {
+            sink(buffer.data(), n);
+        }
+    }
+    if (produced != entry.size) {
+        throw std::runtime_error("Pack entry size mismatch at offset " + std::to_string(entry.offset));
+    }
+}
+
+// The result size at the start of a delta entry's data. Only the two size
+// varints are inflated, never the rest of the delta.
+uint64_t delta_result_size(z_stream &stream, const MappedPack &pack, size_t limit, const PackEntry &entry) {
+    unsigned char head[20];
+    inflateReset(&stream);
+    stream.next_in = const_cast<unsigned char *>(pack.data + entry.data_offset);
+    stream.avail_in = std::min<size_t>(limit - entry.data_offset, UINT_MAX);
+    stream.next_out = head;
+    stream.avail_out = std::min<uint64_t>(sizeof(head), entry.size);
+    int status = inflate(&stream, Z_SYNC_FLUSH);
+    if (status != Z_OK && status != Z_STREAM_END) {
+        throw std::runtime_error("Corrupt pack entry at offset " + std::to_string(entry.offset));
+    }
+    size_t len = std::min<uint64_t>(sizeof(head), entry.size) - stream.avail_out;
+    size_t pos = 0;
+    auto varint = [&]() {
+        uint64_t value = 0;
+        int shift = 0;
+        unsigned char c;
+        do {
+            if (pos >= len || shift > 63) {
+                throw std::runtime_error("Truncated delta");
+            }
+            c = head[pos++];
+            value |= uint64_t(c & 0x7f) << shift;
+            shift += 7;
+        } while (c & 0x80);
+        return value;
+    };
+    varint();
+    return varint();
+}
+
+std::string apply_delta(const std::string &base, const std::string &delta) {
+    size_t pos = 0;
+    auto varint = [&]() {
+        uint64_t value = 0;
+        int shift = 0;
+        unsigned char c;
+        do {
+            if (pos >= delta.size() || shift > 63) {
+                throw std::runtime_error("Truncated delta");
+            }
+            c = delta[pos++];
+            value |= uint64_t(c & 0x7f) << shift;
+            shift += 7;
+        } while (c & 0x80);
+        return value;
+    };
+    if (varint() != base.size()) {
+        throw std::runtime_error("Delta base size mismatch");
+    }
+    std::string result(varint(), '\0');
+    size_t out = 0;
+    while (pos < delta.size()) {
+        unsigned char op = delta[pos++];
+        if (op & 0x80) {
+            uint64_t offset = 0;
+            uint64_t length = 0;
+            for (int i = 0; i < 4; ++i) {
+                if (op & (1 << i)) {
+                    if (pos >= delta.size()) {
+                        throw std::runtime_error("Truncated delta");
+                    }
+                    offset |= uint64_t(static_cast<unsigned char>(delta[pos++])) << (8 * i);
+                }
+            }
+            for (int i = 0; i < 3; ++i) {
+                if (op & (0x10 << i)) {
+                    if (pos >= delta.size()) {
+                        throw std::runtime_error("Truncated delta");
+                    }
+                    length |= uint64_t(static_cast<unsigned char>(delta[pos++])) << (8 * i);
+                }
+            }
+            if (length == 0) {
+                length = 0x10000;
+            }
+            if (offset + length > base.size() || out + length > result.size()) {
+                throw std::runtime_error("Delta copy out of range");
+            }
+            std::memcpy(result.data() + out, base.data() + offset, length);
+            out += length;
+        }
+        else if (op) {
+            if (pos + op > delta.size() || out + op > result.size()) {
+                throw std::runtime_error("Delta insert out of range");
+            }
+            std::memcpy(result.data() + out, delta.data() + pos, op);
+            pos += op;
+            out += op;
+        }
+        else {
+            throw std::runtime_error("Invalid delta opcode");
+        }
+    }
+    if (out != result.size()) {
+        throw std::runtime_error("Delta result size mismatch");
+    }
+    return result;
+}
+
+std::string object_id(int type, const std::string &data) {
+    TraceScope scope(TraceTimer::Sha1);
+    SHA1 hasher;
+    hasher.update(std::string(type_name(type)) + " " + std::to_string(data.size()) + std::string(1, '\0'));
+    hasher.update(data);
+    return hasher.final();
+}
+
+std::string pack_checksum(const MappedPack &pack) {
+    TraceScope scope(TraceTimer::Sha1);
+    SHA1 hasher;
+    size_t len = pack.size - checksum_size;
+    for (size_t pos = 0; pos < len; pos += 1 << 20) {
+        size_t n = std::min<size_t>(len - pos, 1 << 20);
+        hasher.update(std::string(reinterpret_cast<const char *>(pack.data + pos), n));
+    }
+    return hasher.final();
+}
+
+class DeltaResolver {
+public:
+    DeltaResolver(const GitRepository &repo, const MappedPack &pack, std::vector<PackEntry> &entries, bool unpack)
+        : repo(repo), pack(pack), entries(entries), unpack(unpack), limit(pack.size - checksum_size) {
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (entries[i].type == OBJ_OFS_DELTA) {
+                ofs_children[entries[i].base_offset].push_back(i);
+            }
+            else if (entries[i].type == OBJ_REF_DELTA) {
+                ref_children[entries[i].base_sha].push_back(i);
+            }
+        }
+    }
+
+    void run(size_t threads, std::vector<PackThreadStats> &stats) {
+        std::vector<size_t> roots;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (entries[i].type != OBJ_OFS_DELTA && entries[i].type != OBJ_REF_DELTA) {
+                roots.push_back(i);
+            }
+        }
+        ThreadPool pool(threads);
+        stats.assign(pool.size(), PackThreadStats());
+        parallel(pool, stats, roots.size(), [&](Inflater &inflater, size_t i, PackThreadStats &local) {
+            PackEntry &entry = entries[roots[i]];
+            std::string data;
+            inflate_entry(inflater.stream, pack, limit, entry, &data);
+            finish(entry, entry.type, data, local);
+            resolve_children(inflater, true, entry.offset, entry.sha, entry.type, data, local);
+        });
+
+        // REF_DELTA bases missing from the pack (thin packs) come from the
+        // object store.
+        std::unordered_set<std::string> in_pack;
+        for (const auto &entry : entries) {
+            if (!entry.sha.empty()) {
+                in_pack.insert(entry.sha);
+            }
+        }
+        std::vector<std::string> external;
+        for (const auto &[sha, children] : ref_children) {
+            if (!in_pack.count(sha)) {
+                external.push_back(sha);
+            }
+        }
+        parallel(pool, stats, external.size(), [&](Inflater &inflater, size_t i, PackThreadStats &local) {
+            std::vector<unsigned char> raw = read_raw_object(repo, external[i]);
+            auto nul = std::find(raw.begin(), raw.end(), static_cast<unsigned char>('\0'));
+            auto space = std::find(raw.begin(), nul, static_cast<unsigned char>(' '));
+            if (nul == raw.end() || space == nul) {
+                throw std::runtime_error("Invalid object format: " + external[i]);
+            }
+            std::string data(nul + 1, raw.end());
+            resolve_children(inflater, false, 0, external[i], type_from_name(std::string(raw.begin(), space)), data, local);
+        });
+
+        size_t unresolved = std::count_if(entries.begin(), entries.end(), [](const PackEntry &entry) {
+            return entry.sha.empty();
+        });
+        if (unresolved) {
+            throw std::runtime_error("Pack has " + std::to_string(unresolved) + " unresolved deltas");
+        }
+    }
+private:
+    using Task = std::function<void(Inflater &, size_t, PackThreadStats &)>;
+
+    // Runs task(0..count) on every pool thread, each pulling the next index;
+    // the first failure stops the rest and is rethrown here.
+    void parallel(ThreadPool &pool, std::vector<PackThreadStats> &stats, size_t count, const Task &task) {
+        std::atomic<size_t> next{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+        std::mutex error_mutex;
+        for (size_t t = 0; t < pool.size(); ++t) {
+            pool.submit([&, t]() {
+                auto start = std::chrono::steady_clock::now();
+                try {
+                    Inflater inflater;
+                    size_t i;
+                    while (!failed && (i = next++) < count) {
+                        task(inflater, i, stats[t]);
+                    }
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                    failed = true;
+                }
+                stats[t].seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            });
+        }
+        pool.wait_idle();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    void finish(PackEntry &entry, int type, const std::string &data, PackThreadStats &stats) {
+        entry.real_type = type;
+        entry.sha = object_id(type, data);
+        if (unpack) {
+            write_raw_object(repo, type_name(type), data);
+        }
+        ++stats.objects;
+        stats.bytes += data.size();
+    }
+
+    // Depth first, so each base stays inflated only while its own
+    // descendants are being applied.
+    void resolve_children(Inflater &inflater, bool in_pack, uint64_t offset, const std::string &sha, int type,
+                          const std::string &data, PackThreadStats &stats) {
+        auto visit = [&](const std::vector<size_t> &children) {
+            for (size_t index : children) {
+                PackEntry &child = entries[index];
+                std::string delta;
+                inflate_entry(inflater.stream, pack, limit, child, &delta);
+                std::string result = apply_delta(data, delta);
+                delta.clear();
+                delta.shrink_to_fit();
+                finish(child, type, result, stats);
+                resolve_children(inflater, true, child.offset, child.sha, type, result, stats);
+            }
+        };
+        if (in_pack) {
+            auto it = ofs_children.find(offset);
+            if (it != ofs_children.end()) {
+                visit(it->second);
+            }
+        }
+        auto it = ref_children.find(sha);
+        if (it != ref_children.end()) {
+            visit(it->second);
+        }
+    }
+
+    const GitRepository &repo;
+    const MappedPack &pack;
+    std::vector<PackEntry> &entries;
+    bool unpack;
+    size_t limit;
+    std::unordered_map<uint64_t, std::vector<size_t>> ofs_children;
+    std::unordered_map<std::string, std::vector<size_t>> ref_children;
+};
+
+void write_index(const fs::path &path, const std::vector<PackEntry> &entries, const std::string &checksum) {
+    std::vector<size_t> order(entries.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return entries[a].sha < entries[b].sha;
+    });
+
+    std::string out("\377tOc", 4);
+    put_be(out, 2, 4);
+    size_t next = 0;
+    for (int byte = 0; byte < 256; ++byte) {
+        while (next < order.size() && std::stoi(entries[order[next]].sha.substr(0, 2), nullptr, 16) <= byte) {
+            ++next;
+        }
+        put_be(out, next, 4);
+    }
+    for (size_t i : order) {
+        out += hex_to_bytes(entries[i].sha);
+    }
+    for (size_t i : order) {
+        put_be(out, entries[i].crc, 4);
+    }
+    std::vector<uint64_t> large;
+    for (size_t i : order) {
+        if (entries[i].offset < 0x80000000u) {
+            put_be(out, entries[i].offset, 4);
+        }
+        else {
+            put_be(out, 0x80000000u | large.size(), 4);
+            large.push_back(entries[i].offset);
+        }
+    }
+    for (uint64_t offset : large) {
+        put_be(out, offset >> 32, 4);
+        put_be(out, offset & 0xffffffffu, 4);
+    }
+    out += hex_to_bytes(checksum);
+    SHA1 hasher;
+    hasher.update(out);
+    out += hex_to_bytes(hasher.final());
+
+    fs::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        file.write(out.data(), out.size());
+        if (!file) {
+            throw std::runtime_error("Failed to write " + tmp.string());
+        }
+    }
+    fs::rename(tmp, path);
+    Trace::count(TraceCounter::BytesWritten, out.size());
+}
+
+constexpr size_t fanout_size = 256 * 4;
+
+// First position in the sorted id table whose id is not less than key,
+// narrowed by the 256-entry fanout that .idx and multi-pack-index share.
+size_t lower_bound_id(const unsigned char *fanout, const unsigned char *ids, const unsigned char *key) {
+    Trace::count(TraceCounter::PackIndexProbes);
+    size_t lo = key[0] ? read_be(fanout + 4 * (key[0] - 1), 4) : 0;
+    size_t hi = read_be(fanout + 4 * key[0], 4);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (std::memcmp(ids + mid * checksum_size, key, checksum_size) < 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// The 20-byte key for a hex prefix, padded with zero bits; false if the
+// prefix is not hex or too long.
+bool prefix_key(const std::string &prefix, unsigned char *key) {
+    if (prefix.size() > 2 * checksum_size) {
+        return false;
+    }
+    std::memset(key, 0, checksum_size);
+    for (size_t i = 0; i < prefix.size(); ++i) {
+        char c = prefix[i];
+        int nibble = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+        if (nibble < 0) {
+            return false;
+        }
+        key[i / 2] |= i % 2 ? nibble : nibble << 4;
+    }
+    return true;
+}
+
+// Appends ids[from..] that start with prefix, up to limit in total.
+void collect_prefix(const unsigned char *ids, size_t count, size_t from, const std::string &prefix,
+                    std::vector<std::string> &out, size_t limit) {
+    for (size_t i = from; i < count && out.size() < limit; ++i) {
+        std::string hex = to_hex(ids + i * checksum_size, checksum_size);
+        if (hex.compare(0, prefix.size(), prefix) != 0) {
+            break;
+        }
+        out.push_back(std::move(hex));
+    }
+}
+
+// A version 2 pack .idx, mapped read-only.
+class PackIndex {
+public:
+    explicit PackIndex(const fs::path &path) : file(path, 8 + fanout_size + 2 * checksum_size, "pack index") {
+        const unsigned char *d = file.data;
+        if (std::memcmp(d, "\377tOc", 4) != 0 || read_be(d + 4, 4) != 2) {
+            throw std::runtime_error("Unsupported pack index: " + path.string());
+        }
+        fanout = d + 8;
+        count = read_be(fanout + 255 * 4, 4);
+        size_t fixed = 8 + fanout_size + count * (checksum_size + 8) + 2 * checksum_size;
+        if (file.size < fixed) {
+            throw std::runtime_error("Truncated pack index: " + path.string());
+        }
+        ids = fanout + fanout_size;
+        offsets = ids + count * (checksum_size + 4);
+        large = offsets + count * 4;
+        large_count = (file.size - fixed) / 8;
+    }
+
+    size_t size() const {
+        return count;
+    }
+    const unsigned char *id(size_t i) const {
+        return ids + i * checksum_size;
+    }
+    uint64_t offset(size_t i) const {
+        uint32_t value = read_be(offsets + 4 * i, 4);
+        if (!(value & 0x80000000u)) {
+            return value;
+        }
+        size_t k = value & 0x7fffffffu;
+        if (k >= large_count) {
+            throw std::runtime_error("Corrupt pack index: bad large offset");
+        }
+        return read_be(large + 8 * k, 8);
+    }
+    std::optional<uint64_t> find(const unsigned char *key) const {
+        size_t i = lower_bound_id(fanout, ids, key);
+        if (i < count && std::memcmp(id(i), key, checksum_size) == 0) {
+            return offset(i);
+        }
+        return std::nullopt;
+    }
+    void find_prefix(const unsigned char *key, const std::string &prefix, std::vector<std::string> &out,
+                     size_t limit) const {
+        collect_prefix(ids, count, lower_bound_id(fanout, ids, key), prefix, out, limit);
+    }
+private:
+    MappedFile file;
+    const unsigned char *fanout = nullptr;
+    const unsigned char *ids = nullptr;
+    const unsigned char *offsets = nullptr;
+    const unsigned char *large = nullptr;
+    size_t count = 0;
+    size_t large_count = 0;
+};
+
+// git's multi-pack-index, version 1 with SHA-1 ids, integers big-endian:
+//   "MIDX", version, hash version, chunk count C, base file count (0),
+//   pack count P
+//   (C + 1) x (u32 chunk id, u64 offset), the last row marking the end
+//   PNAM  P NUL-terminated .idx names, sorted, padded to 4 bytes
+//   OIDF  256 x u32 fanout
+//   OIDL  N x 20-byte id, sorted
+//   OOFF  N x (u32 pack, u32 offset); a set top bit indexes LOFF instead
+//   LOFF  u64 offsets at or above 2^31, only when there are any
+//   SHA-1 of everything above
+constexpr uint32_t chunk_pack_names = 0x504e414d;      // "PNAM"
+constexpr uint32_t chunk_oid_fanout = 0x4f494446;      // "OIDF"
+constexpr uint32_t chunk_oid_lookup = 0x4f49444c;      // "OIDL"
+constexpr uint32_t chunk_object_offsets = 0x4f4f4646;  // "OOFF"
+constexpr uint32_t chunk_large_offsets = 0x4c4f4646;   // "LOFF"
+constexpr size_t midx_header_size = 12;
+
+class MultiPackIndex {
+public:
+    explicit MultiPackIndex(const fs::path &path)
+        : file(path, midx_header_size + 12 + checksum_size, "multi-pack-index") {
+        const unsigned char *d = file.data;
+        if (std::memcmp(d, "MIDX", 4) != 0 || d[4] != 1 || d[5] != 1 || d[7] != 0) {
+            throw std::runtime_error("Unsupported multi-pack-index: " + path.string());
+        }
+        size_t chunks = d[6];
+        uint32_t packs = read_be(d + 8, 4);
+        size_t end = file.size - checksum_size;
+        if (midx_header_size + (chunks + 1) * 12 > end) {
+            throw std::runtime_error("Truncated multi-pack-index: " + path.string());
+        }
+        for (size_t c = 0; c < chunks; ++c) {
+            const unsigned char *row = d + midx_header_size + c * 12;
+            uint64_t start = read_be(row + 4, 8);
+            uint64_t stop = read_be(row + 16, 8);
+            if (start > stop || stop > end) {
+                throw std::runtime_error("Corrupt multi-pack-index chunk table: " + path.string());
+            }
+            std::pair<const unsigned char *, size_t> span(d + start, stop - start);
+            switch (read_be(row, 4)) {
+            case chunk_pack_names: names_chunk = span; break;
+            case chunk_oid_fanout: fanout_chunk = span; break;
+            case chunk_oid_lookup: ids_chunk = span; break;
+            case chunk_object_offsets: offsets_chunk = span; break;
+            case chunk_large_offsets: large_chunk = span; break;
+            }
+        }
+        if (!names_chunk.first || !ids_chunk.first || !offsets_chunk.first || fanout_chunk.second != fanout_size) {
+            throw std::runtime_error("Multi-pack-index is missing a chunk: " + path.string());
+        }
+        count = read_be(fanout_chunk.first + 255 * 4, 4);
+        if (ids_chunk.second < count * checksum_size || offsets_chunk.second < count * 8) {
+            throw std::runtime_error("Truncated multi-pack-index: " + path.string());
+        }
+        const char *name = reinterpret_cast<const char *>(names_chunk.first);
+        const char *names_end = name + names_chunk.second;
+        while (names.size() < packs) {
+            const char *nul = static_cast<const char *>(std::memchr(name, '\0', names_end - name));
+            if (!nul || nul == name) {
+                throw std::runtime_error("Corrupt multi-pack-index pack names: " + path.string());
+            }
+            names.emplace_back(name, nul);
+            name = nul + 1;
+        }
+    }
+
+    const std::vector<std::string> &pack_names() const {
+        return names;
+    }
+    size_t size() const {
+        return count;
+    }
+    uint32_t pack(size_t i) const {
+        return read_be(offsets_chunk.first + 8 * i, 4);
+    }
+    uint64_t offset(size_t i) const {
+        uint32_t value = read_be(offsets_chunk.first + 8 * i + 4, 4);
+        if (!(value & 0x80000000u)) {
+            return value;
+        }
+        size_t k = value & 0x7fffffffu;
+        if ((k + 1) * 8 > large_chunk.second) {
+            throw std::runtime_error("Corrupt multi-pack-index: bad large offset");
+        }
+        return read_be(large_chunk.first + 8 * k, 8);
+    }
+    std::optional<size_t> find(const unsigned char *key) const {
+        size_t i = lower_bound_id(fanout_chunk.first, ids_chunk.first, key);
+        if (i < count && std::memcmp(ids_chunk.first + i * checksum_size, key, checksum_size) == 0) {
+            return i;
+        }
+        return std::nullopt;
+    }
+    void find_prefix(const unsigned char *key, const std::string &prefix, std::vector<std::string> &out,
+                     size_t limit) const {
+        collect_prefix(ids_chunk.first, count, lower_bound_id(fanout_chunk.first, ids_chunk.first, key), prefix, out,
+                       limit);
+    }
+private:
+    MappedFile file;
+    std::pair<const unsigned char *, size_t> names_chunk{nullptr, 0};
+    std::pair<const unsigned char *, size_t> fanout_chunk{nullptr, 0};
+    std::pair<const unsigned char *, size_t> ids_chunk{nullptr, 0};
+    std::pair<const unsigned char *, size_t> offsets_chunk{nullptr, 0};
+    std::pair<const unsigned char *, size_t> large_chunk{nullptr, 0};
+    std::vector<std::string> names;
+    size_t count = 0;
+};
+
+// One pack in the store. The .pack is mapped on first read; the .idx is
+// mapped only when no multi-pack-index covers the pack.
+struct StoredPack {
+    fs::path path;
+    std::string index_name;
+    std::unique_ptr<PackIndex> index;
+    std::once_flag mapped;
+    std::unique_ptr<MappedPack> data;
+
+    const MappedPack &pack() {
+        std::call_once(mapped, [this]() {
+            auto map = std::make_unique<MappedPack>(path);
+            if (std::memcmp(map->data, "PACK", 4) != 0) {
+                throw std::runtime_error("Not a packfile: " + path.string());
+            }
+            data = std::move(map);
+        });
+        return *data;
+    }
+};
+
+// Deeper chains than git ever writes mean a corrupt or cyclic pack.
+constexpr int max_delta_depth = 10000;
+
+struct PackSet {
+    std::vector<std::unique_ptr<StoredPack>> packs;
+    std::unique_ptr<MultiPackIndex> midx;
+    // packs[] position of each multi-pack-index pack id.
+    std::vector<size_t> midx_packs;
+    // Packs the multi-pack-index does not cover, probed one by one.
+    std::vector<size_t> probed;
+    fs::file_time_type dir_time;
+    bool scanned_dir = false;
+
+    struct Location {
+        StoredPack *pack;
+        uint64_t offset;
+    };
+
+    std::optional<Location> locate(const unsigned char *key) const {
+        if (midx) {
+            if (auto i = midx->find(key)) {
+                uint32_t pack = midx->pack(*i);
+                if (pack >= midx_packs.size()) {
+                    throw std::runtime_error("Corrupt multi-pack-index: bad pack id");
+                }
+                return Location{packs[midx_packs[pack]].get(), midx->offset(*i)};
+            }
+        }
+        for (size_t p : probed) {
+            if (auto offset = packs[p]->index->find(key)) {
+                return Location{packs[p].get(), *offset};
+            }
+        }
+        return std::nullopt;
+    }
+
+    // The entry at offset with its header parsed.
+    PackEntry entry_at(StoredPack &stored, uint64_t offset, int depth) const {
+        if (depth > max_delta_depth) {
+            throw std::runtime_error("Delta chain too long in " + stored.path.string());
+        }
+        const MappedPack &pack = stored.pack();
+        size_t limit = pack.size - checksum_size;
+        if (offset < pack_header_size || offset >= limit) {
+            throw std::runtime_error("Bad pack offset " + std::to_string(offset) + " in " + stored.path.string());
+        }
+        PackEntry entry;
+        entry.offset = offset;
+        parse_entry_header(pack, limit, entry);
+        return entry;
+    }
+
+    // The object's type, from the entry headers down its delta chain.
+    int type_at(const GitRepository &repo, StoredPack &stored, uint64_t offset, int depth) const {
+        PackEntry entry = entry_at(stored, offset, depth);
+        if (entry.type == OBJ_OFS_DELTA) {
+            return type_at(repo, stored, entry.base_offset, depth + 1);
+        }
+        if (entry.type == OBJ_REF_DELTA) {
+            unsigned char key[checksum_size];
+            prefix_key(entry.base_sha, key);
+            if (auto base = locate(key)) {
+                return type_at(repo, *base->pack, base->offset, depth + 1);
+            }
+            return type_from_name(read_object_header(repo, entry.base_sha).type);
+        }
+        return entry.type;
+    }
+
+    // Type and size without inflating the object.
+    ObjectHeader header_at(const GitRepository &repo, StoredPack &stored, uint64_t offset) const {
+        PackEntry entry = entry_at(stored, offset, 0);
+        uint64_t size = entry.size;
+        if (entry.type == OBJ_OFS_DELTA || entry.type == OBJ_REF_DELTA) {
+            thread_local Inflater inflater;
+            const MappedPack &pack = stored.pack();
+            size = delta_result_size(inflater.stream, pack, pack.size - checksum_size, entry);
+        }
+        return ObjectHeader{type_name(type_at(repo, stored, offset, 0)), size};
+    }
+
+    std::string read_at(const GitRepository &repo, StoredPack &stored, uint64_t offset, int &type, int depth) const {
+        PackEntry entry = entry_at(stored, offset, depth);
+        const MappedPack &pack = stored.pack();
+        size_t limit = pack.size - checksum_size;
+        thread_local Inflater inflater;
+        std::string data;
+        inflate_entry(inflater.stream, pack, limit, entry, &data);
+        if (entry.type == OBJ_OFS_DELTA) {
+            return apply_delta(read_at(repo, stored, entry.base_offset, type, depth + 1), data);
+        }
+        if (entry.type == OBJ_REF_DELTA) {
+            unsigned char key[checksum_size];
+            prefix_key(entry.base_sha, key);
+            if (auto base = locate(key)) {
+                return apply_delta(read_at(repo, *base->pack, base->offset, type, depth + 1), data);
+            }
+            std::vector<unsigned char> raw = read_raw_object(repo, entry.base_sha);
+            auto nul = std::find(raw.begin(), raw.end(), static_cast<unsigned char>('\0'));
+            auto space = std::find(raw.begin(), nul, static_cast<unsigned char>(' '));
+            if (nul == raw.end() || space == nul) {
+                throw std::runtime_error("Invalid object format: " + entry.base_sha);
+            }
+            type = type_from_name(std::string(raw.begin(), space));
+            return apply_delta(std::string(nul + 1, raw.end()), data);
+        }
+        type = entry.type;
+        return data;
+    }
+};
+
+// Index files with a matching .pack, sorted by name.
+std::vector<std::string> pack_index_names(const fs::path &dir) {
+    std::vector<std::string> names;
+    std::error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        fs::path path = it->path();
+        if (path.extension() == ".idx" && fs::exists(fs::path(path).replace_extension(".pack"))) {
+            names.push_back(path.filename().string());
+        }
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+}
+
+IndexPackResult index_pack(const GitRepository &repo, const fs::path &pack_path, const IndexPackOptions &options) {
+    IndexPackResult result;
+    MappedPack pack(pack_path);
+    if (std::memcmp(pack.data, "PACK", 4) != 0) {
+        throw std::runtime_error("Not a packfile: " + pack_path.string());
+    }
+    uint32_t version = read_be(pack.data + 4, 4);
+    if (version != 2 && version != 3) {
+        throw std::runtime_error("Unsupported pack version " + std::to_string(version));
+    }
+    std::vector<PackEntry> entries(read_be(pack.data + 8, 4));
+    auto checksum = std::async(std::launch::async, [&pack]() {
+        return pack_checksum(pack);
+    });
+
+    // Pass 1: walk entry boundaries in order, inflating into a scratch
+    // buffer only to find where each zlib stream ends.
+    auto start = std::chrono::steady_clock::now();
+    size_t limit = pack.size - checksum_size;
+    size_t pos = pack_header_size;
+    {
+        Inflater inflater;
+        for (auto &entry : entries) {
+            entry.offset = pos;
+            parse_entry_header(pack, limit, entry);
+            inflate_entry(inflater.stream, pack, limit, entry, nullptr);
+            entry.crc = crc32_z(0, pack.data + entry.offset, entry.end - entry.offset);
+            pos = entry.end;
+            if (entry.type == OBJ_OFS_DELTA || entry.type == OBJ_REF_DELTA) {
+                ++result.deltas;
+            }
+        }
+    }
+    result.pack_checksum = checksum.get();
+    if (pos != limit) {
+        throw std::runtime_error("Pack has trailing data after the last object");
+    }
+    if (result.pack_checksum != to_hex(pack.data + limit, checksum_size)) {
+        throw std::runtime_error("Pack checksum mismatch");
+    }
+    auto scanned = std::chrono::steady_clock::now();
+    result.scan_seconds = std::chrono::duration<double>(scanned - start).count();
+
+    // Pass 2: resolve every object, bases before their delta children.
+    DeltaResolver resolver(repo, pack, entries, options.unpack);
+    resolver.run(options.threads, result.threads);
+    result.objects = entries.size();
+    result.resolve_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - scanned).count();
+
+    if (!options.unpack) {
+        fs::path index_path = options.index_path;
+        if (index_path.empty()) {
+            index_path = pack_path;
+            index_path.replace_extension(".idx");
+        }
+        write_index(index_path, entries, result.pack_checksum);
+    }
+    return result;
+}
+
+struct PackStore::Snapshot : PackSet {};
+
+PackStore::PackStore(const fs::path &pack_dir) : pack_dir(pack_dir) {}
+
+PackStore::~PackStore() = default;
+
+namespace {
+
+void scan_packs(const fs::path &dir, PackSet *set) {
+    std::error_code ec;
+    set->dir_time = fs::last_write_time(dir, ec);
+    set->scanned_dir = !ec;
+    if (ec) {
+        return;
+    }
+    std::unordered_map<std::string, size_t> by_name;
+    for (const auto &name : pack_index_names(dir)) {
+        auto stored = std::make_unique<StoredPack>();
+        stored->path = dir / name;
+        stored->path.replace_extension(".pack");
+        stored->index_name = name;
+        by_name.emplace(name, set->packs.size());
+        set->packs.push_back(std::move(stored));
+    }
+    std::vector<bool> covered(set->packs.size(), false);
+    fs::path midx_path = dir / "multi-pack-index";
+    if (fs::exists(midx_path)) {
+        try {
+            auto midx = std::make_unique<MultiPackIndex>(midx_path);
+            std::vector<size_t> positions;
+            for (const auto &name : midx->pack_names()) {
+                auto it = by_name.find(name);
+                if (it == by_name.end()) {
+                    // Names a pack that is gone: the file is stale, so ignore it.
+                    throw std::runtime_error("stale multi-pack-index");
+                }
+                positions.push_back(it->second);
+            }
+            for (size_t p : positions) {
+                covered[p] = true;
+            }
+            set->midx = std::move(midx);
+            set->midx_packs = std::move(positions);
+        }
+        catch (const std::runtime_error &) {
+            std::fill(covered.begin(), covered.end(), false);
+        }
+    }
+    for (size_t p = 0; p < set->packs.size(); ++p) {
+        if (!covered[p]) {
+            set->packs[p]->index = std::make_unique<PackIndex>(dir / set->packs[p]->index_name);
+            set->probed.push_back(p);
+        }
+    }
+}
+
+}
+
+std::shared_ptr<const PackStore::Snapshot> PackStore::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!current) {
+        auto scanned = std::make_shared<Snapshot>();
+        scan_packs(pack_dir, scanned.get());
+        current = std::move(scanned);
+    }
+    return current;
+}
+
+bool PackStore::refresh() {
+    std::error_code ec;
+    fs::file_time_type now = fs::last_write_time(pack_dir, ec);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (current && current->scanned_dir == !ec && (ec || current->dir_time == now)) {
+        return false;
+    }
+    auto scanned = std::make_shared<Snapshot>();
+    scan_packs(pack_dir, scanned.get());
+    current = std::move(scanned);
+    return true;
+}
+
+bool PackStore::contains(const std::string &sha) const {
+    unsigned char key[checksum_size];
+    return sha.size() == 2 * checksum_size && prefix_key(sha, key) && snapshot()->locate(key).has_value();
+}
+
+std::optional<PackedObject> PackStore::read(const GitRepository &repo, const std::string &sha) const {
+    unsigned char key[checksum_size];
+    if (sha.size() != 2 * checksum_size || !prefix_key(sha, key)) {
+        return std::nullopt;
+    }
+    auto set = snapshot();
+    auto location = set->locate(key);
+    if (!location) {
+        return std::nullopt;
+    }
+    int type = 0;
+    std::string data = set->read_at(repo, *location->pack, location->offset, type, 0);
+    Trace::count(TraceCounter::ObjectsRead);
+    return PackedObject{parse_object_type(type_name(type)), std::move(data)};
+}
+
+std::optional<ObjectHeader> PackStore::read_header(const GitRepository &repo, const std::string &sha) const {
+    unsigned char key[checksum_size];
+    if (sha.size() != 2 * checksum_size || !prefix_key(sha, key)) {
+        return std::nullopt;
+    }
+    auto set = snapshot();
+    auto location = set->locate(key);
+    if (!location) {
+        return std::nullopt;
+    }
+    Trace::count(TraceCounter::ObjectsRead);
+    return set->header_at(repo, *location->pack, location->offset);
+}
+
+std::optional<ObjectHeader> PackStore::stream(const GitRepository &repo, const std::string &sha,
+                                              const std::function<void(const ObjectHeader &)> &on_header,
+                                              const std::function<void(const unsigned char *, size_t)> &sink) const {
+    unsigned char key[checksum_size];
+    if (sha.size() != 2 * checksum_size || !prefix_key(sha, key)) {
+        return std::nullopt;
+    }
+    auto set = snapshot();
+    auto location = set->locate(key);
+    if (!location) {
+        return std::nullopt;
+    }
+    Trace::count(TraceCounter::ObjectsRead);
+    StoredPack &stored = *location->pack;
+    PackEntry entry = set->entry_at(stored, location->offset, 0);
+    bool delta = entry.type == OBJ_OFS_DELTA || entry.type == OBJ_REF_DELTA;
+    // A delta's header comes from the headers alone too, so on_header can
+    // still reject the object before its chain is resolved.
+    ObjectHeader header = delta ? set->header_at(repo, stored, location->offset) : ObjectHeader{type_name(entry.type), entry.size};
+    if (on_header) {
+        on_header(header);
+    }
+    if (delta) {
+        int type = 0;
+        std::string data = set->read_at(repo, stored, location->offset, type, 0);
+        if (!data.empty()) {
+            sink(reinterpret_cast<const unsigned char *>(data.data()), data.size());
+        }
+    }
+    else {
+        thread_local Inflater inflater;
+        const MappedPack &pack = stored.pack();
+        stream_entry(inflater.stream, pack, pack.size - checksum_size, entry, sink);
+    }
+    return header;
+}
+
+void PackStore::find_prefix(const std::string &prefix, std::vector<std::string> &out, size_t limit) const {
+    unsigned char key[checksum_size];
+    if (!prefix_key(prefix, key)) {
+        return;
+    }
+    auto set = snapshot();
+    if (set->midx) {
+        set->midx->find_prefix(key, prefix, out, limit);
+    }
+    for (size_t p : set->probed) {
+        set->packs[p]->index->find_prefix(key, prefix, out, limit);
+    }
+}
+
+std::vector<std::string> PackStore::list_ids() const {
+    std::vector<std::string> ids;
+    // The empty prefix matches every id.
+    find_prefix("", ids, std::numeric_limits<size_t>::max());
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+size_t PackStore::pack_count() const {
+    return snapshot()->packs.size();
+}
+
+bool PackStore::uses_multi_pack_index() const {
+    return snapshot()->midx != nullptr;
+}
+
+fs::path multi_pack_index_path(const GitRepository &repo) {
+    return repo.get_gitdir() / "objects" / "pack" / "multi-pack-index";
+}
+
+MultiPackIndexStats write_multi_pack_index(const GitRepository &repo) {
+    fs::path dir = repo.get_gitdir() / "objects" / "pack";
+    std::vector<std::string> names = pack_index_names(dir);
+    if (names.empty()) {
+        throw std::runtime_error("No packs to index in " + dir.string());
+    }
+    std::vector<std::unique_ptr<PackIndex>> indexes;
+    std::vector<fs::file_time_type> times;
+    size_t total = 0;
+    for (const auto &name : names) {
+        indexes.push_back(std::make_unique<PackIndex>(dir / name));
+        times.push_back(fs::last_write_time(fs::path(dir / name).replace_extension(".pack")));
+        total += indexes.back()->size();
+    }
+
+    struct Row {
+        const unsigned char *id;
+        uint32_t pack;
+        uint64_t offset;
+    };
+    std::vector<Row> rows;
+    rows.reserve(total);
+    for (uint32_t p = 0; p < indexes.size(); ++p) {
+        for (size_t i = 0; i < indexes[p]->size(); ++i) {
+            rows.push_back({indexes[p]->id(i), p, indexes[p]->offset(i)});
+        }
+    }
+    // By id, then newest pack first so duplicates keep that copy.
+    std::sort(rows.begin(), rows.end(), [&](const Row &a, const Row &b) {
+        int c = std::memcmp(a.id, b.id, checksum_size);
+        if (c != 0) {
+            return c < 0;
+        }
+        if (times[a.pack] != times[b.pack]) {
+            return times[a.pack] > times[b.pack];
+        }
+        return a.pack < b.pack;
+    });
+    MultiPackIndexStats stats;
+    size_t kept = 0;
+    for (size_t i = 0; i < rows.size(); ++i) {
+        if (kept && std::memcmp(rows[kept - 1].id, rows[i].id, checksum_size) == 0) {
+            ++stats.duplicates;
+            continue;
+        }
+        rows[kept++] = rows[i];
+    }
+    rows.resize(kept);
+
+    std::string pack_names;
+    for (const auto &name : names) {
+        pack_names += name;
+        pack_names += '\0';
+    }
+    pack_names.resize((pack_names.size() + 3) / 4 * 4, '\0');
+    std::string fanout;
+    size_t next = 0;
+    for (int byte = 0; byte < 256; ++byte) {
+        while (next < rows.size() && rows[next].id[0] <= byte) {
+            ++next;
+        }
+        put_be(fanout, next, 4);
+    }
+    std::string ids;
+    std::string offsets;
+    std::string large;
+    ids.reserve(rows.size() * checksum_size);
+    for (const auto &row : rows) {
+        ids.append(reinterpret_cast<const char *>(row.id), checksum_size);
+        put_be(offsets, row.pack, 4);
+        if (row.offset < 0x80000000u) {
+            put_be(offsets, row.offset, 4);
+        }
+        else {
+            put_be(offsets, 0x80000000u | (large.size() / 8), 4);
+            put_be(large, row.offset, 8);
+        }
+    }
+
+    std::vector<std::pair<uint32_t, const std::string *>> chunks = {
+        {chunk_pack_names, &pack_names},
+        {chunk_oid_fanout, &fanout},
+        {chunk_oid_lookup, &ids},
+        {chunk_object_offsets, &offsets},
+    };
+    if (!large.empty()) {
+        chunks.push_back({chunk_large_offsets, &large});
+    }
+    std::string out("MIDX", 4);
+    out += static_cast<char>(1);
+    out += static_cast<char>(1);
+    out += static_cast<char>(chunks.size());
+    out += static_cast<char>(0);
+    put_be(out, names.size(), 4);
+    uint64_t offset = midx_header_size + (chunks.size() + 1) * 12;
+    for (const auto &[id, body] : chunks) {
+        put_be(out, id, 4);
+        put_be(out, offset, 8);
+        offset += body->size();
+    }
+    put_be(out, 0, 4);
+    put_be(out, offset, 8);
+    for (const auto &[id, body] : chunks) {
+        out += *body;
+    }
+    {
+        TraceScope scope(TraceTimer::Sha1);
+        SHA1 hasher;
+        hasher.update(out);
+        out += hex_to_bytes(hasher.final());
+    }
+
+    fs::path path = dir / "multi-pack-index";
+    fs::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        file.write(out.data(), out.size());
+        if (!file) {
+            throw std::runtime_error("Failed to write " + tmp.string());
+        }
+    }
+    fs::rename(tmp, path);
+    Trace::count(TraceCounter::BytesWritten, out.size());
+    repo.packs().refresh();
+
+    stats.packs = names.size();
+    stats.objects = rows.size();
+    stats.bytes = out.size();
+    return stats;
+}
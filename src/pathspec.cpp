@@ -0,0 +1,99 @@
+#include <fnmatch.h>
+#include <fstream>
+#include <stdexcept>
+
+#include "pathspec.h"
+
+Pathspec::Pathspec(const std::vector<std::string> &specs) {
+    for (std::string text : specs) {
+        while (!text.empty() && text.front() == '/') {
+            text.erase(0, 1);
+        }
+        while (!text.empty() && text.back() == '/') {
+            text.pop_back();
+        }
+        if (text.empty()) {
+            continue;
+        }
+        size_t wildcard = text.find_first_of("*?[");
+        Pattern pattern;
+        pattern.glob = wildcard != std::string::npos;
+        pattern.literal_prefix = pattern.glob ? text.substr(0, wildcard) : text;
+        pattern.text = std::move(text);
+        patterns.push_back(std::move(pattern));
+    }
+}
+
+Pathspec Pathspec::from_file(const fs::path &file) {
+    std::ifstream in(file);
+    if (!in) {
+        throw std::runtime_error("Cannot read pathspec file: " + file.string());
+    }
+    std::vector<std::string> specs;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        specs.push_back(line);
+    }
+    Pathspec pathspec(specs);
+    if (pathspec.empty()) {
+        throw std::runtime_error("No patterns in " + file.string());
+    }
+    return pathspec;
+}
+
+bool Pathspec::matches_one(const Pattern &pattern, const std::string &path) const {
+    if (path.compare(0, pattern.literal_prefix.size(), pattern.literal_prefix) != 0) {
+        return false;
+    }
+    if (!pattern.glob) {
+        return path.size() == pattern.text.size() || path[pattern.text.size()] == '/';
+    }
+    if (fnmatch(pattern.text.c_str(), path.c_str(), 0) == 0) {
+        return true;
+    }
+    // A glob that names a directory selects everything inside it.
+    for (size_t slash = path.rfind('/'); slash != std::string::npos && slash >= pattern.literal_prefix.size();
+         slash = slash ? path.rfind('/', slash - 1) : std::string::npos) {
+        if (fnmatch(pattern.text.c_str(), path.substr(0, slash).c_str(), 0) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Pathspec::matches(const std::string &path) const {
+    if (patterns.empty()) {
+        return true;
+    }
+    for (const auto &pattern : patterns) {
+        if (matches_one(pattern, path)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Pathspec::may_match_under(const std::string &dir) const {
+    if (patterns.empty()) {
+        return true;
+    }
+    std::string dir_slash = dir + "/";
+    for (const auto &pattern : patterns) {
+        // Paths below dir start with "dir/"; they can only match if that
+        // agrees with the pattern's literal prefix as far as both go.
+        size_t n = std::min(dir_slash.size(), pattern.literal_prefix.size());
+        if (dir_slash.compare(0, n, pattern.literal_prefix, 0, n) != 0) {
+            continue;
+        }
+        if (pattern.glob || pattern.text.size() > dir.size() || matches_one(pattern, dir)) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,245 @@
+#include "prefetch.h"
+#include "trace.h"
+
+ObjectPrefetcher::ObjectPrefetcher(const GitRepository &repo, size_t threads, size_t max_bytes)
+    : repo(repo), backend(configured_read_backend(repo)), max_bytes(max_bytes) {
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back(&ObjectPrefetcher::worker_loop, this);
+    }
+}
+
+ObjectPrefetcher::~ObjectPrefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    cancel_all();
+}
+
+void ObjectPrefetcher::prefetch(const std::vector<std::string> &ids) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = ids.rbegin(); it != ids.rend(); ++it) {
+            if (slots.try_emplace(*it).second) {
+                queue.push_front(*it);
+            }
+        }
+    }
+    work_ready.notify_all();
+}
+
+void ObjectPrefetcher::drop_locked(std::unordered_map<std::string, Slot>::iterator it) {
+    ready_bytes -= it->second.bytes;
+    slots.erase(it);
+}
+
+std::shared_ptr<GitObject> ObjectPrefetcher::get(const std::string &sha) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = slots.find(sha);
+    if (it != slots.end() && it->second.state == State::Loading) {
+        slot_done.wait(lock, [&]() {
+            it = slots.find(sha);
+            return it == slots.end() || it->second.state != State::Loading;
+        });
+    }
+    if (it == slots.end() || it->second.state == State::Queued) {
+        // Not started yet: take it off the queue and read it ourselves.
+        if (it != slots.end()) {
+            slots.erase(it);
+        }
+        lock.unlock();
+        return read_object(repo, sha);
+    }
+    Slot slot = std::move(it->second);
+    ready_bytes -= slot.bytes;
+    slots.erase(it);
+    lock.unlock();
+    work_ready.notify_all();
+    if (slot.state == State::Failed) {
+        std::rethrow_exception(slot.error);
+    }
+    Trace::count(TraceCounter::PrefetchHits);
+    return slot.obj;
+}
+
+void ObjectPrefetcher::cancel(const std::vector<std::string> &ids) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &sha : ids) {
+        auto it = slots.find(sha);
+        if (it != slots.end()) {
+            Trace::count(TraceCounter::PrefetchCancelled);
+            drop_locked(it);
+        }
+    }
+    work_ready.notify_all();
+}
+
+void ObjectPrefetcher::cancel_all() {
+    std::lock_guard<std::mutex> lock(mutex);
+    Trace::count(TraceCounter::PrefetchCancelled, slots.size());
+    slots.clear();
+    queue.clear();
+    ready_bytes = 0;
+}
+
+ObjectPrefetcher::Stats ObjectPrefetcher::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats stats;
+    for (const auto &[sha, slot] : slots) {
+        switch (slot.state) {
+        case State::Queued: ++stats.queued; break;
+        case State::Loading: ++stats.loading; break;
+        case State::Ready: ++stats.ready; break;
+        case State::Failed: ++stats.failed; break;
+        }
+    }
+    stats.ready_bytes = ready_bytes;
+    return stats;
+}
+
+void ObjectPrefetcher::publish(const std::string &sha, Slot &&loaded) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = slots.find(sha);
+        if (it != slots.end()) {
+            // Anything cancelled while loading was erased, so this is still wanted.
+            it->second = std::move(loaded);
+            ready_bytes += it->second.bytes;
+        }
+    }
+    slot_done.notify_all();
+}
+
+void ObjectPrefetcher::load_batch(BatchObjectReader &reader, std::vector<std::string> &batch) {
+    // Cached objects need no I/O; only the rest go to the reader.
+    std::vector<std::string> misses;
+    for (auto &sha : batch) {
+        Slot loaded;
+        if ((loaded.obj = repo.object_cache().get(sha))) {
+            loaded.bytes = loaded.obj->get_size();
+            loaded.state = State::Ready;
+            publish(sha, std::move(loaded));
+        }
+        else {
+            misses.push_back(std::move(sha));
+        }
+    }
+    std::vector<bool> done(misses.size());
+    auto finish = [&](size_t index, std::string &&compressed, std::exception_ptr error) {
+        Slot loaded;
+        try {
+            // No loose file (it may be packed) or a bad one: the normal
+            // read path finds packed objects and reports real errors.
+            loaded.obj = error ? read_object(repo, misses[index])
+                               : parse_loose_object(repo, misses[index], compressed);
+            loaded.bytes = loaded.obj->get_size();
+            loaded.state = State::Ready;
+        }
+        catch (...) {
+            loaded.error = std::current_exception();
+            loaded.state = State::Failed;
+        }
+        done[index] = true;
+        publish(misses[index], std::move(loaded));
+    };
+    try {
+        reader.read(misses, finish);
+    }
+    catch (...) {
+        // The reader itself failed; fail whatever it had not delivered so
+        // no get() waits on it forever.
+        std::exception_ptr error = std::current_exception();
+        for (size_t i = 0; i < misses.size(); ++i) {
+            if (!done[i]) {
+                finish(i, {}, error);
+            }
+        }
+    }
+}
+
+void ObjectPrefetcher::worker_loop() {
+    std::unique_ptr<BatchObjectReader> reader;
+    if (backend != ObjectReadBackend::Sync) {
+        reader = std::make_unique<BatchObjectReader>(repo, backend);
+    }
+    std::vector<std::string> batch;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        work_ready.wait(lock, [this]() {
+            return stopping || (!queue.empty() && ready_bytes < max_bytes);
+        });
+        if (stopping) {
+            return;
+        }
+        batch.clear();
+        size_t limit = reader ? read_batch : 1;
+        while (!queue.empty() && batch.size() < limit) {
+            std::string sha = std::move(queue.front());
+            queue.pop_front();
+            auto it = slots.find(sha);
+            if (it != slots.end() && it->second.state == State::Queued) {
+                it->second.state = State::Loading;
+                batch.push_back(std::move(sha));
+            }
+        }
+        if (batch.empty()) {
+            continue;
+        }
+        lock.unlock();
+
+        if (reader) {
+            load_batch(*reader, batch);
+        }
+        else {
+            Slot loaded;
+            try {
+                loaded.obj = read_object(repo, batch.front());
+                loaded.bytes = loaded.obj->get_size();
+                loaded.state = State::Ready;
+            }
+            catch (...) {
+                loaded.error = std::current_exception();
+                loaded.state = State::Failed;
+            }
+            publish(batch.front(), std::move(loaded));
+        }
+        lock.lock();
+    }
+}
+
+PrefetcherPool::Lease::~Lease() {
+    if (prefetcher) {
+        pool->release(std::move(prefetcher));
+    }
+}
+
+PrefetcherPool::Lease PrefetcherPool::acquire() {
+    std::unique_ptr<ObjectPrefetcher> prefetcher;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!pooled.empty()) {
+            prefetcher = std::move(pooled.back());
+            pooled.pop_back();
+        }
+    }
+    if (!prefetcher) {
+        prefetcher = std::make_unique<ObjectPrefetcher>(repo);
+    }
+    return Lease(*this, std::move(prefetcher));
+}
+
+size_t PrefetcherPool::idle() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pooled.size();
+}
+
+void PrefetcherPool::release(std::unique_ptr<ObjectPrefetcher> prefetcher) {
+    // Whatever the last walk queued but never took would only hold budget.
+    prefetcher->cancel_all();
+    std::lock_guard<std::mutex> lock(mutex);
+    pooled.push_back(std::move(prefetcher));
+}
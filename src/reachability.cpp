@@ -0,0 +1,486 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "reachability.h"
+#include "binaryIO.h"
+#include "ewah.h"
+#include "object.h"
+#include "gitCommit.h"
+#include "gitTree.h"
+#include "prefetch.h"
+
+namespace {
+
+// File layout, all integers big-endian:
+//   "RBMP", version, object count N, bitmap count M
+//   N x (20-byte id, 1-byte type)      objects in bit order
+//   N x u32                            bit positions sorted by id
+//   M x (20-byte id, u64 offset)       bitmapped commits sorted by id
+//   M x EWAH bitmap
+//   SHA-1 of everything above
+constexpr char file_magic[4] = {'R', 'B', 'M', 'P'};
+constexpr uint32_t file_version = 1;
+constexpr size_t header_size = 16;
+constexpr size_t object_record = 21;
+constexpr size_t commit_record = 28;
+
+enum ObjectKind : unsigned char {
+    KIND_COMMIT = 1,
+    KIND_TREE = 2,
+    KIND_BLOB = 3
+};
+
+// Object numbering plus stored bitmaps, either mapped from disk or being
+// built in memory by the writer.
+class BitmapIndex {
+public:
+    virtual ~BitmapIndex() = default;
+    virtual size_t size() const = 0;
+    virtual std::optional<uint32_t> position(const std::string &sha) const = 0;
+    // ORs commit's stored bitmap into bits; false if it has none.
+    virtual bool or_bitmap(const std::string &commit, std::vector<uint64_t> &bits) const = 0;
+    virtual std::string object_at(uint32_t pos, unsigned char &kind) const = 0;
+};
+
+class MappedBitmapIndex : public BitmapIndex {
+public:
+    // Null if there is no bitmap file at path.
+    static std::unique_ptr<MappedBitmapIndex> open(const fs::path &path) {
+        std::error_code ec;
+        if (!fs::exists(path, ec)) {
+            return nullptr;
+        }
+        std::unique_ptr<MappedBitmapIndex> index(new MappedBitmapIndex(path));
+        const unsigned char *data = index->file.data;
+        if (std::memcmp(data, file_magic, 4) != 0 || read_be(data + 4, 4) != file_version) {
+            throw std::runtime_error("Invalid reachability bitmap file: " + path.string());
+        }
+        index->objects = read_be(data + 8, 4);
+        index->commits = read_be(data + 12, 4);
+        index->lookup = header_size + index->objects * object_record;
+        index->commit_table = index->lookup + index->objects * 4;
+        if (index->commit_table + index->commits * commit_record + 20 > index->file.size) {
+            throw std::runtime_error("Truncated reachability bitmap file: " + path.string());
+        }
+        return index;
+    }
+
+    size_t size() const override {
+        return objects;
+    }
+    std::optional<uint32_t> position(const std::string &sha) const override {
+        std::string key = hex_to_bytes(sha);
+        size_t lo = 0;
+        size_t hi = objects;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            uint32_t pos = read_be(file.data + lookup + mid * 4, 4);
+            if (pos >= objects) {
+                throw std::runtime_error("Corrupt reachability bitmap: bad object position");
+            }
+            int cmp = std::memcmp(file.data + header_size + size_t(pos) * object_record, key.data(), 20);
+            if (cmp == 0) {
+                return pos;
+            }
+            if (cmp < 0) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+        return std::nullopt;
+    }
+    bool or_bitmap(const std::string &commit, std::vector<uint64_t> &bits) const override {
+        std::string key = hex_to_bytes(commit);
+        size_t lo = 0;
+        size_t hi = commits;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            const unsigned char *record = file.data + commit_table + mid * commit_record;
+            int cmp = std::memcmp(record, key.data(), 20);
+            if (cmp == 0) {
+                size_t offset = read_be(record + 20, 8);
+                if (offset < commit_table + commits * commit_record || offset >= file.size - 20) {
+                    throw std::runtime_error("Corrupt reachability bitmap");
+                }
+                size_t used = 0;
+                EwahBitmap::deserialize(file.data + offset, file.size - 20 - offset, used).or_into(bits);
+                return true;
+            }
+            if (cmp < 0) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+        return false;
+    }
+    std::string object_at(uint32_t pos, unsigned char &kind) const override {
+        if (pos >= objects) {
+            throw std::runtime_error("Corrupt reachability bitmap: bad object position");
+        }
+        const unsigned char *record = file.data + header_size + size_t(pos) * object_record;
+        kind = record[20];
+        return to_hex(record, 20);
+    }
+private:
+    explicit MappedBitmapIndex(const fs::path &path) : file(path, header_size + 20, "reachability bitmap file") {}
+
+    MappedFile file;
+    size_t objects = 0;
+    size_t commits = 0;
+    size_t lookup = 0;
+    size_t commit_table = 0;
+};
+
+class MemoryBitmapIndex : public BitmapIndex {
+public:
+    uint32_t add(const std::string &sha, unsigned char kind) {
+        auto [it, inserted] = positions.emplace(sha, order.size());
+        if (inserted) {
+            order.emplace_back(sha, kind);
+        }
+        return it->second;
+    }
+    bool contains(const std::string &sha) const {
+        return positions.count(sha) > 0;
+    }
+    size_t size() const override {
+        return order.size();
+    }
+    std::optional<uint32_t> position(const std::string &sha) const override {
+        auto it = positions.find(sha);
+        if (it == positions.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+    bool or_bitmap(const std::string &commit, std::vector<uint64_t> &bits) const override {
+        auto it = bitmaps.find(commit);
+        if (it == bitmaps.end()) {
+            return false;
+        }
+        it->second.or_into(bits);
+        return true;
+    }
+    std::string object_at(uint32_t pos, unsigned char &kind) const override {
+        kind = order[pos].second;
+        return order[pos].first;
+    }
+
+    std::unordered_map<std::string, uint32_t> positions;
+    std::vector<std::pair<std::string, unsigned char>> order;
+    std::unordered_map<std::string, EwahBitmap> bitmaps;
+};
+
+std::shared_ptr<GitCommit> load_commit(ObjectPrefetcher &prefetcher, const std::string &sha) {
+    return object_as<GitCommit>(prefetcher.get(sha), sha);
+}
+
+std::string peel_to_commit(const GitRepository &repo, std::string sha) {
+    for (int depth = 0; depth < 8; ++depth) {
+        std::string type = read_object_header(repo, sha).type;
+        if (type == "commit") {
+            return sha;
+        }
+        if (type != "tag") {
+            throw std::runtime_error("Not a commit: " + sha);
+        }
+        std::vector<unsigned char> raw = read_raw_object(repo, sha);
+        std::string text(raw.begin(), raw.end());
+        size_t body = text.find('\0') + 1;
+        if (text.compare(body, 7, "object ") != 0) {
+            throw std::runtime_error("Malformed tag: " + sha);
+        }
+        sha = text.substr(body + 7, 40);
+    }
+    throw std::runtime_error("Tag chain too deep: " + sha);
+}
+
+// Marks everything reachable from the commits it is given. Objects the
+// index numbers go into `bits`; anything newer than the index goes into
+// `extra`, in discovery order and with its path.
+class ReachWalk {
+public:
+    struct Extra {
+        std::string sha;
+        unsigned char kind;
+        std::string path;
+    };
+
+    ReachWalk(ObjectPrefetcher &prefetcher, const BitmapIndex *index, bool objects)
+        : prefetcher(prefetcher), index(index), objects(objects) {
+        if (index) {
+            bits.resize((index->size() + 63) / 64);
+        }
+    }
+
+    // Seeds the walk with another walk's marks, so nothing already reached
+    // there is walked again (used for exclusions).
+    void seed(const ReachWalk &other) {
+        bits = other.bits;
+        seen = other.seen;
+    }
+
+    void walk(const std::string &tip) {
+        std::vector<std::string> stack{tip};
+        while (!stack.empty()) {
+            std::string sha = std::move(stack.back());
+            stack.pop_back();
+            auto pos = index ? index->position(sha) : std::nullopt;
+            if (pos && test(*pos)) {
+                continue;
+            }
+            if (index && index->or_bitmap(sha, bits)) {
+                continue;
+            }
+            if (!mark(sha, pos, KIND_COMMIT, "")) {
+                continue;
+            }
+            auto commit = load_commit(prefetcher, sha);
+            auto parents = commit->get_value("parent");
+            prefetcher.prefetch(parents);
+            stack.insert(stack.end(), parents.rbegin(), parents.rend());
+            if (objects) {
+                walk_tree(commit_tree(*commit), "");
+            }
+        }
+    }
+
+    std::vector<uint64_t> bits;
+    std::vector<Extra> extra;
+private:
+    bool test(uint32_t pos) const {
+        return (bits[pos / 64] >> (pos % 64)) & 1;
+    }
+    bool mark(const std::string &sha, std::optional<uint32_t> pos, unsigned char kind, const std::string &path) {
+        if (pos) {
+            if (test(*pos)) {
+                return false;
+            }
+            bits[*pos / 64] |= uint64_t(1) << (*pos % 64);
+            return true;
+        }
+        if (!seen.insert(sha).second) {
+            return false;
+        }
+        extra.push_back({sha, kind, path});
+        return true;
+    }
+    void walk_tree(const std::string &sha, const std::string &path) {
+        if (!mark(sha, index ? index->position(sha) : std::nullopt, KIND_TREE, path)) {
+            return;
+        }
+        auto tree = object_as<GitTree>(prefetcher.get(sha), sha);
+        const auto &entries = tree->get_entries();
+        std::vector<std::string> subtrees;
+        for (const auto &entry : entries) {
+            if (entry.mode == "40000") {
+                subtrees.push_back(entry.sha);
+            }
+        }
+        prefetcher.prefetch(subtrees);
+        for (const auto &entry : entries) {
+            std::string child = path.empty() ? entry.path : path + "/" + entry.path;
+            if (entry.mode == "40000") {
+                walk_tree(entry.sha, child);
+            }
+            else if (entry.mode != "160000") {
+                mark(entry.sha, index ? index->position(entry.sha) : std::nullopt, KIND_BLOB, child);
+            }
+        }
+    }
+
+    ObjectPrefetcher &prefetcher;
+    const BitmapIndex *index;
+    bool objects;
+    std::unordered_set<std::string> seen;
+};
+
+void number_tree(ObjectPrefetcher &prefetcher, MemoryBitmapIndex &index, const std::string &sha) {
+    if (index.contains(sha)) {
+        return;
+    }
+    index.add(sha, KIND_TREE);
+    auto tree = object_as<GitTree>(prefetcher.get(sha), sha);
+    for (const auto &entry : tree->get_entries()) {
+        if (entry.mode == "40000") {
+            number_tree(prefetcher, index, entry.sha);
+        }
+        else if (entry.mode != "160000") {
+            index.add(entry.sha, KIND_BLOB);
+        }
+    }
+}
+
+}
+
+fs::path reachability_bitmap_path(const GitRepository &repo) {
+    return repo.get_gitdir() / "objects" / "info" / "reachability.bitmap";
+}
+
+size_t rev_list(const GitRepository &repo, const std::vector<std::string> &include,
+                const std::vector<std::string> &exclude, const RevListOptions &options,
+                const std::function<void(const std::string &sha, const std::string &path)> &visit) {
+    std::unique_ptr<MappedBitmapIndex> index;
+    if (options.use_bitmaps) {
+        index = MappedBitmapIndex::open(reachability_bitmap_path(repo));
+    }
+    auto lease = repo.prefetchers().acquire();
+    ObjectPrefetcher &prefetcher = *lease;
+
+    ReachWalk excluded(prefetcher, index.get(), options.objects);
+    for (const auto &sha : exclude) {
+        excluded.walk(peel_to_commit(repo, sha));
+    }
+    ReachWalk included(prefetcher, index.get(), options.objects);
+    included.seed(excluded);
+    for (const auto &sha : include) {
+        included.walk(peel_to_commit(repo, sha));
+    }
+
+    size_t count = 0;
+    for (bool commits : {true, false}) {
+        if (!commits && !options.objects) {
+            break;
+        }
+        for (size_t word = 0; word < included.bits.size(); ++word) {
+            uint64_t fresh = included.bits[word] & ~excluded.bits[word];
+            while (fresh) {
+                size_t pos = word * 64 + __builtin_ctzll(fresh);
+                fresh &= fresh - 1;
+                if (pos >= index->size()) {
+                    break;
+                }
+                unsigned char kind;
+                std::string sha = index->object_at(pos, kind);
+                if ((kind == KIND_COMMIT) != commits) {
+                    continue;
+                }
+                ++count;
+                if (visit) {
+                    visit(sha, "");
+                }
+            }
+        }
+        for (const auto &object : included.extra) {
+            if ((object.kind == KIND_COMMIT) != commits) {
+                continue;
+            }
+            ++count;
+            if (visit) {
+                visit(object.sha, object.path);
+            }
+        }
+    }
+    return count;
+}
+
+BitmapWriteStats write_reachability_bitmaps(const GitRepository &repo, const std::vector<std::string> &tips,
+                                            size_t every) {
+    auto lease = repo.prefetchers().acquire();
+    ObjectPrefetcher &prefetcher = *lease;
+    std::vector<std::string> commits;
+    std::unordered_set<std::string> tip_set;
+    for (const auto &tip : tips) {
+        tip_set.insert(peel_to_commit(repo, tip));
+    }
+
+    // Post-order over the commit graph: every parent before its children.
+    {
+        std::unordered_set<std::string> visited;
+        std::vector<std::pair<std::string, bool>> stack;
+        for (const auto &tip : tip_set) {
+            stack.emplace_back(tip, false);
+        }
+        while (!stack.empty()) {
+            auto [sha, expanded] = stack.back();
+            stack.pop_back();
+            if (expanded) {
+                commits.push_back(sha);
+                continue;
+            }
+            if (!visited.insert(sha).second) {
+                continue;
+            }
+            stack.emplace_back(sha, true);
+            for (const auto &parent : load_commit(prefetcher, sha)->get_value("parent")) {
+                if (!visited.count(parent)) {
+                    stack.emplace_back(parent, false);
+                }
+            }
+        }
+    }
+
+    MemoryBitmapIndex index;
+    for (const auto &sha : commits) {
+        index.add(sha, KIND_COMMIT);
+        number_tree(prefetcher, index, commit_tree(*load_commit(prefetcher, sha)));
+    }
+
+    // Ancestors first, so each walk stops at the nearest bitmapped commit.
+    std::vector<std::string> selected;
+    for (size_t i = 0; i < commits.size(); ++i) {
+        if (tip_set.count(commits[i]) || (every && i % every == every - 1)) {
+            ReachWalk walk(prefetcher, &index, true);
+            walk.walk(commits[i]);
+            index.bitmaps.emplace(commits[i], EwahBitmap::compress(walk.bits, index.size()));
+            selected.push_back(commits[i]);
+        }
+    }
+    std::sort(selected.begin(), selected.end());
+
+    std::string out(file_magic, 4);
+    put_be(out, file_version, 4);
+    put_be(out, index.size(), 4);
+    put_be(out, selected.size(), 4);
+    std::vector<uint32_t> by_id(index.size());
+    for (uint32_t pos = 0; pos < index.size(); ++pos) {
+        out += hex_to_bytes(index.order[pos].first);
+        out += static_cast<char>(index.order[pos].second);
+        by_id[pos] = pos;
+    }
+    std::sort(by_id.begin(), by_id.end(), [&](uint32_t a, uint32_t b) {
+        return index.order[a].first < index.order[b].first;
+    });
+    for (uint32_t pos : by_id) {
+        put_be(out, pos, 4);
+    }
+    size_t data_offset = out.size() + selected.size() * commit_record;
+    std::string data;
+    for (const auto &sha : selected) {
+        out += hex_to_bytes(sha);
+        put_be(out, data_offset + data.size(), 8);
+        index.bitmaps.at(sha).serialize(data);
+    }
+    out += data;
+    SHA1 hasher;
+    hasher.update(out);
+    out += hex_to_bytes(hasher.final());
+
+    fs::path path = reachability_bitmap_path(repo);
+    fs::create_directories(path.parent_path());
+    fs::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        file.write(out.data(), out.size());
+        if (!file) {
+            throw std::runtime_error("Failed to write " + tmp.string());
+        }
+    }
+    fs::rename(tmp, path);
+
+    BitmapWriteStats stats;
+    stats.objects = index.size();
+    stats.commits = selected.size();
+    stats.bytes = out.size();
+    return stats;
+}
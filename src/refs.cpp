@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "refs.h"
+
+namespace {
+
+constexpr int max_symref_depth = 5;
+
+bool is_hex_sha(std::string_view s) {
+    return s.size() == 40 && std::all_of(s.begin(), s.end(), [](char c) {
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+    });
+}
+
+// Rejects names that would escape the git dir when used as a path.
+bool is_safe_refname(const std::string &name) {
+    if (name.empty() || name.front() == '/' || name.back() == '/') {
+        return false;
+    }
+    size_t start = 0;
+    while (start <= name.size()) {
+        size_t end = name.find('/', start);
+        if (end == std::string::npos) {
+            end = name.size();
+        }
+        std::string_view part(name.data() + start, end - start);
+        if (part.empty() || part == "." || part == "..") {
+            return false;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+}
+
+RefStore::RefStore(const GitRepository &repo) : repo(repo) {
+    fs::path path = repo.get_gitdir() / "packed-refs";
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            packed = static_cast<const char *>(map);
+            packed_size = st.st_size;
+        }
+    }
+    ::close(fd);
+    if (!packed) {
+        return;
+    }
+
+    bool sorted = false;
+    if (packed_size > 0 && packed[0] == '#') {
+        auto eol = static_cast<const char *>(std::memchr(packed, '\n', packed_size));
+        packed_begin = eol ? eol - packed + 1 : packed_size;
+        std::string_view header(packed, packed_begin);
+        sorted = header.rfind("# pack-refs with:", 0) == 0 && header.find(" sorted") != std::string_view::npos;
+    }
+    if (!sorted) {
+        // Written by an old git: index the records once so lookups can
+        // still binary-search.
+        for (size_t pos = packed_begin; pos < packed_size; pos = packed_record(pos).next) {
+            packed_index.push_back(pos);
+        }
+        std::sort(packed_index.begin(), packed_index.end(), [this](size_t a, size_t b) {
+            return packed_record(a).name < packed_record(b).name;
+        });
+    }
+}
+
+RefStore::~RefStore() {
+    if (packed) {
+        ::munmap(const_cast<char *>(packed), packed_size);
+    }
+}
+
+RefStore::PackedRecord RefStore::packed_record(size_t pos) const {
+    auto eol = static_cast<const char *>(std::memchr(packed + pos, '\n', packed_size - pos));
+    size_t end = eol ? eol - packed : packed_size;
+    std::string_view line(packed + pos, end - pos);
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    if (line.size() < 42 || line[40] != ' ') {
+        throw std::runtime_error("Malformed packed-refs line: " + std::string(line));
+    }
+    PackedRecord record{line.substr(41), line.substr(0, 40), std::min(end + 1, packed_size)};
+    // Skip the peeled "^<sha>" line that follows an annotated tag.
+    while (record.next < packed_size && packed[record.next] == '^') {
+        auto peeled_eol = static_cast<const char *>(std::memchr(packed + record.next, '\n', packed_size - record.next));
+        record.next = peeled_eol ? peeled_eol - packed + 1 : packed_size;
+    }
+    return record;
+}
+
+void RefStore::scan_packed(std::string_view from, const std::function<bool(const PackedRecord &)> &visit) const {
+    if (!packed) {
+        return;
+    }
+    if (!packed_index.empty() || packed_begin == packed_size) {
+        auto it = std::lower_bound(packed_index.begin(), packed_index.end(), from, [this](size_t pos, std::string_view name) {
+            return packed_record(pos).name < name;
+        });
+        for (; it != packed_index.end(); ++it) {
+            if (!visit(packed_record(*it))) {
+                return;
+            }
+        }
+        return;
+    }
+
+    // Binary search over byte offsets: land anywhere, back up to the start
+    // of that record, and compare. lo and hi always sit on record starts.
+    size_t lo = packed_begin;
+    size_t hi = packed_size;
+    while (lo < hi) {
+        size_t pos = lo + (hi - lo) / 2;
+        while (pos > lo && packed[pos - 1] != '\n') {
+            --pos;
+        }
+        if (packed[pos] == '^') {
+            do {
+                --pos;
+            } while (pos > lo && packed[pos - 1] != '\n');
+        }
+        PackedRecord record = packed_record(pos);
+        if (record.name < from) {
+            lo = record.next;
+        }
+        else {
+            hi = pos;
+        }
+    }
+    for (size_t pos = lo; pos < packed_size;) {
+        PackedRecord record = packed_record(pos);
+        if (!visit(record)) {
+            return;
+        }
+        pos = record.next;
+    }
+}
+
+std::optional<std::string> RefStore::read_loose(const std::string &refname, std::string &symref) const {
+    symref.clear();
+    if (!is_safe_refname(refname)) {
+        return std::nullopt;
+    }
+    fs::path path = repo.get_gitdir() / refname;
+    std::error_code ec;
+    if (!fs::is_regular_file(path, ec)) {
+        return std::nullopt;
+    }
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    while (!line.empty() && std::isspace(static_cast<unsigned char>(line.back()))) {
+        line.pop_back();
+    }
+    if (line.rfind("ref: ", 0) == 0) {
+        symref = line.substr(5);
+        return std::nullopt;
+    }
+    if (!is_hex_sha(line)) {
+        return std::nullopt;
+    }
+    return line;
+}
+
+std::optional<std::string> RefStore::read_packed(const std::string &refname) const {
+    std::optional<std::string> sha;
+    scan_packed(refname, [&](const PackedRecord &record) {
+        if (record.name == refname) {
+            sha = std::string(record.sha);
+        }
+        return false;
+    });
+    return sha;
+}
+
+std::optional<std::string> RefStore::read(const std::string &refname) const {
+    std::string name = refname;
+    std::string symref;
+    for (int depth = 0; depth < max_symref_depth; ++depth) {
+        if (auto sha = read_loose(name, symref)) {
+            return sha;
+        }
+        if (symref.empty()) {
+            return read_packed(name);
+        }
+        name = symref;
+    }
+    return std::nullopt;
+}
+
+std::optional<std::string> RefStore::resolve(const std::string &name) const {
+    for (const char *rule : {"%s", "refs/%s", "refs/tags/%s", "refs/heads/%s", "refs/remotes/%s", "refs/remotes/%s/HEAD"}) {
+        std::string candidate(rule);
+        candidate.replace(candidate.find("%s"), 2, name);
+        if (auto sha = read(candidate)) {
+            return sha;
+        }
+    }
+    return std::nullopt;
+}
+
+void RefStore::for_each(const std::function<void(const std::string &, const std::string &)> &visit,
+                        const std::string &prefix) const {
+    // Loose refs are few next to a packed mirror, so they are listed up
+    // front and merged into the packed stream.
+    std::vector<std::string> loose;
+    fs::path root = repo.get_gitdir() / "refs";
+    std::error_code ec;
+    if (fs::is_directory(root, ec)) {
+        for (auto it = fs::recursive_directory_iterator(root, ec); it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            if (ec) {
+                break;
+            }
+            if (it->is_regular_file(ec)) {
+                std::string name = "refs/" + fs::relative(it->path(), root).generic_string();
+                if (name.rfind(prefix, 0) == 0) {
+                    loose.push_back(std::move(name));
+                }
+            }
+        }
+    }
+    std::sort(loose.begin(), loose.end());
+
+    auto next_loose = loose.begin();
+    auto emit_loose = [&]() {
+        if (auto sha = read(*next_loose)) {
+            visit(*next_loose, *sha);
+        }
+        ++next_loose;
+    };
+    scan_packed(prefix, [&](const PackedRecord &record) {
+        if (record.name.substr(0, prefix.size()) != prefix) {
+            return false;
+        }
+        while (next_loose != loose.end() && *next_loose < record.name) {
+            emit_loose();
+        }
+        if (next_loose != loose.end() && *next_loose == record.name) {
+            // The loose copy is newer than the packed one.
+            emit_loose();
+        }
+        else {
+            visit(std::string(record.name), std::string(record.sha));
+        }
+        return true;
+    });
+    while (next_loose != loose.end()) {
+        emit_loose();
+    }
+}
@@ -6,11 +6,11 @@
 
 #include "repository.h"
 #include "configParser.h"
+#include "pack.h"
+#include "prefetch.h"
 
 namespace fs = std::filesystem;
 
-ConfigParser GitRepository::config;
-
 GitRepository::GitRepository(const fs::path& path, bool force) {
     worktree = path;
     gitdir = path / ".git";
@@ -32,8 +32,37 @@ GitRepository::GitRepository(const fs::path& path, bool force) {
             throw std::runtime_error("Unsupported repository format version: " + version);
         }
     }
+    size_t cache_size = ObjectCache::default_capacity;
+    std::string configured = config.get("core", "objectcachesize", "");
+    if (!configured.empty()) {
+        cache_size = std::stoull(configured);
+    }
+    cache = std::make_shared<ObjectCache>(cache_size);
+    pack_store = std::make_shared<PackStore>(gitdir / "objects" / "pack");
+    prefetch_pool = std::make_unique<PrefetcherPool>(*this);
+}
+
+GitRepository::GitRepository(const GitRepository &other)
+    : config(other.config), worktree(other.worktree), gitdir(other.gitdir), configFile(other.configFile),
+      cache(other.cache), pack_store(other.pack_store), prefetch_pool(std::make_unique<PrefetcherPool>(*this)) {
+}
+
+GitRepository &GitRepository::operator=(const GitRepository &other) {
+    if (this != &other) {
+        // Pooled prefetchers were made for the old config.
+        prefetch_pool = std::make_unique<PrefetcherPool>(*this);
+        config = other.config;
+        worktree = other.worktree;
+        gitdir = other.gitdir;
+        configFile = other.configFile;
+        cache = other.cache;
+        pack_store = other.pack_store;
+    }
+    return *this;
 }
 
+GitRepository::~GitRepository() = default;
+
 
 fs::path GitRepository::repo_dir(const GitRepository& repo, const fs::path& subpath, bool mkdir) {
     fs::path dir = repo.gitdir / subpath;
@@ -0,0 +1,438 @@
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "threadPool.h"
+
+namespace {
+
+// epoll tags for the non-connection descriptors; connection ids start above.
+constexpr uint64_t listen_tag = 0;
+constexpr uint64_t wakeup_tag = 1;
+constexpr uint64_t signal_tag = 2;
+constexpr uint32_t max_frame = 64 << 20;
+
+void put_u32(std::string &buf, uint32_t value) {
+    buf.push_back(static_cast<char>(value >> 24));
+    buf.push_back(static_cast<char>(value >> 16));
+    buf.push_back(static_cast<char>(value >> 8));
+    buf.push_back(static_cast<char>(value));
+}
+
+uint32_t get_u32(const char *p) {
+    auto b = reinterpret_cast<const unsigned char *>(p);
+    return (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | uint32_t(b[3]);
+}
+
+std::string frame(const std::string &payload) {
+    std::string buf;
+    buf.reserve(payload.size() + 4);
+    put_u32(buf, payload.size());
+    buf += payload;
+    return buf;
+}
+
+std::vector<std::string> split_args(const std::string &payload) {
+    std::vector<std::string> args;
+    size_t start = 0;
+    while (start <= payload.size()) {
+        size_t end = payload.find('\0', start);
+        if (end == std::string::npos) {
+            end = payload.size();
+        }
+        args.push_back(payload.substr(start, end - start));
+        start = end + 1;
+    }
+    return args;
+}
+
+// Sockets are written with send(MSG_NOSIGNAL): a peer that hangs up must
+// surface as EPIPE, not a SIGPIPE that kills the process.
+void write_all(int fd, const std::string &buf) {
+    size_t off = 0;
+    while (off < buf.size()) {
+        ssize_t n = ::send(fd, buf.data() + off, buf.size() - off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("socket write failed: ") + std::strerror(errno));
+        }
+        off += n;
+    }
+}
+
+void read_exact(int fd, char *buf, size_t len) {
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = ::read(fd, buf + off, len - off);
+        if (n == 0) {
+            throw std::runtime_error("server closed the connection");
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("socket read failed: ") + std::strerror(errno));
+        }
+        off += n;
+    }
+}
+
+sockaddr_un socket_address(const fs::path &path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::string p = path.string();
+    if (p.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + p);
+    }
+    std::memcpy(addr.sun_path, p.c_str(), p.size() + 1);
+    return addr;
+}
+
+}
+
+struct ObjectServer::Connection {
+    int fd = -1;
+    std::string in;
+    std::string out;
+    bool busy = false;
+    bool closed = false;
+    // The client shut down its side; replies still owed are written first.
+    bool eof = false;
+    bool watched = false;
+};
+
+ObjectServer::ObjectServer(const fs::path &socket_path, RequestHandler handler, size_t workers)
+    : socket_path(socket_path), handler(std::move(handler)), workers(workers) {
+    if (fs::is_socket(socket_path)) {
+        fs::remove(socket_path);
+    }
+    listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        throw std::runtime_error(std::string("socket failed: ") + std::strerror(errno));
+    }
+    sockaddr_un addr = socket_address(socket_path);
+    if (::bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || ::listen(listen_fd, 128) < 0) {
+        int saved = errno;
+        ::close(listen_fd);
+        throw std::runtime_error("Cannot listen on " + socket_path.string() + ": " + std::strerror(saved));
+    }
+}
+
+ObjectServer::~ObjectServer() {
+    if (listen_fd >= 0) {
+        ::close(listen_fd);
+        std::error_code ec;
+        fs::remove(socket_path, ec);
+    }
+}
+
+void ObjectServer::run() {
+    // Block the shutdown signals before the pool starts so only the
+    // signalfd ever sees them.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigset_t previous;
+    pthread_sigmask(SIG_BLOCK, &signals, &previous);
+    int signal_fd = ::signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    int wakeup_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (signal_fd < 0 || wakeup_fd < 0 || epoll_fd < 0) {
+        throw std::runtime_error(std::string("Cannot set up event loop: ") + std::strerror(errno));
+    }
+
+    auto watch = [&](int fd, uint64_t tag, uint32_t events, int op) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.u64 = tag;
+        ::epoll_ctl(epoll_fd, op, fd, &ev);
+    };
+    watch(listen_fd, listen_tag, EPOLLIN, EPOLL_CTL_ADD);
+    watch(wakeup_fd, wakeup_tag, EPOLLIN, EPOLL_CTL_ADD);
+    watch(signal_fd, signal_tag, EPOLLIN, EPOLL_CTL_ADD);
+
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections;
+    uint64_t next_id = signal_tag + 1;
+    std::mutex done_mutex;
+    std::deque<std::pair<uint64_t, std::string>> done;
+
+    {
+        ThreadPool pool(workers);
+
+        auto open = [&](uint64_t id) {
+            auto it = connections.find(id);
+            return it != connections.end() && !it->second->closed;
+        };
+
+        auto close_connection = [&](uint64_t id) {
+            auto &conn = connections.at(id);
+            if (conn->watched) {
+                ::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+            }
+            ::close(conn->fd);
+            conn->closed = true;
+            if (!conn->busy) {
+                connections.erase(id);
+            }
+        };
+
+        auto flush = [&](uint64_t id) {
+            auto &conn = *connections.at(id);
+            size_t off = 0;
+            while (off < conn.out.size()) {
+                ssize_t n = ::send(conn.fd, conn.out.data() + off, conn.out.size() - off, MSG_NOSIGNAL);
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    if (errno == EAGAIN) {
+                        break;
+                    }
+                    // EPIPE, ECONNRESET, ...: only this client is gone.
+                    conn.out.clear();
+                    close_connection(id);
+                    return;
+                }
+                off += n;
+            }
+            conn.out.erase(0, off);
+        };
+
+        // Re-arms a connection after its buffers changed. Once the client has
+        // shut down its side the socket stays readable (or hung up) for good,
+        // so it is only watched while a reply is waiting to be written, and
+        // closed when nothing more is owed.
+        auto settle = [&](uint64_t id) {
+            auto &conn = *connections.at(id);
+            if (conn.eof && !conn.busy && conn.out.empty()) {
+                close_connection(id);
+                return;
+            }
+            uint32_t events = conn.eof ? 0 : EPOLLIN;
+            if (!conn.out.empty()) {
+                events |= EPOLLOUT;
+            }
+            if (events == 0) {
+                if (conn.watched) {
+                    ::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn.fd, nullptr);
+                    conn.watched = false;
+                }
+                return;
+            }
+            watch(conn.fd, id, events, conn.watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD);
+            conn.watched = true;
+        };
+
+        auto dispatch = [&](uint64_t id) {
+            auto &conn = *connections.at(id);
+            if (conn.busy || conn.in.size() < 4) {
+                return;
+            }
+            uint32_t len = get_u32(conn.in.data());
+            if (len > max_frame) {
+                close_connection(id);
+                return;
+            }
+            if (conn.in.size() < 4 + size_t(len)) {
+                return;
+            }
+            std::string payload = conn.in.substr(4, len);
+            conn.in.erase(0, 4 + size_t(len));
+            conn.busy = true;
+            pool.submit([&, id, payload = std::move(payload)]() {
+                std::ostringstream out;
+                std::ostringstream err;
+                int status = 1;
+                try {
+                    std::vector<std::string> args = split_args(payload);
+                    args.insert(args.begin(), "git_cli");
+                    status = handler(args, out, err);
+                }
+                catch (const std::exception &e) {
+                    err << "Error: " << e.what() << "\n";
+                }
+                std::string out_str = out.str();
+                std::string err_str = err.str();
+                // The client rejects frames over max_frame, so an oversized
+                // reply becomes an error instead.
+                if (5 + out_str.size() + err_str.size() > max_frame) {
+                    err_str = "Error: reply of " + std::to_string(out_str.size() + err_str.size()) +
+                              " bytes exceeds the " + std::to_string(max_frame >> 20) + " MiB frame limit\n";
+                    out_str.clear();
+                    status = 1;
+                }
+                std::string body(1, static_cast<char>(status & 0xff));
+                put_u32(body, out_str.size());
+                body += out_str;
+                body += err_str;
+                {
+                    std::lock_guard<std::mutex> lock(done_mutex);
+                    done.emplace_back(id, frame(body));
+                }
+                uint64_t one = 1;
+                [[maybe_unused]] ssize_t n = ::write(wakeup_fd, &one, sizeof(one));
+            });
+        };
+
+        bool running = true;
+        epoll_event events[64];
+        while (running) {
+            int n = ::epoll_wait(epoll_fd, events, 64, -1);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            for (int i = 0; i < n; ++i) {
+                uint64_t tag = events[i].data.u64;
+                if (tag == signal_tag) {
+                    signalfd_siginfo info;
+                    [[maybe_unused]] ssize_t r = ::read(signal_fd, &info, sizeof(info));
+                    running = false;
+                }
+                else if (tag == listen_tag) {
+                    int fd;
+                    while ((fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                        uint64_t id = next_id++;
+                        auto conn = std::make_unique<Connection>();
+                        conn->fd = fd;
+                        conn->watched = true;
+                        connections[id] = std::move(conn);
+                        watch(fd, id, EPOLLIN, EPOLL_CTL_ADD);
+                    }
+                }
+                else if (tag == wakeup_tag) {
+                    uint64_t count;
+                    [[maybe_unused]] ssize_t r = ::read(wakeup_fd, &count, sizeof(count));
+                    std::deque<std::pair<uint64_t, std::string>> ready;
+                    {
+                        std::lock_guard<std::mutex> lock(done_mutex);
+                        ready.swap(done);
+                    }
+                    for (auto &[id, response] : ready) {
+                        auto &conn = *connections.at(id);
+                        conn.busy = false;
+                        if (conn.closed) {
+                            connections.erase(id);
+                            continue;
+                        }
+                        conn.out += response;
+                        flush(id);
+                        if (open(id)) {
+                            dispatch(id);
+                        }
+                        if (open(id)) {
+                            settle(id);
+                        }
+                    }
+                }
+                else if (open(tag)) {
+                    if (events[i].events & EPOLLOUT) {
+                        flush(tag);
+                    }
+                    if (open(tag) && !connections.at(tag)->eof &&
+                        (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                        auto &conn = *connections.at(tag);
+                        char buf[16384];
+                        while (true) {
+                            ssize_t r = ::read(conn.fd, buf, sizeof(buf));
+                            if (r > 0) {
+                                conn.in.append(buf, r);
+                                continue;
+                            }
+                            if (r < 0 && errno == EINTR) {
+                                continue;
+                            }
+                            // A client that sends a request and then shuts
+                            // down its side still gets the reply.
+                            conn.eof = r == 0 || errno != EAGAIN;
+                            break;
+                        }
+                        dispatch(tag);
+                    }
+                    if (open(tag)) {
+                        settle(tag);
+                    }
+                }
+            }
+        }
+        // Pool joins here, after in-flight requests finish.
+    }
+
+    for (auto &[id, conn] : connections) {
+        if (!conn->closed) {
+            ::close(conn->fd);
+        }
+    }
+    ::close(epoll_fd);
+    ::close(wakeup_fd);
+    ::close(signal_fd);
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+}
+
+ServerClient::ServerClient(const fs::path &socket_path) {
+    fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("socket failed: ") + std::strerror(errno));
+    }
+    sockaddr_un addr = socket_address(socket_path);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+        int saved = errno;
+        ::close(fd);
+        throw std::runtime_error("Cannot connect to " + socket_path.string() + ": " + std::strerror(saved));
+    }
+}
+
+ServerClient::~ServerClient() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+ServerResponse ServerClient::request(const std::vector<std::string> &args) {
+    std::string payload;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (i) {
+            payload.push_back('\0');
+        }
+        payload += args[i];
+    }
+    write_all(fd, frame(payload));
+
+    char header[4];
+    read_exact(fd, header, 4);
+    uint32_t len = get_u32(header);
+    if (len < 5 || len > max_frame) {
+        throw std::runtime_error("Malformed server response");
+    }
+    std::string body(len, '\0');
+    read_exact(fd, body.data(), len);
+    uint32_t out_len = get_u32(body.data() + 1);
+    if (5 + size_t(out_len) > body.size()) {
+        throw std::runtime_error("Malformed server response");
+    }
+    ServerResponse response;
+    response.status = static_cast<unsigned char>(body[0]);
+    response.out = body.substr(5, out_len);
+    response.err = body.substr(5 + out_len);
+    return response;
+}
@@ -0,0 +1,184 @@
+#include "threadPool.h"
+
+size_t ThreadPool::default_threads() {
+    size_t n = std::thread::hardware_concurrency();
+    return n ? n : 4;
+}
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) {
+        threads = default_threads();
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back(&ThreadPool::worker_loop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    task_ready.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    task_ready.notify_one();
+}
+
+void ThreadPool::wait_idle() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this]() { return tasks.empty() && running == 0; });
+}
+
+void ThreadPool::worker_loop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            task_ready.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (tasks.empty()) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+            ++running;
+        }
+        task();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --running;
+            if (tasks.empty() && running == 0) {
+                idle.notify_all();
+            }
+        }
+    }
+}
+
+namespace {
+
+// The pool and worker the current thread is running tasks for, if any.
+thread_local WorkStealingPool *current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+}
+
+WorkStealingPool::WorkStealingPool(size_t threads) {
+    if (threads == 0) {
+        threads = ThreadPool::default_threads();
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+}
+
+void WorkStealingPool::push(size_t worker, Task task) {
+    outstanding.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(workers[worker]->mutex);
+        workers[worker]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        ++queued;
+    }
+    work_ready.notify_one();
+}
+
+void WorkStealingPool::spawn(Task task) {
+    push(current_pool == this ? current_worker : 0, std::move(task));
+}
+
+void WorkStealingPool::run(Task root) {
+    failed = false;
+    error = nullptr;
+    queued = 0;
+    push(0, std::move(root));
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers.size(); ++i) {
+        threads.emplace_back(&WorkStealingPool::work, this, i);
+    }
+    work(0);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+bool WorkStealingPool::next_task(size_t self, Task &task) {
+    {
+        Worker &own = *workers[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < workers.size(); ++i) {
+        Worker &victim = *workers[(self + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WorkStealingPool::wait_for_work() {
+    std::unique_lock<std::mutex> lock(idle_mutex);
+    work_ready.wait(lock, [this]() { return queued != 0 || outstanding.load(std::memory_order_acquire) == 0; });
+    return queued != 0;
+}
+
+void WorkStealingPool::work(size_t self) {
+    current_pool = this;
+    current_worker = self;
+    // A task counts as outstanding from spawn until it has run, so empty
+    // deques with work still outstanding mean more may be spawned; queued
+    // counts tasks pushed but not yet taken, so a sleeper knows when to
+    // look again.
+    while (true) {
+        if (!wait_for_work()) {
+            break;
+        }
+        Task task;
+        if (!next_task(self, task)) {
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex);
+            --queued;
+        }
+        if (!failed.load(std::memory_order_relaxed)) {
+            try {
+                task();
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                failed = true;
+            }
+        }
+        task = nullptr;
+        if (outstanding.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            // The last task is done: wake the sleepers so they exit.
+            std::lock_guard<std::mutex> lock(idle_mutex);
+            work_ready.notify_all();
+        }
+    }
+    current_pool = nullptr;
+}
@@ -0,0 +1,185 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include "trace.h"
+
+namespace {
+
+const char *timer_names[] = {
+    "read_object",
+    "write_object",
+    "inflate",
+    "deflate",
+    "sha1",
+    "parse_tree",
+    "parse_commit",
+    "checkout_write",
+};
+
+const char *counter_names[] = {
+    "objects_read",
+    "objects_written",
+    "bytes_read",
+    "bytes_written",
+    "bytes_inflated",
+    "bytes_deflated",
+    "cache_hits",
+    "cache_misses",
+    "syscalls",
+    "files_checked_out",
+    "prefetch_hits",
+    "prefetch_cancelled",
+    "read_batches",
+    "pack_index_probes",
+};
+
+static_assert(std::size(timer_names) == static_cast<size_t>(TraceTimer::Count));
+static_assert(std::size(counter_names) == static_cast<size_t>(TraceCounter::Count));
+
+// Bound the memory a long traced run can spend on Chrome events.
+constexpr size_t max_events_per_thread = 1 << 20;
+
+struct TraceEvent {
+    TraceTimer timer;
+    uint64_t start_ns;
+    uint64_t dur_ns;
+};
+
+struct ThreadEvents {
+    size_t tid;
+    std::vector<TraceEvent> events;
+};
+
+std::mutex events_mutex;
+std::vector<std::unique_ptr<ThreadEvents>> all_events;
+
+ThreadEvents &thread_events() {
+    thread_local ThreadEvents *local = nullptr;
+    if (!local) {
+        std::lock_guard<std::mutex> lock(events_mutex);
+        all_events.push_back(std::make_unique<ThreadEvents>());
+        local = all_events.back().get();
+        local->tid = all_events.size();
+    }
+    return *local;
+}
+
+void write_summary(std::ostream &out, uint64_t wall_ns,
+                   const std::vector<std::pair<uint64_t, uint64_t>> &timer_totals,
+                   const std::vector<uint64_t> &counter_totals) {
+    out << "git_cli trace: wall " << std::fixed << std::setprecision(3) << wall_ns / 1e6 << " ms\n";
+    out << std::left << std::setw(18) << "timer" << std::right << std::setw(10) << "calls"
+        << std::setw(14) << "total ms" << std::setw(12) << "avg us" << "\n";
+    for (size_t i = 0; i < timer_totals.size(); ++i) {
+        auto [calls, total] = timer_totals[i];
+        if (calls == 0) {
+            continue;
+        }
+        out << std::left << std::setw(18) << timer_names[i] << std::right << std::setw(10) << calls
+            << std::setw(14) << std::setprecision(3) << total / 1e6
+            << std::setw(12) << std::setprecision(2) << total / 1e3 / calls << "\n";
+    }
+    out << std::left << std::setw(18) << "counter" << std::right << std::setw(10) << "value" << "\n";
+    for (size_t i = 0; i < counter_totals.size(); ++i) {
+        out << std::left << std::setw(18) << counter_names[i] << std::right << std::setw(10) << counter_totals[i] << "\n";
+    }
+}
+
+// Microseconds with nanosecond precision, e.g. "1234567.089": a double at
+// the stream's default precision would round long runs to 10 us or worse.
+std::string micros(uint64_t ns) {
+    std::string frac = std::to_string(ns % 1000);
+    return std::to_string(ns / 1000) + "." + std::string(3 - frac.size(), '0') + frac;
+}
+
+void write_chrome(std::ostream &out, uint64_t origin_ns, const std::vector<uint64_t> &counter_totals) {
+    std::lock_guard<std::mutex> lock(events_mutex);
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    for (const auto &thread : all_events) {
+        for (const auto &event : thread->events) {
+            out << (first ? "" : ",") << "\n{\"name\":\"" << timer_names[static_cast<size_t>(event.timer)]
+                << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->tid
+                << ",\"ts\":" << micros(event.start_ns - origin_ns)
+                << ",\"dur\":" << micros(event.dur_ns) << "}";
+            first = false;
+        }
+    }
+    out << "\n],\"otherData\":{";
+    for (size_t i = 0; i < counter_totals.size(); ++i) {
+        out << (i ? "," : "") << "\"" << counter_names[i] << "\":" << counter_totals[i];
+    }
+    out << "}}\n";
+}
+
+}
+
+void Trace::init_from_env() {
+    const char *env = std::getenv("GIT_CLI_TRACE");
+    if (!env) {
+        return;
+    }
+    std::string spec(env);
+    std::string mode = spec.substr(0, spec.find(':'));
+    if (mode != "perf") {
+        return;
+    }
+    if (spec.size() > mode.size()) {
+        output = spec.substr(mode.size() + 1);
+    }
+    chrome = output.size() >= 5 && output.compare(output.size() - 5, 5, ".json") == 0;
+    start_ns = now_ns();
+    active = true;
+    std::atexit(Trace::report);
+}
+
+void Trace::record(TraceTimer timer, uint64_t start, uint64_t end) {
+    auto &stats = timers[static_cast<size_t>(timer)];
+    stats.calls.fetch_add(1, std::memory_order_relaxed);
+    stats.total_ns.fetch_add(end - start, std::memory_order_relaxed);
+    if (chrome) {
+        auto &local = thread_events();
+        if (local.events.size() < max_events_per_thread) {
+            local.events.push_back({timer, start, end - start});
+        }
+    }
+}
+
+void Trace::report() {
+    if (!active) {
+        return;
+    }
+    uint64_t wall_ns = now_ns() - start_ns;
+    std::vector<std::pair<uint64_t, uint64_t>> timer_totals;
+    for (const auto &stats : timers) {
+        timer_totals.emplace_back(stats.calls.load(), stats.total_ns.load());
+    }
+    std::vector<uint64_t> counter_totals;
+    for (const auto &counter : counters) {
+        counter_totals.push_back(counter.load());
+    }
+
+    std::ofstream file;
+    if (!output.empty()) {
+        file.open(output);
+        if (!file) {
+            std::cerr << "trace: cannot open " << output << std::endl;
+            return;
+        }
+    }
+    std::ostream &out = output.empty() ? std::cerr : file;
+    if (chrome) {
+        write_chrome(out, start_ns, counter_totals);
+    }
+    else {
+        write_summary(out, wall_ns, timer_totals, counter_totals);
+    }
+    active = false;
+}
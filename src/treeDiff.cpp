@@ -0,0 +1,74 @@
+#include <vector>
+
+#include "treeDiff.h"
+#include "object.h"
+
+static std::vector<GitTreeEntry> tree_entries(const GitRepository &repo, const std::string &sha) {
+    if (sha.empty()) {
+        return {};
+    }
+    return read_tree(repo, sha)->get_entries();
+}
+
+static bool is_tree(const GitTreeEntry &entry) {
+    return entry.mode == "40000";
+}
+
+static int compare_entries(const GitTreeEntry &a, const GitTreeEntry &b) {
+    return tree_entry_less(a, b) ? -1 : tree_entry_less(b, a) ? 1 : 0;
+}
+
+static std::string join_path(const std::string &prefix, const std::string &name) {
+    return prefix.empty() ? name : prefix + "/" + name;
+}
+
+void diff_trees(const GitRepository &repo, const std::string &old_tree, const std::string &new_tree,
+                const std::function<void(const TreeDiffEntry &)> &visit, const Pathspec &pathspec,
+                const std::string &prefix) {
+    if (old_tree == new_tree) {
+        return;
+    }
+    auto old_entries = select_entries(tree_entries(repo, old_tree), prefix, pathspec);
+    auto new_entries = select_entries(tree_entries(repo, new_tree), prefix, pathspec);
+
+    auto removed = [&](const GitTreeEntry &entry) {
+        std::string path = join_path(prefix, entry.path);
+        if (is_tree(entry)) {
+            diff_trees(repo, entry.sha, "", visit, pathspec, path);
+        }
+        else {
+            visit({TreeChange::Deleted, path, entry, {}});
+        }
+    };
+    auto added = [&](const GitTreeEntry &entry) {
+        std::string path = join_path(prefix, entry.path);
+        if (is_tree(entry)) {
+            diff_trees(repo, "", entry.sha, visit, pathspec, path);
+        }
+        else {
+            visit({TreeChange::Added, path, {}, entry});
+        }
+    };
+
+    size_t i = 0;
+    size_t j = 0;
+    while (i < old_entries.size() || j < new_entries.size()) {
+        int order = i == old_entries.size() ? 1 : j == new_entries.size() ? -1 : compare_entries(old_entries[i], new_entries[j]);
+        if (order < 0) {
+            removed(old_entries[i++]);
+        }
+        else if (order > 0) {
+            added(new_entries[j++]);
+        }
+        else {
+            const GitTreeEntry &before = old_entries[i++];
+            const GitTreeEntry &after = new_entries[j++];
+            if (is_tree(before)) {
+                diff_trees(repo, before.sha, after.sha, visit, pathspec, join_path(prefix, before.path));
+            }
+            else if (before.sha != after.sha || before.mode != after.mode) {
+                visit({TreeChange::Modified, join_path(prefix, before.path), before, after});
+            }
+        }
+    }
+}
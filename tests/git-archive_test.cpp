@@ -0,0 +1,177 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#include "repository.h"
+#include "object.h"
+#include "binaryIO.h"
+#include "archive.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct TarMember {
+    std::string path;
+    char typeflag;
+    unsigned mode;
+    uint64_t mtime;
+    std::string link;
+    std::string data;
+};
+
+uint64_t octal_field(const char *field, size_t width) {
+    return std::stoull(std::string(field, strnlen(field, width)), nullptr, 8);
+}
+
+// Parses a ustar stream, checking every header checksum, applying pax path
+// records, and requiring the zero-block trailer and record padding.
+std::vector<TarMember> parse_tar(const std::string &tar) {
+    std::vector<TarMember> members;
+    std::string pax_path;
+    size_t pos = 0;
+    EXPECT_EQ(tar.size() % (20 * 512), 0u);
+    while (true) {
+        if (pos + 512 > tar.size()) {
+            ADD_FAILURE() << "archive ends without a trailer";
+            return members;
+        }
+        const char *block = tar.data() + pos;
+        if (std::all_of(block, block + 512, [](char c) { return c == 0; })) {
+            EXPECT_TRUE(std::all_of(tar.begin() + pos, tar.end(), [](char c) { return c == 0; }));
+            EXPECT_GE(tar.size() - pos, 1024u);
+            return members;
+        }
+        unsigned sum = 0;
+        for (size_t i = 0; i < 512; ++i) {
+            sum += (i >= 148 && i < 156) ? ' ' : static_cast<unsigned char>(block[i]);
+        }
+        EXPECT_EQ(octal_field(block + 148, 8), sum);
+        EXPECT_EQ(std::string(block + 257, 5), "ustar");
+
+        TarMember member;
+        member.typeflag = block[156];
+        member.mode = octal_field(block + 100, 8);
+        member.mtime = octal_field(block + 136, 12);
+        member.link = std::string(block + 157, strnlen(block + 157, 100));
+        std::string name(block, strnlen(block, 100));
+        std::string prefix(block + 345, strnlen(block + 345, 155));
+        member.path = prefix.empty() ? name : prefix + "/" + name;
+        uint64_t size = octal_field(block + 124, 12);
+        member.data = tar.substr(pos + 512, size);
+        pos += 512 + (size + 511) / 512 * 512;
+
+        if (member.typeflag == 'x') {
+            // "<len> path=<value>\n"
+            auto key = member.data.find(" path=");
+            if (key != std::string::npos) {
+                pax_path = member.data.substr(key + 6, member.data.find('\n', key) - key - 6);
+            }
+            continue;
+        }
+        if (!pax_path.empty()) {
+            member.path = pax_path;
+            pax_path.clear();
+        }
+        members.push_back(std::move(member));
+    }
+}
+
+std::string gunzip(const std::string &gz) {
+    z_stream stream{};
+    EXPECT_EQ(inflateInit2(&stream, 15 + 16), Z_OK);
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(gz.data()));
+    stream.avail_in = gz.size();
+    std::string out;
+    char buf[65536];
+    int status = Z_OK;
+    while (status == Z_OK) {
+        stream.next_out = reinterpret_cast<Bytef *>(buf);
+        stream.avail_out = sizeof(buf);
+        status = inflate(&stream, Z_NO_FLUSH);
+        out.append(buf, sizeof(buf) - stream.avail_out);
+    }
+    EXPECT_EQ(status, Z_STREAM_END);
+    inflateEnd(&stream);
+    return out;
+}
+
+}
+
+class ArchiveTest : public ::testing::Test {
+protected:
+    fs::path tempDir;
+
+    void SetUp() override {
+        tempDir = fs::temp_directory_path() / fs::path("git_archive_test_repo");
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+        fs::create_directory(tempDir);
+        GitRepository::repo_create(tempDir);
+    }
+
+    void TearDown() override {
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+    }
+
+    static std::string entry(const std::string &mode, const std::string &name, const std::string &sha) {
+        return mode + " " + name + std::string(1, '\0') + hex_to_bytes(sha);
+    }
+};
+
+TEST_F(ArchiveTest, WritesUstarWithPaxModesAndTrailer) {
+    GitRepository repo(tempDir);
+    std::string long_name(120, 'n');
+    std::string text = write_raw_object(repo, "blob", "hello\n");
+    std::string script = write_raw_object(repo, "blob", "#!/bin/sh\necho hi\n");
+    std::string target = write_raw_object(repo, "blob", "file.txt");
+    std::string big_content(3 << 20, 'z');
+    std::string big = write_raw_object(repo, "blob", big_content);
+    std::string sub = write_raw_object(repo, "tree", entry("100644", long_name, text));
+    // Entries in git's tree order.
+    std::string tree = write_raw_object(repo, "tree",
+                                        entry("100644", "big.bin", big) + entry("40000", "dir", sub) +
+                                        entry("100644", "file.txt", text) + entry("120000", "link", target) +
+                                        entry("100755", "run.sh", script));
+
+    ArchiveOptions options;
+    options.mtime = 1700000000;
+    std::ostringstream tar_out;
+    write_archive(repo, tree, options, tar_out);
+    std::string tar = tar_out.str();
+
+    auto members = parse_tar(tar);
+    ASSERT_EQ(members.size(), 6u);
+    EXPECT_EQ(members[0].path, "big.bin");
+    EXPECT_EQ(members[0].data, big_content);
+    EXPECT_EQ(members[1].path, "dir/");
+    EXPECT_EQ(members[1].typeflag, '5');
+    EXPECT_EQ(members[2].path, "dir/" + long_name);
+    EXPECT_EQ(members[2].data, "hello\n");
+    EXPECT_EQ(members[3].path, "file.txt");
+    EXPECT_EQ(members[3].mode, 0644u);
+    EXPECT_EQ(members[4].path, "link");
+    EXPECT_EQ(members[4].typeflag, '2');
+    EXPECT_EQ(members[4].link, "file.txt");
+    EXPECT_EQ(members[4].data, "");
+    EXPECT_EQ(members[5].path, "run.sh");
+    EXPECT_EQ(members[5].mode, 0755u);
+    EXPECT_EQ(members[5].data, "#!/bin/sh\necho hi\n");
+    for (const auto &member : members) {
+        EXPECT_EQ(member.mtime, 1700000000u);
+    }
+    // The long name needed a pax header.
+    EXPECT_NE(tar.find(" path=dir/" + long_name + "\n"), std::string::npos);
+
+    options.format = ArchiveFormat::TarGz;
+    std::ostringstream gz_out;
+    write_archive(repo, tree, options, gz_out);
+    EXPECT_EQ(gunzip(gz_out.str()), tar);
+}
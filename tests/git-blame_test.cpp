@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "repository.h"
+#include "object.h"
+#include "blame.h"
+
+namespace fs = std::filesystem;
+
+TEST(DiffLinesTest, FindsALongestCommonSubsequence) {
+    std::mt19937 rng(3);
+    for (int round = 0; round < 200; ++round) {
+        // Small alphabets force repeated lines and ambiguous alignments.
+        std::vector<std::string> old_text(rng() % 30), new_text(rng() % 30);
+        for (auto &line : old_text) {
+            line = std::string(1, 'a' + rng() % 4);
+        }
+        for (auto &line : new_text) {
+            line = std::string(1, 'a' + rng() % 4);
+        }
+        std::vector<std::string_view> a(old_text.begin(), old_text.end());
+        std::vector<std::string_view> b(new_text.begin(), new_text.end());
+
+        std::vector<std::vector<size_t>> lcs(a.size() + 1, std::vector<size_t>(b.size() + 1, 0));
+        for (size_t i = a.size(); i-- > 0;) {
+            for (size_t j = b.size(); j-- > 0;) {
+                lcs[i][j] = a[i] == b[j] ? lcs[i + 1][j + 1] + 1 : std::max(lcs[i + 1][j], lcs[i][j + 1]);
+            }
+        }
+
+        size_t matched = 0, next_old = 0, next_new = 0;
+        for (const auto &match : diff_lines(a, b)) {
+            ASSERT_GE(match.old_start, next_old);
+            ASSERT_GE(match.new_start, next_new);
+            for (size_t k = 0; k < match.count; ++k) {
+                ASSERT_EQ(a[match.old_start + k], b[match.new_start + k]);
+            }
+            next_old = match.old_start + match.count;
+            next_new = match.new_start + match.count;
+            matched += match.count;
+        }
+        EXPECT_EQ(matched, lcs[0][0]);
+    }
+}
+
+class BlameTest : public ::testing::Test {
+protected:
+    fs::path tempDir;
+    int64_t clock = 1700000000;
+
+    void SetUp() override {
+        tempDir = fs::temp_directory_path() / fs::path("git_blame_test_repo");
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+        fs::create_directory(tempDir);
+        GitRepository::repo_create(tempDir);
+    }
+
+    void TearDown() override {
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+    }
+
+    static std::string hex_to_bytes(const std::string &hex) {
+        std::string out;
+        for (size_t i = 0; i < hex.size(); i += 2) {
+            out += static_cast<char>(std::stoi(hex.substr(i, 2), nullptr, 16));
+        }
+        return out;
+    }
+
+    // A commit whose tree holds src/file.txt with the given content.
+    std::string commit(const GitRepository &repo, const std::string &content, const std::vector<std::string> &parents) {
+        std::string blob = write_raw_object(repo, "blob", content);
+        std::string dir = write_raw_object(repo, "tree", "100644 file.txt" + std::string(1, '\0') + hex_to_bytes(blob));
+        std::string tree = write_raw_object(repo, "tree", "40000 src" + std::string(1, '\0') + hex_to_bytes(dir));
+        std::string body = "tree " + tree + "\n";
+        for (const auto &parent : parents) {
+            body += "parent " + parent + "\n";
+        }
+        std::string stamp = std::to_string(clock += 60) + " +0000";
+        body += "author a <a@b> " + stamp + "\ncommitter a <a@b> " + stamp + "\n\nchange\n";
+        return write_raw_object(repo, "commit", body);
+    }
+
+    static std::vector<std::string> owners(const BlameResult &result) {
+        std::vector<std::string> out;
+        for (const auto &entry : result.entries) {
+            out.insert(out.end(), entry.count, entry.commit);
+        }
+        return out;
+    }
+};
+
+TEST_F(BlameTest, AttributesLinesThroughMerges) {
+    GitRepository repo(tempDir);
+    std::string root = commit(repo, "one\ntwo\nthree\n", {});
+    std::string edit = commit(repo, "one\n2\nthree\n", {root});
+    std::string side = commit(repo, "zero\none\ntwo\nthree\n", {root});
+    std::string merge = commit(repo, "zero\none\n2\nthree\nfour\n", {edit, side});
+    std::string same = commit(repo, "zero\none\n2\nthree\nfour\n", {merge});
+
+    BlameDiffCache cache;
+    BlameResult result = blame_file(repo, same, "src/file.txt", cache);
+    EXPECT_EQ(result.lines, (std::vector<std::string>{"zero", "one", "2", "three", "four"}));
+    EXPECT_EQ(owners(result), (std::vector<std::string>{side, root, edit, root, merge}));
+    EXPECT_TRUE(result.entries[1].boundary);
+    EXPECT_EQ(result.entries[1].orig_start, 0u);
+    EXPECT_EQ(result.entries[3].orig_start, 2u);
+    EXPECT_EQ(result.stats.cached_diffs, 0u);
+
+    // The second blame reuses every diff.
+    size_t diffs = result.stats.diffs;
+    EXPECT_GT(diffs, 0u);
+    BlameResult again = blame_file(repo, same, "src/file.txt", cache);
+    EXPECT_EQ(owners(again), owners(result));
+    EXPECT_EQ(again.stats.diffs, 0u);
+    EXPECT_EQ(again.stats.cached_diffs, diffs);
+
+    EXPECT_THROW(blame_file(repo, same, "src/missing.txt", cache), std::runtime_error);
+}
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "repository.h"
+#include "object.h"
+#include "changedPaths.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+bool maybe(const std::string &filter, const std::string &path) {
+    return ChangedPathFilter::maybe_contains(reinterpret_cast<const unsigned char *>(filter.data()), filter.size(),
+                                             ChangedPathFilter::keys(path));
+}
+
+std::string hex_to_bytes(const std::string &hex) {
+    std::string out;
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        out += static_cast<char>(std::stoi(hex.substr(i, 2), nullptr, 16));
+    }
+    return out;
+}
+
+}
+
+TEST(ChangedPathFilterTest, KeysIncludeLeadingDirectories) {
+    EXPECT_EQ(ChangedPathFilter::keys("a/b/c.txt"), (std::vector<std::string>{"a/b/c.txt", "a/b", "a"}));
+    EXPECT_EQ(ChangedPathFilter::keys("top"), (std::vector<std::string>{"top"}));
+}
+
+TEST(ChangedPathFilterTest, NoFalseNegatives) {
+    std::vector<std::string> paths;
+    for (int i = 0; i < 200; ++i) {
+        paths.push_back("dir" + std::to_string(i % 7) + "/file" + std::to_string(i));
+        paths.push_back("dir" + std::to_string(i % 7));
+    }
+    std::string filter = ChangedPathFilter::build(paths);
+    for (int i = 0; i < 200; ++i) {
+        EXPECT_TRUE(maybe(filter, "dir" + std::to_string(i % 7) + "/file" + std::to_string(i)));
+    }
+    int false_positives = 0;
+    for (int i = 0; i < 1000; ++i) {
+        false_positives += maybe(filter, "other/file" + std::to_string(i));
+    }
+    EXPECT_LT(false_positives, 50);
+}
+
+TEST(ChangedPathFilterTest, EmptyAndOversizedFilters) {
+    EXPECT_FALSE(maybe(ChangedPathFilter::build({}), "anything"));
+    std::vector<std::string> many(ChangedPathFilter::max_changes + 1, "x");
+    EXPECT_TRUE(maybe(ChangedPathFilter::build(many), "anything"));
+}
+
+class ChangedPathLogTest : public ::testing::Test {
+protected:
+    fs::path tempDir;
+
+    void SetUp() override {
+        tempDir = fs::temp_directory_path() / fs::path("git_changed_paths_test_repo");
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+        fs::create_directory(tempDir);
+        GitRepository::repo_create(tempDir);
+    }
+
+    void TearDown() override {
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+    }
+
+    // Commit i sets src/a.txt to a (if given) and notes.txt to "note i".
+    std::string commit(const GitRepository &repo, int i, const std::string &a, const std::string &parent) {
+        std::string src = write_raw_object(repo, "tree", "100644 a.txt" + std::string(1, '\0') +
+                                                         hex_to_bytes(write_raw_object(repo, "blob", a)));
+        std::string note = write_raw_object(repo, "blob", "note " + std::to_string(i) + "\n");
+        std::string tree = write_raw_object(repo, "tree", "100644 notes.txt" + std::string(1, '\0') + hex_to_bytes(note) +
+                                                          "40000 src" + std::string(1, '\0') + hex_to_bytes(src));
+        std::string body = "tree " + tree + "\n";
+        if (!parent.empty()) {
+            body += "parent " + parent + "\n";
+        }
+        body += "author a <a@b> " + std::to_string(1000 + i) + " +0000\n";
+        body += "committer a <a@b> " + std::to_string(1000 + i) + " +0000\n\ncommit " + std::to_string(i) + "\n";
+        return write_raw_object(repo, "commit", body);
+    }
+};
+
+TEST_F(ChangedPathLogTest, FiltersSkipUnchangedCommits) {
+    GitRepository repo(tempDir);
+    std::vector<std::string> commits;
+    for (int i = 0; i < 20; ++i) {
+        std::string a = "version " + std::to_string(i / 5) + "\n";
+        commits.push_back(commit(repo, i, a, commits.empty() ? "" : commits.back()));
+    }
+    auto list = [&](bool use_filters, PathLogStats &stats) {
+        std::vector<std::string> shown;
+        PathLogOptions options;
+        options.use_filters = use_filters;
+        stats = log_path(repo, commits.back(), "src/a.txt", options, [&](const std::string &sha, const std::string &) {
+            shown.push_back(sha);
+        });
+        return shown;
+    };
+    PathLogStats plain;
+    auto expected = list(false, plain);
+    EXPECT_EQ(expected, (std::vector<std::string>{commits[15], commits[10], commits[5], commits[0]}));
+    EXPECT_EQ(plain.compared, 20u);
+
+    EXPECT_EQ(write_changed_path_index(repo, {commits.back()}).commits, 20u);
+    PathLogStats filtered;
+    EXPECT_EQ(list(true, filtered), expected);
+    EXPECT_GE(filtered.filtered, 14u);
+}
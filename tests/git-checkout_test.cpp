@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "repository.h"
+#include "object.h"
+#include "gitTree.h"
+#include "dirSnapshot.h"
+
+namespace fs = std::filesystem;
+
+class CheckoutTest : public ::testing::Test {
+protected:
+    fs::path tempDir;
+
+    void SetUp() override {
+        tempDir = fs::temp_directory_path() / fs::path("git_checkout_test_repo");
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+        fs::create_directory(tempDir);
+        GitRepository::repo_create(tempDir);
+    }
+
+    void TearDown() override {
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+    }
+
+    static void write_file(const fs::path &path, const std::string &content) {
+        fs::create_directories(path.parent_path());
+        std::ofstream(path, std::ios::binary) << content;
+    }
+
+    static std::string read_file(const fs::path &path) {
+        std::ifstream in(path, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    }
+
+    // Stores the files under a scratch directory as a tree.
+    std::string make_tree(const GitRepository &repo, const std::vector<std::pair<std::string, std::string>> &files) {
+        fs::path scratch = tempDir / "scratch";
+        fs::remove_all(scratch);
+        for (const auto &[path, content] : files) {
+            write_file(scratch / path, content);
+        }
+        fs::create_directories(scratch);
+        return write_tree_from_dir(repo, scratch).tree;
+    }
+};
+
+TEST_F(CheckoutTest, UpdateSwapsFilesAndDirectories) {
+    GitRepository repo(tempDir);
+    std::string old_tree = make_tree(repo, {{"a/f", "one\n"}, {"b", "two\n"}, {"keep/x", "same\n"}, {"gone", "bye\n"}});
+    std::string new_tree = make_tree(repo, {{"a", "file now\n"}, {"b/g", "dir now\n"}, {"keep/x", "same\n"}});
+    fs::path work = tempDir / "work";
+    fs::create_directories(work);
+    tree_checkout(repo, old_tree, work);
+    EXPECT_EQ(read_file(work / "a" / "f"), "one\n");
+
+    // a/ becoming a file must not count as a local change.
+    CheckoutStats stats = tree_checkout_update(repo, old_tree, new_tree, work, true);
+    EXPECT_EQ(stats.written, 2u);
+    EXPECT_EQ(stats.deleted, 3u);
+    EXPECT_EQ(read_file(work / "a"), "file now\n");
+    EXPECT_EQ(read_file(work / "b" / "g"), "dir now\n");
+    EXPECT_EQ(read_file(work / "keep" / "x"), "same\n");
+    EXPECT_FALSE(fs::exists(work / "gone"));
+}
+
+TEST_F(CheckoutTest, CheckRefusesToOverwriteLocalChanges) {
+    GitRepository repo(tempDir);
+    std::string old_tree = make_tree(repo, {{"a/f", "one\n"}, {"b", "two\n"}});
+    std::string new_tree = make_tree(repo, {{"a/f", "changed\n"}, {"b", "two\n"}, {"c", "new\n"}});
+    fs::path work = tempDir / "work";
+    fs::create_directories(work);
+    tree_checkout(repo, old_tree, work);
+    write_file(work / "a" / "f", "edited locally\n");
+    write_file(work / "c", "untracked\n");
+
+    try {
+        tree_checkout_update(repo, old_tree, new_tree, work, true);
+        FAIL() << "expected a conflict";
+    }
+    catch (const std::runtime_error &e) {
+        EXPECT_EQ(std::string(e.what()), "Local changes would be overwritten:\n  a/f\n  c");
+    }
+    EXPECT_EQ(read_file(work / "a" / "f"), "edited locally\n");
+
+    // Without the check the new tree wins.
+    tree_checkout_update(repo, old_tree, new_tree, work, false);
+    EXPECT_EQ(read_file(work / "a" / "f"), "changed\n");
+    EXPECT_EQ(read_file(work / "c"), "new\n");
+}
+
+TEST_F(CheckoutTest, StreamsLargeBlobsToDisk) {
+    GitRepository repo(tempDir);
+    // Several inflate chunks long, and not a multiple of the chunk size.
+    std::string big;
+    for (size_t i = 0; big.size() < 3 * 1024 * 1024 + 17; ++i) {
+        big += "line " + std::to_string(i * 2654435761u) + "\n";
+    }
+    fs::path scratch = tempDir / "scratch";
+    write_file(scratch / "assets" / "big.bin", big);
+    write_file(scratch / "empty", "");
+    write_file(scratch / "run.sh", "#!/bin/sh\n");
+    fs::permissions(scratch / "run.sh", fs::perms::owner_exec, fs::perm_options::add);
+    std::string tree = write_tree_from_dir(repo, scratch).tree;
+
+    fs::path work = tempDir / "work";
+    fs::create_directories(work);
+    tree_checkout(repo, tree, work);
+    EXPECT_EQ(fs::file_size(work / "assets" / "big.bin"), big.size());
+    EXPECT_EQ(read_file(work / "assets" / "big.bin"), big);
+    EXPECT_EQ(fs::file_size(work / "empty"), 0u);
+    EXPECT_NE(fs::status(work / "run.sh").permissions() & fs::perms::owner_exec, fs::perms::none);
+    EXPECT_EQ(fs::status(work / "empty").permissions() & fs::perms::owner_exec, fs::perms::none);
+}
+
+TEST_F(CheckoutTest, UpdateKeepsTargetGivenWithTrailingSlash) {
+    GitRepository repo(tempDir);
+    std::string old_tree = make_tree(repo, {{"sub/f", "one\n"}});
+    std::string new_tree = make_tree(repo, {});
+    fs::path work = tempDir / "work";
+    fs::create_directories(work);
+    tree_checkout(repo, old_tree, work);
+
+    CheckoutStats stats = tree_checkout_update(repo, old_tree, new_tree, tempDir / "work/", true);
+    EXPECT_EQ(stats.deleted, 1u);
+    EXPECT_FALSE(fs::exists(work / "sub"));
+    EXPECT_TRUE(fs::is_directory(work));
+}
+
+TEST_F(CheckoutTest, ReplacesSymlinksInsteadOfWritingThroughThem) {
+    GitRepository repo(tempDir);
+    std::string old_tree = make_tree(repo, {{"a", "one\n"}, {"b", "two\n"}});
+    std::string new_tree = make_tree(repo, {{"a", "changed\n"}, {"b", "two\n"}, {"c", "new\n"}});
+    fs::path work = tempDir / "work";
+    fs::create_directories(work);
+    tree_checkout(repo, old_tree, work);
+
+    fs::path victim = tempDir / "victim";
+    write_file(victim, "keep\n");
+    fs::remove(work / "a");
+    fs::create_symlink(victim, work / "a");
+    fs::create_symlink(victim, work / "c");
+    tree_checkout_update(repo, old_tree, new_tree, work, false);
+    EXPECT_FALSE(fs::is_symlink(work / "a"));
+    EXPECT_FALSE(fs::is_symlink(work / "c"));
+    EXPECT_EQ(read_file(work / "a"), "changed\n");
+    EXPECT_EQ(read_file(work / "c"), "new\n");
+    EXPECT_EQ(read_file(victim), "keep\n");
+
+    // A full checkout over a symlink replaces it the same way.
+    fs::remove(work / "b");
+    fs::create_symlink(victim, work / "b");
+    tree_checkout(repo, new_tree, work);
+    EXPECT_FALSE(fs::is_symlink(work / "b"));
+    EXPECT_EQ(read_file(work / "b"), "two\n");
+    EXPECT_EQ(read_file(victim), "keep\n");
+}
@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <zlib.h>
+
+#include "repository.h"
+#include "object.h"
+#include "binaryIO.h"
+#include "fsck.h"
+
+namespace fs = std::filesystem;
+
+class FsckTest : public ::testing::Test {
+protected:
+    fs::path tempDir;
+
+    void SetUp() override {
+        tempDir = fs::temp_directory_path() / fs::path("git_fsck_test_repo");
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+        fs::create_directory(tempDir);
+        GitRepository::repo_create(tempDir);
+    }
+
+    void TearDown() override {
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+    }
+
+    void write_ref(const std::string &name, const std::string &sha) {
+        fs::path path = tempDir / ".git" / name;
+        fs::create_directories(path.parent_path());
+        std::ofstream out(path);
+        out << sha << "\n";
+    }
+
+    std::string tree_with(const GitRepository &repo, const std::string &mode, const std::string &name,
+                          const std::string &sha) {
+        return write_raw_object(repo, "tree", mode + " " + name + std::string(1, '\0') + hex_to_bytes(sha));
+    }
+
+    std::string commit_with(const GitRepository &repo, const std::string &tree) {
+        return write_raw_object(repo, "commit", "tree " + tree + "\nauthor A <a@b> 0 +0000\ncommitter A <a@b> 0 +0000\n\nm\n");
+    }
+
+    FsckReport run(const GitRepository &repo, std::string &findings) {
+        std::ostringstream out, err;
+        FsckReport report = fsck_objects(repo, FsckOptions(), out, err);
+        findings = out.str();
+        return report;
+    }
+};
+
+TEST_F(FsckTest, CleanHistoryHasNoFindings) {
+    GitRepository repo(tempDir);
+    std::string blob = write_raw_object(repo, "blob", "content\n");
+    std::string commit = commit_with(repo, tree_with(repo, "100644", "file", blob));
+    write_ref("refs/heads/master", commit);
+
+    std::string findings;
+    FsckReport report = run(repo, findings);
+    EXPECT_EQ(report.objects, 3u);
+    EXPECT_EQ(report.corrupt + report.missing + report.dangling, 0u);
+    EXPECT_EQ(findings, "");
+}
+
+TEST_F(FsckTest, ReportsHashMismatch) {
+    GitRepository repo(tempDir);
+    std::string blob = write_raw_object(repo, "blob", "original\n");
+    write_ref("refs/heads/master", commit_with(repo, tree_with(repo, "100644", "file", blob)));
+    // Replace the object file with a valid object of different content.
+    std::string other = "blob 9" + std::string(1, '\0') + "tampered\n";
+    uLongf len = compressBound(other.size());
+    std::string compressed(len, '\0');
+    compress(reinterpret_cast<Bytef *>(compressed.data()), &len, reinterpret_cast<const Bytef *>(other.data()),
+             other.size());
+    compressed.resize(len);
+    fs::path path = tempDir / ".git" / "objects" / blob.substr(0, 2) / blob.substr(2);
+    fs::permissions(path, fs::perms::owner_write, fs::perm_options::add);
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << compressed;
+
+    std::string findings;
+    FsckReport report = run(repo, findings);
+    EXPECT_EQ(report.corrupt, 1u);
+    EXPECT_EQ(report.missing, 0u);
+    EXPECT_EQ(findings, "error in object " + blob + ": hash mismatch\n");
+}
+
+TEST_F(FsckTest, ReportsMalformedTreeAndCommit) {
+    GitRepository repo(tempDir);
+    std::string tree = write_raw_object(repo, "tree", "100644 truncated");
+    std::string commit = write_raw_object(repo, "commit", "author A <a@b> 0 +0000\n\nno tree line\n");
+    write_ref("refs/heads/tree", tree);
+    write_ref("refs/heads/master", commit);
+
+    std::string findings;
+    FsckReport report = run(repo, findings);
+    EXPECT_EQ(report.corrupt, 2u);
+    EXPECT_NE(findings.find("error in object " + tree + ": "), std::string::npos);
+    EXPECT_NE(findings.find("error in object " + commit + ": invalid tree line\n"), std::string::npos);
+}
+
+TEST_F(FsckTest, ReportsMissingObjectsAndRefTargets) {
+    GitRepository repo(tempDir);
+    std::string absent_blob(40, 'b');
+    std::string commit = commit_with(repo, tree_with(repo, "100644", "file", absent_blob));
+    std::string absent_commit(40, 'c');
+    write_ref("refs/heads/master", commit);
+    write_ref("refs/heads/lost", absent_commit);
+
+    std::string findings;
+    FsckReport report = run(repo, findings);
+    EXPECT_EQ(report.corrupt, 0u);
+    EXPECT_EQ(report.missing, 2u);
+    EXPECT_EQ(findings, "missing blob " + absent_blob + "\n" +
+                        "missing object " + absent_commit + " from refs/heads/lost\n");
+}
+
+TEST_F(FsckTest, ReportsDanglingObjects) {
+    GitRepository repo(tempDir);
+    std::string kept = write_raw_object(repo, "blob", "kept\n");
+    write_ref("refs/heads/master", commit_with(repo, tree_with(repo, "100644", "file", kept)));
+    std::string orphan = write_raw_object(repo, "blob", "orphan\n");
+
+    std::string findings;
+    FsckReport report = run(repo, findings);
+    EXPECT_EQ(report.dangling, 1u);
+    EXPECT_EQ(report.missing, 0u);
+    EXPECT_EQ(findings, "dangling blob " + orphan + "\n");
+}
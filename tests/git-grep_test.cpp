@@ -0,0 +1,39 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <string_view>
+
+#include "grep.h"
+
+TEST(GrepMatcherTest, PlainPatternsUseLiteralSearch) {
+    EXPECT_TRUE(GrepMatcher("needle", GrepSyntax::Basic, false).is_literal());
+    EXPECT_TRUE(GrepMatcher("a+b", GrepSyntax::Basic, false).is_literal());
+    EXPECT_FALSE(GrepMatcher("a+b", GrepSyntax::Extended, false).is_literal());
+    EXPECT_TRUE(GrepMatcher("a.b", GrepSyntax::Fixed, false).is_literal());
+}
+
+TEST(GrepMatcherTest, ReturnsWholeMatchingLines) {
+    GrepMatcher matcher("needle", GrepSyntax::Fixed, false);
+    std::string_view text = "hay\nsome needle here\nhay\nneedle\n";
+    std::string_view line = matcher.next_line(text, 0);
+    EXPECT_EQ(line, "some needle here");
+
+    line = matcher.next_line(text, line.data() + line.size() - text.data() + 1);
+    EXPECT_EQ(line, "needle");
+
+    line = matcher.next_line(text, line.data() + line.size() - text.data() + 1);
+    EXPECT_EQ(line.data(), nullptr);
+}
+
+TEST(GrepMatcherTest, IgnoreCaseLiteral) {
+    GrepMatcher matcher("NeEdLe", GrepSyntax::Fixed, true);
+    EXPECT_EQ(matcher.next_line("a\nxx NEEDLE yy\n", 0), "xx NEEDLE yy");
+    EXPECT_EQ(matcher.next_line("nope\nneedl\n", 0).data(), nullptr);
+}
+
+TEST(GrepMatcherTest, RegexMatchesPerLine) {
+    GrepMatcher matcher("^b[0-9]+$", GrepSyntax::Extended, false);
+    EXPECT_EQ(matcher.next_line("ab12\nb12\n", 0), "b12");
+
+    GrepMatcher basic("x\\{2\\}", GrepSyntax::Basic, false);
+    EXPECT_EQ(basic.next_line("x\nyxxy\n", 0), "yxxy");
+}
@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "repository.h"
+#include "object.h"
+#include "objectReader.h"
+#include "prefetch.h"
+
+namespace fs = std::filesystem;
+
+class ObjectReaderTest : public ::testing::Test {
+protected:
+    fs::path tempDir;
+
+    void SetUp() override {
+        tempDir = fs::temp_directory_path() / fs::path("git_object_reader_test_repo");
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+        fs::create_directory(tempDir);
+        GitRepository::repo_create(tempDir);
+    }
+
+    void TearDown() override {
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+    }
+
+    void set_reader(const std::string &name) {
+        std::ofstream(tempDir / ".git" / "config") << "[core]\nrepositoryformatversion=0\nobjectreader=" << name << "\n";
+    }
+};
+
+TEST_F(ObjectReaderTest, EveryBackendReadsTheSameBytes) {
+    GitRepository repo(tempDir);
+    std::vector<std::string> ids;
+    for (int i = 0; i < 150; ++i) {
+        // One object larger than the first io_uring read.
+        std::string content = i == 7 ? std::string(300000, 'x') + "tail" : "blob " + std::to_string(i) + "\n";
+        ids.push_back(write_raw_object(repo, "blob", content));
+    }
+    ids.push_back(std::string(40, '0'));
+
+    for (auto backend : {ObjectReadBackend::Sync, ObjectReadBackend::Threads, ObjectReadBackend::IoUring}) {
+        BatchObjectReader reader(repo, backend, 16);
+        if (backend == ObjectReadBackend::IoUring && !io_uring_available()) {
+            EXPECT_EQ(reader.backend(), ObjectReadBackend::Threads);
+        }
+        std::vector<int> calls(ids.size());
+        reader.read(ids, [&](size_t index, std::string &&compressed, std::exception_ptr error) {
+            ++calls[index];
+            if (index + 1 == ids.size()) {
+                ASSERT_TRUE(error);
+                try {
+                    std::rethrow_exception(error);
+                }
+                catch (const std::runtime_error &e) {
+                    EXPECT_NE(std::string(e.what()).find(ids[index]), std::string::npos) << e.what();
+                }
+                return;
+            }
+            ASSERT_FALSE(error);
+            EXPECT_EQ(inflate_loose_object(ids[index], compressed), read_raw_object(repo, ids[index]));
+        });
+        EXPECT_EQ(calls, std::vector<int>(ids.size(), 1)) << read_backend_name(backend);
+    }
+}
+
+TEST_F(ObjectReaderTest, ConfigSelectsBackendForPrefetch) {
+    EXPECT_EQ(configured_read_backend(GitRepository(tempDir)), ObjectReadBackend::Sync);
+    set_reader("threads");
+    GitRepository repo(tempDir);
+    EXPECT_EQ(configured_read_backend(repo), ObjectReadBackend::Threads);
+    EXPECT_THROW(parse_read_backend("aio"), std::runtime_error);
+
+    std::vector<std::string> ids;
+    for (int i = 0; i < 100; ++i) {
+        ids.push_back(write_raw_object(repo, "blob", "content " + std::to_string(i) + "\n"));
+    }
+    ObjectPrefetcher prefetcher(repo);
+    prefetcher.prefetch(ids);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(prefetcher.get(ids[i])->serialize(), "content " + std::to_string(i) + "\n");
+    }
+}
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+
+#include "repository.h"
+#include "object.h"
+#include "gitBlob.h"
+#include "gitTree.h"
+#include "gitCommit.h"
+
+namespace fs = std::filesystem;
+
+class GitObjectTest : public ::testing::Test {
+protected:
+    fs::path tempDir;
+
+    void SetUp() override {
+        tempDir = fs::temp_directory_path() / fs::path("git_object_test_repo");
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+        fs::create_directory(tempDir);
+        GitRepository::repo_create(tempDir);
+    }
+
+    void TearDown() override {
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+    }
+};
+
+TEST_F(GitObjectTest, HashedBlobReadsBack) {
+    GitRepository repo(tempDir);
+    std::string sha = hash_object(repo, "hello\n", "blob", true);
+
+    EXPECT_EQ(sha, "ce013625030ba8dba906f756967f9e9ca394464a");
+    EXPECT_EQ(find_object(repo, sha.substr(0, 7)), sha);
+
+    auto obj = read_object(repo, sha);
+    EXPECT_EQ(obj->get_type(), "blob");
+    EXPECT_EQ(obj->get_content(), "hello\n");
+}
+
+TEST_F(GitObjectTest, ConcurrentReadsShareOneHandle) {
+    GitRepository repo(tempDir);
+    std::vector<std::string> shas;
+    for (int i = 0; i < 32; ++i) {
+        shas.push_back(hash_object(repo, "blob " + std::to_string(i), "blob", true));
+    }
+
+    std::atomic<int> mismatches{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&]() {
+            for (int round = 0; round < 20; ++round) {
+                for (size_t i = 0; i < shas.size(); ++i) {
+                    if (read_object(repo, shas[i])->get_content() != "blob " + std::to_string(i)) {
+                        ++mismatches;
+                    }
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(mismatches.load(), 0);
+}
+
+TEST_F(GitObjectTest, HandlesOwnTheirConfig) {
+    fs::path otherDir = tempDir / "other";
+    fs::create_directory(otherDir);
+    GitRepository::repo_create(otherDir);
+    {
+        std::ofstream fc(otherDir / ".git" / "config", std::ios::app);
+        fc << "objectcachesize=0\n";
+    }
+
+    GitRepository repo(tempDir);
+    GitRepository other(otherDir);
+    EXPECT_EQ(repo.config.get("core", "objectcachesize", "unset"), "unset");
+    EXPECT_EQ(other.config.get("core", "objectcachesize", "unset"), "0");
+    EXPECT_EQ(repo.object_cache().capacity(), ObjectCache::default_capacity);
+    EXPECT_EQ(other.object_cache().capacity(), 0u);
+}
+
+TEST_F(GitObjectTest, TypedReadsCheckTheHeader) {
+    GitRepository repo(tempDir);
+    std::string blob = hash_object(repo, "hello\n", "blob", true);
+    std::string tree = write_raw_object(repo, "tree", "100644 hello" + std::string(1, '\0') + std::string(20, '\x01'));
+
+    EXPECT_EQ(read_blob(repo, blob)->get_content(), "hello\n");
+    EXPECT_EQ(read_object(repo, blob)->get_object_type(), ObjectType::Blob);
+    EXPECT_THROW(read_tree(repo, blob), std::runtime_error);
+    // A cached object is checked the same way.
+    EXPECT_THROW(read_commit(repo, blob), std::runtime_error);
+
+    auto parsed = read_tree(repo, tree);
+    ASSERT_EQ(parsed->get_entries().size(), 1u);
+    EXPECT_EQ(parsed->get_entries()[0].sha, "0101010101010101010101010101010101010101");
+    EXPECT_THROW(object_as<GitCommit>(read_object(repo, tree), tree), std::runtime_error);
+}
@@ -0,0 +1,244 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <zlib.h>
+
+#include "repository.h"
+#include "object.h"
+#include "pack.h"
+#include "fsck.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::string deflate_string(const std::string &data) {
+    uLongf len = compressBound(data.size());
+    std::string out(len, '\0');
+    compress2(reinterpret_cast<Bytef *>(out.data()), &len, reinterpret_cast<const Bytef *>(data.data()), data.size(),
+              Z_DEFAULT_COMPRESSION);
+    out.resize(len);
+    return out;
+}
+
+std::string entry_header(int type, size_t size) {
+    std::string out;
+    unsigned char c = (type << 4) | (size & 15);
+    size >>= 4;
+    while (size) {
+        out += static_cast<char>(c | 0x80);
+        c = size & 0x7f;
+        size >>= 7;
+    }
+    out += static_cast<char>(c);
+    return out;
+}
+
+std::string blob_id(const std::string &content) {
+    SHA1 hasher;
+    hasher.update("blob " + std::to_string(content.size()) + std::string(1, '\0') + content);
+    return hasher.final();
+}
+
+std::string hex_to_bytes(const std::string &hex) {
+    std::string out;
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        out += static_cast<char>(std::stoi(hex.substr(i, 2), nullptr, 16));
+    }
+    return out;
+}
+
+}
+
+class PackTest : public ::testing::Test {
+protected:
+    fs::path tempDir;
+
+    void SetUp() override {
+        tempDir = fs::temp_directory_path() / fs::path("git_pack_test_repo");
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+        fs::create_directory(tempDir);
+        GitRepository::repo_create(tempDir);
+    }
+
+    void TearDown() override {
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+    }
+
+    // A blob plus an OFS_DELTA that copies its first 6 bytes and appends
+    // "world\n".
+    fs::path write_pack() {
+        std::string base = "hello there\n";
+        std::string delta;
+        delta += static_cast<char>(base.size());
+        delta += static_cast<char>(12);
+        delta += static_cast<char>(0x90);
+        delta += static_cast<char>(6);
+        delta += static_cast<char>(6);
+        delta += "world\n";
+
+        std::string pack("PACK\0\0\0\2\0\0\0\2", 12);
+        size_t base_offset = pack.size();
+        pack += entry_header(3, base.size()) + deflate_string(base);
+        size_t delta_offset = pack.size();
+        pack += entry_header(6, delta.size());
+        pack += static_cast<char>(delta_offset - base_offset);
+        pack += deflate_string(delta);
+        SHA1 hasher;
+        hasher.update(pack);
+        pack += hex_to_bytes(hasher.final());
+
+        fs::path path = tempDir / "test.pack";
+        std::ofstream out(path, std::ios::binary);
+        out << pack;
+        return path;
+    }
+
+    // Indexes pack into objects/pack so the repository reads from it.
+    void install_pack(const GitRepository &repo, const fs::path &pack, const std::string &name) {
+        fs::path pack_dir = tempDir / ".git" / "objects" / "pack";
+        fs::create_directories(pack_dir);
+        fs::copy_file(pack, pack_dir / (name + ".pack"));
+        IndexPackOptions options;
+        options.index_path = pack_dir / (name + ".idx");
+        index_pack(repo, pack_dir / (name + ".pack"), options);
+    }
+
+    fs::path write_blob_pack(const std::string &content) {
+        std::string pack("PACK\0\0\0\2\0\0\0\1", 12);
+        pack += entry_header(3, content.size()) + deflate_string(content);
+        SHA1 hasher;
+        hasher.update(pack);
+        pack += hex_to_bytes(hasher.final());
+        fs::path path = tempDir / "blob.pack";
+        std::ofstream out(path, std::ios::binary);
+        out << pack;
+        return path;
+    }
+};
+
+TEST_F(PackTest, UnpackResolvesDeltas) {
+    GitRepository repo(tempDir);
+    IndexPackOptions options;
+    options.unpack = true;
+    options.threads = 2;
+    IndexPackResult result = index_pack(repo, write_pack(), options);
+
+    EXPECT_EQ(result.objects, 2u);
+    EXPECT_EQ(result.deltas, 1u);
+    EXPECT_EQ(read_object(repo, blob_id("hello there\n"))->get_content(), "hello there\n");
+    EXPECT_EQ(read_object(repo, blob_id("hello world\n"))->get_content(), "hello world\n");
+}
+
+TEST_F(PackTest, IndexHasFanoutAndChecksum) {
+    GitRepository repo(tempDir);
+    fs::path pack = write_pack();
+    IndexPackResult result = index_pack(repo, pack, IndexPackOptions());
+
+    std::ifstream in(tempDir / "test.idx", std::ios::binary);
+    std::string idx((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    ASSERT_EQ(idx.size(), 8 + 256 * 4 + 2 * (20 + 4 + 4) + 40);
+    EXPECT_EQ(idx.substr(0, 8), std::string("\377tOc\0\0\0\2", 8));
+    EXPECT_EQ(static_cast<unsigned char>(idx[8 + 255 * 4 + 3]), 2);
+    EXPECT_EQ(idx.substr(idx.size() - 40, 20), hex_to_bytes(result.pack_checksum));
+}
+
+TEST_F(PackTest, RejectsCorruptChecksum) {
+    GitRepository repo(tempDir);
+    fs::path pack = write_pack();
+    {
+        std::fstream file(pack, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(-1, std::ios::end);
+        file.put('\0');
+    }
+    EXPECT_THROW(index_pack(repo, pack, IndexPackOptions()), std::runtime_error);
+}
+
+TEST_F(PackTest, ReadsPackedObjectsThroughMultiPackIndex) {
+    GitRepository repo(tempDir);
+    fs::path pack = write_pack();
+    for (const std::string name : {"pack-a", "pack-b"}) {
+        install_pack(repo, pack, name);
+    }
+
+    std::string world = blob_id("hello world\n");
+    EXPECT_EQ(read_object(repo, world)->get_content(), "hello world\n");
+    EXPECT_EQ(find_object(repo, world.substr(0, 7)), world);
+    EXPECT_EQ(repo.packs().pack_count(), 2u);
+    EXPECT_FALSE(repo.packs().uses_multi_pack_index());
+
+    MultiPackIndexStats stats = write_multi_pack_index(repo);
+    EXPECT_EQ(stats.packs, 2u);
+    EXPECT_EQ(stats.objects, 2u);
+    EXPECT_EQ(stats.duplicates, 2u);
+    EXPECT_TRUE(repo.packs().uses_multi_pack_index());
+
+    GitRepository reopened(tempDir);
+    EXPECT_TRUE(reopened.packs().uses_multi_pack_index());
+    EXPECT_EQ(read_object(reopened, blob_id("hello there\n"))->get_content(), "hello there\n");
+    EXPECT_EQ(find_object(reopened, world.substr(0, 7)), world);
+    EXPECT_THROW(read_object(reopened, std::string(40, 'f')), std::runtime_error);
+}
+
+TEST_F(PackTest, FsckChecksPackedObjects) {
+    GitRepository repo(tempDir);
+    install_pack(repo, write_pack(), "pack-a");
+    // A loose tree pointing at both packed blobs.
+    std::string tree = write_raw_object(repo, "tree",
+                                        "100644 a" + std::string(1, '\0') + hex_to_bytes(blob_id("hello there\n")) +
+                                        "100644 b" + std::string(1, '\0') + hex_to_bytes(blob_id("hello world\n")));
+
+    std::ostringstream out, err;
+    FsckReport report = fsck_objects(repo, FsckOptions(), out, err);
+    EXPECT_EQ(report.objects, 3u);
+    EXPECT_EQ(report.corrupt, 0u);
+    EXPECT_EQ(report.missing, 0u);
+    EXPECT_EQ(out.str(), "dangling tree " + tree + "\n");
+}
+
+TEST_F(PackTest, ReadsPackedHeadersAndStreamsPackedBlobs) {
+    GitRepository repo(tempDir);
+    install_pack(repo, write_pack(), "pack-a");
+    std::string large(1 << 20, '\0');
+    for (size_t i = 0; i < large.size(); ++i) {
+        large[i] = static_cast<char>('a' + (i * 7919) % 26);
+    }
+    install_pack(repo, write_blob_pack(large), "pack-b");
+
+    ObjectHeader delta = read_object_header(repo, blob_id("hello world\n"));
+    EXPECT_EQ(delta.type, "blob");
+    EXPECT_EQ(delta.size, 12u);
+    EXPECT_EQ(read_object_header(repo, blob_id(large)).size, large.size());
+
+    std::string streamed;
+    size_t chunks = 0;
+    size_t largest = 0;
+    ObjectHeader seen;
+    stream_object(repo, blob_id(large), [&](const ObjectHeader &header) {
+        seen = header;
+    }, [&](const unsigned char *data, size_t len) {
+        streamed.append(reinterpret_cast<const char *>(data), len);
+        ++chunks;
+        largest = std::max(largest, len);
+    });
+    EXPECT_EQ(seen.size, large.size());
+    EXPECT_EQ(streamed, large);
+    EXPECT_GT(chunks, 1u);
+    EXPECT_LE(largest, 128u * 1024);
+
+    // A rejected header stops the read before anything is inflated.
+    struct Rejected {};
+    bool sunk = false;
+    EXPECT_THROW(stream_object(repo, blob_id("hello world\n"), [](const ObjectHeader &) {
+        throw Rejected{};
+    }, [&](const unsigned char *, size_t) {
+        sunk = true;
+    }), Rejected);
+    EXPECT_FALSE(sunk);
+}
@@ -0,0 +1,43 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "pathspec.h"
+
+TEST(PathspecTest, EmptySelectsEverything) {
+    Pathspec pathspec;
+    EXPECT_TRUE(pathspec.matches("any/path.txt"));
+    EXPECT_TRUE(pathspec.may_match_under("any"));
+}
+
+TEST(PathspecTest, LiteralSelectsPathAndBelow) {
+    Pathspec pathspec({"src/sub/"});
+    EXPECT_TRUE(pathspec.matches("src/sub"));
+    EXPECT_TRUE(pathspec.matches("src/sub/c.h"));
+    EXPECT_FALSE(pathspec.matches("src/subway/c.h"));
+    EXPECT_FALSE(pathspec.matches("src/b.c"));
+
+    EXPECT_TRUE(pathspec.may_match_under("src"));
+    EXPECT_TRUE(pathspec.may_match_under("src/sub/deeper"));
+    EXPECT_FALSE(pathspec.may_match_under("docs"));
+    EXPECT_FALSE(pathspec.may_match_under("src/subway"));
+}
+
+TEST(PathspecTest, GlobPrunesByLiteralPrefix) {
+    Pathspec pathspec({"src/*.c", "/docs/*/index.md"});
+    EXPECT_TRUE(pathspec.matches("src/b.c"));
+    EXPECT_TRUE(pathspec.matches("src/sub/b.c"));
+    EXPECT_FALSE(pathspec.matches("src/b.h"));
+    EXPECT_TRUE(pathspec.matches("docs/api/index.md"));
+
+    EXPECT_TRUE(pathspec.may_match_under("src/sub"));
+    EXPECT_TRUE(pathspec.may_match_under("docs"));
+    EXPECT_FALSE(pathspec.may_match_under("lib"));
+    EXPECT_FALSE(pathspec.may_match_under("srcx"));
+}
+
+TEST(PathspecTest, GlobMatchingDirectorySelectsContents) {
+    Pathspec pathspec({"build-*"});
+    EXPECT_TRUE(pathspec.matches("build-linux/out/app"));
+    EXPECT_FALSE(pathspec.matches("src/build-linux"));
+}
@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "repository.h"
+#include "object.h"
+#include "prefetch.h"
+
+namespace fs = std::filesystem;
+
+class PrefetchTest : public ::testing::Test {
+protected:
+    fs::path tempDir;
+
+    void SetUp() override {
+        tempDir = fs::temp_directory_path() / fs::path("git_prefetch_test_repo");
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+        fs::create_directory(tempDir);
+        GitRepository::repo_create(tempDir);
+    }
+
+    void TearDown() override {
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+    }
+
+    static std::string content(int i) {
+        return std::string(64 * 1024, static_cast<char>('a' + i % 26)) + std::to_string(i);
+    }
+
+    // Waits until the workers have nothing left they are allowed to start:
+    // nothing loading, and either nothing queued or the budget used up.
+    static ObjectPrefetcher::Stats settle(ObjectPrefetcher &prefetcher, size_t budget) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+        while (true) {
+            auto stats = prefetcher.stats();
+            bool idle = stats.loading == 0 && (stats.queued == 0 || stats.ready_bytes >= budget);
+            if (idle || std::chrono::steady_clock::now() > deadline) {
+                return stats;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+};
+
+TEST_F(PrefetchTest, BudgetStallsWorkersUntilObjectsAreTaken) {
+    GitRepository repo(tempDir);
+    std::vector<std::string> ids;
+    for (int i = 0; i < 20; ++i) {
+        ids.push_back(write_raw_object(repo, "blob", content(i)));
+    }
+    constexpr size_t budget = 1;
+    ObjectPrefetcher prefetcher(repo, 2, budget);
+    prefetcher.prefetch(ids);
+
+    // Each worker claims at most one object before the first one fills the
+    // budget, so the rest stay queued.
+    auto stalled = settle(prefetcher, budget);
+    EXPECT_GE(stalled.ready, 1u);
+    EXPECT_LE(stalled.ready, 2u);
+    EXPECT_EQ(stalled.loading, 0u);
+    EXPECT_EQ(stalled.queued + stalled.ready, ids.size());
+
+    // A queued id is read inline and leaves the queue.
+    EXPECT_EQ(prefetcher.get(ids.back())->serialize(), content(19));
+    EXPECT_EQ(prefetcher.stats().queued, stalled.queued - 1);
+
+    // Taking objects frees the budget and the workers move on.
+    for (int i = 0; i + 1 < 20; ++i) {
+        EXPECT_EQ(prefetcher.get(ids[i])->serialize(), content(i));
+    }
+    auto drained = prefetcher.stats();
+    EXPECT_EQ(drained.queued + drained.loading + drained.ready + drained.failed, 0u);
+    EXPECT_EQ(drained.ready_bytes, 0u);
+}
+
+TEST_F(PrefetchTest, CancelledIdsAreDropped) {
+    GitRepository repo(tempDir);
+    std::vector<std::string> ids;
+    for (int i = 0; i < 20; ++i) {
+        ids.push_back(write_raw_object(repo, "blob", content(i)));
+    }
+    ObjectPrefetcher prefetcher(repo, 2, 1);
+    prefetcher.prefetch(ids);
+    settle(prefetcher, 1);
+    prefetcher.cancel(std::vector<std::string>(ids.begin(), ids.begin() + 10));
+    auto half = settle(prefetcher, 1);
+    EXPECT_EQ(half.queued + half.loading + half.ready, 10u);
+
+    prefetcher.cancel_all();
+    auto empty = prefetcher.stats();
+    EXPECT_EQ(empty.queued + empty.loading + empty.ready + empty.failed, 0u);
+    EXPECT_EQ(empty.ready_bytes, 0u);
+    // Dropped ids can still be read; they are just not buffered.
+    EXPECT_EQ(prefetcher.get(ids[3])->serialize(), content(3));
+}
+
+TEST_F(PrefetchTest, LoadErrorsReachGet) {
+    GitRepository repo(tempDir);
+    std::string good = write_raw_object(repo, "blob", "fine\n");
+    std::string absent(40, 'e');
+    ObjectPrefetcher prefetcher(repo, 1);
+    prefetcher.prefetch({absent, good});
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (prefetcher.stats().failed == 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(prefetcher.stats().failed, 1u);
+    EXPECT_THROW(prefetcher.get(absent), std::runtime_error);
+    EXPECT_EQ(prefetcher.get(good)->serialize(), "fine\n");
+    EXPECT_EQ(prefetcher.stats().failed, 0u);
+}
@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "repository.h"
+#include "object.h"
+#include "ewah.h"
+#include "reachability.h"
+
+namespace fs = std::filesystem;
+
+TEST(EwahTest, RoundTripsRunsAndLiterals) {
+    std::vector<uint64_t> plain(200, 0);
+    for (size_t i = 10; i < 150; ++i) {
+        plain[i] = ~uint64_t(0);
+    }
+    plain[3] = 0x5;
+    plain[170] = uint64_t(1) << 63;
+    EwahBitmap bitmap = EwahBitmap::compress(plain, 200 * 64);
+    EXPECT_LT(bitmap.word_count(), 10u);
+
+    std::string bytes;
+    bitmap.serialize(bytes);
+    size_t used = 0;
+    EwahBitmap loaded = EwahBitmap::deserialize(reinterpret_cast<const unsigned char *>(bytes.data()), bytes.size(), used);
+    EXPECT_EQ(used, bytes.size());
+    EXPECT_EQ(loaded.bit_size(), 200u * 64);
+
+    std::vector<uint64_t> out(200, 0);
+    out[0] = 0x2;
+    loaded.or_into(out);
+    plain[0] |= 0x2;
+    EXPECT_EQ(out, plain);
+}
+
+class ReachabilityTest : public ::testing::Test {
+protected:
+    fs::path tempDir;
+
+    void SetUp() override {
+        tempDir = fs::temp_directory_path() / fs::path("git_reachability_test_repo");
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+        fs::create_directory(tempDir);
+        GitRepository::repo_create(tempDir);
+    }
+
+    void TearDown() override {
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+    }
+
+    static std::string hex_to_bytes(const std::string &hex) {
+        std::string out;
+        for (size_t i = 0; i < hex.size(); i += 2) {
+            out += static_cast<char>(std::stoi(hex.substr(i, 2), nullptr, 16));
+        }
+        return out;
+    }
+
+    // A commit whose tree holds one file with the given content.
+    std::string commit(const GitRepository &repo, const std::string &content, const std::string &parent) {
+        std::string blob = write_raw_object(repo, "blob", content);
+        std::string tree = write_raw_object(repo, "tree", "100644 file" + std::string(1, '\0') + hex_to_bytes(blob));
+        std::string body = "tree " + tree + "\n";
+        if (!parent.empty()) {
+            body += "parent " + parent + "\n";
+        }
+        body += "author a <a@b> 0 +0000\ncommitter a <a@b> 0 +0000\n\n" + content;
+        return write_raw_object(repo, "commit", body);
+    }
+
+    std::set<std::string> list(const GitRepository &repo, const std::vector<std::string> &include,
+                               const std::vector<std::string> &exclude, bool use_bitmaps) {
+        RevListOptions options;
+        options.objects = true;
+        options.use_bitmaps = use_bitmaps;
+        std::set<std::string> seen;
+        size_t count = rev_list(repo, include, exclude, options, [&](const std::string &sha, const std::string &) {
+            seen.insert(sha);
+        });
+        EXPECT_EQ(count, seen.size());
+        return seen;
+    }
+};
+
+TEST_F(ReachabilityTest, BitmapsMatchGraphWalk) {
+    GitRepository repo(tempDir);
+    std::vector<std::string> commits;
+    for (int i = 0; i < 12; ++i) {
+        commits.push_back(commit(repo, "v" + std::to_string(i) + "\n", commits.empty() ? "" : commits.back()));
+    }
+    auto all = list(repo, {commits.back()}, {}, false);
+    EXPECT_EQ(all.size(), 12u * 3);
+    auto tail = list(repo, {commits.back()}, {commits[7]}, false);
+    EXPECT_EQ(tail.size(), 4u * 3);
+
+    BitmapWriteStats stats = write_reachability_bitmaps(repo, {commits[9]}, 4);
+    EXPECT_EQ(stats.objects, 10u * 3);
+    EXPECT_EQ(stats.commits, 3u);
+    EXPECT_EQ(list(repo, {commits.back()}, {}, true), all);
+    EXPECT_EQ(list(repo, {commits.back()}, {commits[7]}, true), tail);
+}
+
+TEST_F(ReachabilityTest, CorruptBitmapPositionsThrow) {
+    GitRepository repo(tempDir);
+    std::vector<std::string> commits;
+    for (int i = 0; i < 4; ++i) {
+        commits.push_back(commit(repo, "v" + std::to_string(i) + "\n", commits.empty() ? "" : commits.back()));
+    }
+    BitmapWriteStats stats = write_reachability_bitmaps(repo, {commits.back()}, 2);
+
+    // Point every lookup entry past the end of the object table.
+    fs::path path = reachability_bitmap_path(repo);
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    size_t lookup = 16 + stats.objects * 21;
+    for (size_t i = 0; i < stats.objects; ++i) {
+        file.seekp(std::streamoff(lookup + i * 4));
+        file.write("\xff\xff\xff\xff", 4);
+    }
+    file.close();
+    EXPECT_THROW(list(repo, {commits.back()}, {}, true), std::runtime_error);
+}
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "repository.h"
+#include "refs.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::string sha_of(char c) {
+    return std::string(40, c);
+}
+
+}
+
+class RefStoreTest : public ::testing::Test {
+protected:
+    fs::path tempDir;
+
+    void SetUp() override {
+        tempDir = fs::temp_directory_path() / fs::path("git_refs_test_repo");
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+        fs::create_directory(tempDir);
+        GitRepository::repo_create(tempDir);
+    }
+
+    void TearDown() override {
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+    }
+
+    void write_file(const fs::path &relative, const std::string &content) {
+        fs::path path = tempDir / ".git" / relative;
+        fs::create_directories(path.parent_path());
+        std::ofstream out(path);
+        out << content;
+    }
+};
+
+TEST_F(RefStoreTest, PackedRefsAreFoundByBinarySearch) {
+    std::string packed = "# pack-refs with: peeled fully-peeled sorted \n";
+    for (int i = 100; i < 600; ++i) {
+        packed += sha_of('a') + " refs/tags/t" + std::to_string(i) + "\n";
+        if (i % 7 == 0) {
+            packed += "^" + sha_of('b') + "\n";
+        }
+    }
+    write_file("packed-refs", packed);
+
+    GitRepository repo(tempDir);
+    RefStore refs(repo);
+    for (int i = 100; i < 600; ++i) {
+        EXPECT_EQ(refs.read("refs/tags/t" + std::to_string(i)), sha_of('a')) << i;
+    }
+    EXPECT_FALSE(refs.read("refs/tags/t099"));
+    EXPECT_FALSE(refs.read("refs/tags/t6000"));
+    EXPECT_EQ(refs.resolve("t350"), sha_of('a'));
+}
+
+TEST_F(RefStoreTest, LooseRefsOverridePackedAndListInOrder) {
+    write_file("packed-refs", "# pack-refs with: peeled fully-peeled sorted \n" +
+               sha_of('1') + " refs/heads/main\n" +
+               sha_of('1') + " refs/tags/v1\n" +
+               sha_of('1') + " refs/tags/v3\n");
+    write_file("refs/heads/main", sha_of('2') + "\n");
+    write_file("refs/tags/v2", sha_of('3') + "\n");
+    write_file("HEAD", "ref: refs/heads/main\n");
+
+    GitRepository repo(tempDir);
+    RefStore refs(repo);
+    EXPECT_EQ(refs.read("HEAD"), sha_of('2'));
+    EXPECT_EQ(refs.resolve("main"), sha_of('2'));
+
+    std::vector<std::string> names;
+    refs.for_each([&](const std::string &name, const std::string &sha) {
+        names.push_back(name + " " + sha.substr(0, 1));
+    });
+    EXPECT_EQ(names, (std::vector<std::string>{"refs/heads/main 2", "refs/tags/v1 1", "refs/tags/v2 3", "refs/tags/v3 1"}));
+
+    names.clear();
+    refs.for_each([&](const std::string &name, const std::string &) {
+        names.push_back(name);
+    }, "refs/tags/");
+    EXPECT_EQ(names, (std::vector<std::string>{"refs/tags/v1", "refs/tags/v2", "refs/tags/v3"}));
+}
+
+TEST_F(RefStoreTest, UnsortedPackedRefsStillResolve) {
+    write_file("packed-refs", sha_of('c') + " refs/tags/zeta\n" + sha_of('d') + " refs/tags/alpha\n");
+
+    GitRepository repo(tempDir);
+    RefStore refs(repo);
+    EXPECT_EQ(refs.resolve("alpha"), sha_of('d'));
+    EXPECT_EQ(refs.resolve("zeta"), sha_of('c'));
+    EXPECT_FALSE(refs.resolve("../config"));
+}
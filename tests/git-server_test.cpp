@@ -0,0 +1,150 @@
+#include <gtest/gtest.h>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "repository.h"
+#include "object.h"
+#include "binaryIO.h"
+#include "gitTree.h"
+#include "prefetch.h"
+#include "server.h"
+
+namespace fs = std::filesystem;
+
+class ServerTest : public ::testing::Test {
+protected:
+    fs::path tempDir;
+    fs::path socketPath;
+
+    void SetUp() override {
+        tempDir = fs::temp_directory_path() / fs::path("git_server_test_repo");
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+        fs::create_directory(tempDir);
+        GitRepository::repo_create(tempDir);
+        socketPath = tempDir / "serve.sock";
+    }
+
+    void TearDown() override {
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+    }
+
+    // The read-only subset of `serve`, answered through one long-lived handle.
+    static int handle(GitRepository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err) {
+        if (args.size() == 4 && args[1] == "cat-file" && args[2] == "-p") {
+            out << read_object(repo, args[3])->get_content() << std::endl;
+            return 0;
+        }
+        if (args.size() == 3 && args[1] == "ls-tree") {
+            read_tree(repo, args[2])->recursive_ls_tree(repo, args[2], "", out);
+            return 0;
+        }
+        err << "Unsupported command" << std::endl;
+        return 1;
+    }
+
+    // A raw client, for requests ServerClient will not send.
+    int connect_raw() {
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+        EXPECT_EQ(::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)), 0);
+        return fd;
+    }
+
+    static void send_all(int fd, const std::string &data) {
+        ASSERT_EQ(::send(fd, data.data(), data.size(), MSG_NOSIGNAL), ssize_t(data.size()));
+    }
+
+    static std::string read_to_eof(int fd) {
+        std::string data;
+        char buf[4096];
+        ssize_t n;
+        while ((n = ::read(fd, buf, sizeof(buf))) > 0) {
+            data.append(buf, n);
+        }
+        return data;
+    }
+
+    static std::string request_frame(const std::string &payload) {
+        std::string frame;
+        put_be(frame, payload.size(), 4);
+        return frame + payload;
+    }
+};
+
+TEST_F(ServerTest, AnswersRequestsAndSurvivesBadClients) {
+    GitRepository repo(tempDir);
+    std::string blob = write_raw_object(repo, "blob", "hello\n");
+    std::string tree = write_raw_object(repo, "tree", "100644 a.txt" + std::string(1, '\0') + hex_to_bytes(blob));
+
+    ObjectServer server(socketPath, [&repo](const std::vector<std::string> &args, std::ostream &out, std::ostream &err) {
+        return handle(repo, args, out, err);
+    }, 2);
+    std::thread loop([&server]() {
+        server.run();
+    });
+
+    {
+        ServerClient client(socketPath);
+        ServerResponse cat = client.request({"cat-file", "-p", blob});
+        EXPECT_EQ(cat.status, 0);
+        EXPECT_EQ(cat.out, "hello\n\n");
+        for (int i = 0; i < 3; ++i) {
+            ServerResponse ls = client.request({"ls-tree", tree});
+            EXPECT_EQ(ls.status, 0);
+            EXPECT_EQ(ls.out, "100644 blob " + blob + "\ta.txt\n");
+        }
+        ServerResponse bad = client.request({"write-tree"});
+        EXPECT_EQ(bad.status, 1);
+        EXPECT_EQ(bad.err, "Unsupported command\n");
+    }
+    // Serial walks through the daemon's handle share one pooled prefetcher.
+    EXPECT_EQ(repo.prefetchers().idle(), 1u);
+
+    // A frame over the limit closes that connection without a reply.
+    int oversized = connect_raw();
+    send_all(oversized, std::string("\x04\x00\x00\x01", 4));
+    EXPECT_EQ(read_to_eof(oversized), "");
+    ::close(oversized);
+
+    // A client that hangs up mid-request, or before its reply, costs only itself.
+    int partial = connect_raw();
+    send_all(partial, request_frame(std::string("cat-file\0-p\0", 12) + blob).substr(0, 10));
+    ::close(partial);
+    int gone = connect_raw();
+    send_all(gone, request_frame(std::string("ls-tree\0", 8) + tree));
+    ::close(gone);
+
+    // A client that shuts down its side after sending still gets its reply.
+    int half_closed = connect_raw();
+    send_all(half_closed, request_frame(std::string("cat-file\0-p\0", 12) + blob));
+    ::shutdown(half_closed, SHUT_WR);
+    std::string reply = read_to_eof(half_closed);
+    ::close(half_closed);
+    ASSERT_EQ(reply.size(), 4u + 5 + 7);
+    EXPECT_EQ(reply.substr(9), "hello\n\n");
+
+    {
+        ServerClient client(socketPath);
+        EXPECT_EQ(client.request({"cat-file", "-p", blob}).out, "hello\n\n");
+    }
+
+    // run() only sees SIGTERM through its signalfd, so it must be sent to
+    // that thread; the round trips above guarantee it is blocked there.
+    pthread_kill(loop.native_handle(), SIGTERM);
+    loop.join();
+}
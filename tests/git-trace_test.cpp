@@ -0,0 +1,166 @@
+#include <gtest/gtest.h>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <regex>
+#include <sstream>
+#include <string>
+
+#include "repository.h"
+#include "object.h"
+#include "trace.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// A strict JSON syntax check, enough to know a trace viewer will load the file.
+class JsonChecker {
+public:
+    explicit JsonChecker(const std::string &text) : s(text) {}
+
+    bool valid() {
+        return value() && (skip_space(), pos == s.size());
+    }
+private:
+    const std::string &s;
+    size_t pos = 0;
+
+    void skip_space() {
+        while (pos < s.size() && std::isspace(static_cast<unsigned char>(s[pos]))) {
+            ++pos;
+        }
+    }
+    bool eat(char c) {
+        skip_space();
+        if (pos < s.size() && s[pos] == c) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+    bool string() {
+        if (!eat('"')) {
+            return false;
+        }
+        while (pos < s.size() && s[pos] != '"') {
+            if (static_cast<unsigned char>(s[pos]) < 0x20) {
+                return false;
+            }
+            pos += s[pos] == '\\' ? 2 : 1;
+        }
+        return pos++ < s.size();
+    }
+    bool number() {
+        static const std::regex pattern(R"(-?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?)");
+        std::smatch match;
+        if (!std::regex_search(s.begin() + pos, s.end(), match, pattern, std::regex_constants::match_continuous)) {
+            return false;
+        }
+        pos += match.length();
+        return true;
+    }
+    template <typename Item>
+    bool sequence(char close, Item item) {
+        if (eat(close)) {
+            return true;
+        }
+        do {
+            if (!item()) {
+                return false;
+            }
+        } while (eat(','));
+        return eat(close);
+    }
+    bool value() {
+        skip_space();
+        if (pos >= s.size()) {
+            return false;
+        }
+        switch (s[pos]) {
+        case '{':
+            ++pos;
+            return sequence('}', [this]() {
+                return string() && eat(':') && value();
+            });
+        case '[':
+            ++pos;
+            return sequence(']', [this]() {
+                return value();
+            });
+        case '"':
+            return string();
+        default:
+            for (const char *word : {"true", "false", "null"}) {
+                if (s.compare(pos, std::strlen(word), word) == 0) {
+                    pos += std::strlen(word);
+                    return true;
+                }
+            }
+            return number();
+        }
+    }
+};
+
+}
+
+class TraceTest : public ::testing::Test {
+protected:
+    fs::path tempDir;
+
+    void SetUp() override {
+        tempDir = fs::temp_directory_path() / fs::path("git_trace_test_repo");
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+        fs::create_directory(tempDir);
+        GitRepository::repo_create(tempDir);
+    }
+
+    void TearDown() override {
+        unsetenv("GIT_CLI_TRACE");
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+    }
+};
+
+TEST_F(TraceTest, CountsReadsAndWritesChromeJson) {
+    std::string content(10000, 'x');
+    std::string sha = write_raw_object(GitRepository(tempDir), "blob", content);
+
+    fs::path output = tempDir / "trace.json";
+    setenv("GIT_CLI_TRACE", ("perf:" + output.string()).c_str(), 1);
+    Trace::init_from_env();
+    ASSERT_TRUE(Trace::enabled());
+    uint64_t objects = Trace::counter(TraceCounter::ObjectsRead);
+    uint64_t bytes = Trace::counter(TraceCounter::BytesRead);
+
+    // A fresh handle has a cold cache, so this goes to the object file.
+    GitRepository repo(tempDir);
+    EXPECT_EQ(read_object(repo, sha)->get_content(), content);
+    EXPECT_GT(Trace::counter(TraceCounter::ObjectsRead), objects);
+    EXPECT_GT(Trace::counter(TraceCounter::BytesRead), bytes);
+
+    // report() writes the file once and switches tracing back off.
+    Trace::report();
+    EXPECT_FALSE(Trace::enabled());
+    std::ifstream in(output);
+    std::stringstream json;
+    json << in.rdbuf();
+    std::string text = json.str();
+    EXPECT_TRUE(JsonChecker(text).valid()) << text;
+    EXPECT_NE(text.find("\"name\":\"read_object\""), std::string::npos);
+
+    // Every timestamp and duration keeps its nanoseconds: microseconds with
+    // exactly three decimals, never exponent notation.
+    static const std::regex field(R"re("(ts|dur)":([^,}]*))re");
+    static const std::regex micros(R"([0-9]+\.[0-9]{3})");
+    size_t fields = 0;
+    for (std::sregex_iterator it(text.begin(), text.end(), field), end; it != end; ++it, ++fields) {
+        EXPECT_TRUE(std::regex_match((*it)[2].str(), micros)) << (*it)[0];
+    }
+    EXPECT_GE(fields, 2u);
+}
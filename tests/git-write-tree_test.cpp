@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "repository.h"
+#include "object.h"
+#include "gitTree.h"
+#include "dirSnapshot.h"
+
+namespace fs = std::filesystem;
+
+class WriteTreeTest : public ::testing::Test {
+protected:
+    fs::path tempDir;
+
+    void SetUp() override {
+        tempDir = fs::temp_directory_path() / fs::path("git_write_tree_test_repo");
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+        fs::create_directory(tempDir);
+        GitRepository::repo_create(tempDir);
+    }
+
+    void TearDown() override {
+        if (fs::exists(tempDir)) {
+            fs::remove_all(tempDir);
+        }
+    }
+
+    void write_file(const fs::path &path, const std::string &content) {
+        fs::create_directories(path.parent_path());
+        std::ofstream(path, std::ios::binary) << content;
+    }
+};
+
+TEST(TreeOrderTest, OnlySubtreesSortAsIfEndingInSlash) {
+    EXPECT_TRUE(tree_entry_less({"100644", "a-b", ""}, {"40000", "a", ""}));
+    EXPECT_TRUE(tree_entry_less({"40000", "a", ""}, {"100644", "a0", ""}));
+    EXPECT_TRUE(tree_entry_less({"120000", "a", ""}, {"100644", "a-b", ""}));
+    EXPECT_TRUE(tree_entry_less({"160000", "a", ""}, {"100644", "a-b", ""}));
+    EXPECT_FALSE(tree_entry_less({"100644", "a", ""}, {"100644", "a", ""}));
+}
+
+// The ids are the ones `git add -A && git write-tree` gives for this
+// worktree.
+TEST_F(WriteTreeTest, MatchesGitWriteTree) {
+    fs::path src = tempDir / "src";
+    write_file(src / "a" / "f", "one\n");
+    write_file(src / "a.txt", "two\n");
+    write_file(src / "a-b", "three\n");
+    write_file(src / "a.b" / "g", "four\n");
+    write_file(src / "run.sh", "#!/bin/sh\n");
+    fs::permissions(src / "run.sh", fs::perms::owner_exec, fs::perm_options::add);
+    fs::create_symlink("a.txt", src / "link");
+    fs::create_directories(src / "empty" / "inner");
+
+    GitRepository repo(tempDir);
+    SnapshotOptions options;
+    options.threads = 4;
+    SnapshotStats stats = write_tree_from_dir(repo, tempDir, options);
+    EXPECT_EQ(stats.tree, "25a49829a37bed113e2e4b8d10d9632022f0df65");
+    EXPECT_EQ(stats.files, 6u);
+    EXPECT_EQ(stats.trees, 4u);
+    EXPECT_EQ(stats.written, 10u);
+    EXPECT_EQ(read_object_header(repo, "5e7b584bca77907a60deb57667d0536697faa2fe").type, "tree");
+
+    // Everything is stored already, so nothing is written again.
+    options.threads = 1;
+    SnapshotStats again = write_tree_from_dir(repo, tempDir, options);
+    EXPECT_EQ(again.tree, stats.tree);
+    EXPECT_EQ(again.written, 0u);
+}
+
+TEST_F(WriteTreeTest, SnapshotsManyFilesInParallel) {
+    fs::path src = tempDir / "src";
+    for (int i = 0; i < 500; ++i) {
+        write_file(src / ("d" + std::to_string(i % 7)) / ("d" + std::to_string(i % 3)) / ("f" + std::to_string(i)),
+                   "file " + std::to_string(i % 50) + "\n");
+    }
+    GitRepository repo(tempDir);
+    SnapshotOptions options;
+    options.threads = 8;
+    SnapshotStats parallel = write_tree_from_dir(repo, src, options);
+    EXPECT_EQ(parallel.files, 500u);
+    EXPECT_EQ(parallel.trees, 1u + 7u + 21u);
+    // 50 distinct blobs and 29 distinct trees; two threads that hash the
+    // same content at once may both write it.
+    EXPECT_GE(parallel.written, 50u + 29u);
+    EXPECT_LE(parallel.written, 500u + 29u);
+
+    options.threads = 1;
+    EXPECT_EQ(write_tree_from_dir(repo, src, options).tree, parallel.tree);
+    EXPECT_THROW(write_tree_from_dir(repo, src / "d0" / "d0" / "f0"), std::runtime_error);
+}